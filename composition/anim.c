@@ -0,0 +1,116 @@
+/*****************************************************************************
+ * anim.c
+ *
+ *    plane animations
+ *        - easing curves
+ *        - per plane interpolation of position, size, alpha and rotation
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *   
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *   
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+#include "anim.h"
+
+/* Map the elapsed fraction t [0, 1] of an animation onto its progress */
+float anim_ease (int easing, float t)
+{
+    if (t <= 0.0f) return 0.0f;
+    if (t >= 1.0f) return 1.0f;
+
+    switch (easing)
+    {
+        case ANIM_EASE_IN:
+            return t * t;
+        case ANIM_EASE_OUT:
+            return t * (2.0f - t);
+        case ANIM_EASE_IN_OUT:
+            return t * t * (3.0f - 2.0f * t);
+        case ANIM_EASE_LINEAR:
+        default:
+            return t;
+    }
+}
+
+/* Start moving from the current state to the target of an animation message */
+void anim_start (planeAnimation_s *anim, const planeState_s *cur,
+                 const planeAnim_s *msg, long long now_us)
+{
+    anim->mask        = msg->mask;
+    anim->easing      = msg->easing;
+    anim->start_us    = now_us;
+    anim->duration_us = (long long)msg->duration_ms * 1000;
+    anim->from        = *cur;
+    anim->to          = *cur;
+
+    if (msg->mask & ANIM_POSITION) {
+        anim->to.xpos = msg->target.xpos;
+        anim->to.ypos = msg->target.ypos;
+    }
+    if (msg->mask & ANIM_SIZE) {
+        anim->to.width  = msg->target.width;
+        anim->to.height = msg->target.height;
+    }
+    if (msg->mask & ANIM_ALPHA)
+        anim->to.alpha = msg->target.alpha;
+    if (msg->mask & ANIM_ROTATE)
+        anim->to.rotate = msg->target.rotate;
+
+    anim->active = 1;
+}
+
+#define LERP(a, b, p)   ((a) + ((b) - (a)) * (p))
+
+/* Advance an animation to now_us and store the plane state in cur.
+   Returns 1 if the state was updated; the animation ends at its target */
+int anim_step (planeAnimation_s *anim, long long now_us, planeState_s *cur)
+{
+    float p;
+
+    if (!anim->active)
+        return 0;
+
+    if (now_us - anim->start_us >= anim->duration_us) {
+        p = 1.0f;
+        anim->active = 0;
+    } else {
+        p = anim_ease (anim->easing,
+                       (float)(now_us - anim->start_us) / anim->duration_us);
+    }
+
+    cur->xpos   = LERP (anim->from.xpos,   anim->to.xpos,   p);
+    cur->ypos   = LERP (anim->from.ypos,   anim->to.ypos,   p);
+    cur->width  = LERP (anim->from.width,  anim->to.width,  p);
+    cur->height = LERP (anim->from.height, anim->to.height, p);
+    cur->alpha  = LERP (anim->from.alpha,  anim->to.alpha,  p);
+    cur->rotate = LERP (anim->from.rotate, anim->to.rotate, p);
+
+    return 1;
+}
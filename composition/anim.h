@@ -0,0 +1,72 @@
+/*****************************************************************************
+ * anim.h
+ *
+ *    plane animations
+ *        - easing curves
+ *        - per plane interpolation of position, size, alpha and rotation
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *   
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *   
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+#ifndef __ANIM_H__
+#define __ANIM_H__
+
+#include "../gpucomp.h"
+
+/* What can be animated on a plane */
+typedef struct
+{
+    float xpos;
+    float ypos;
+    float width;
+    float height;
+    float alpha;
+    float rotate;
+} planeState_s;
+
+typedef struct
+{
+    int          active;
+    int          mask;          /* ANIM_POSITION | ANIM_SIZE | ... */
+    int          easing;
+    long long    start_us;
+    long long    duration_us;
+    planeState_s from;
+    planeState_s to;
+} planeAnimation_s;
+
+float anim_ease (int easing, float t);
+void  anim_start (planeAnimation_s *anim, const planeState_s *cur,
+                  const planeAnim_s *msg, long long now_us);
+int   anim_step (planeAnimation_s *anim, long long now_us, planeState_s *cur);
+
+#endif /* __ANIM_H__ */
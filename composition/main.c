@@ -38,7 +38,10 @@
  * mmurthy@ti.com
  ****************************************************************************/
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <poll.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -53,6 +56,8 @@
 #include <math.h>
 
 #include "common.h"
+#include "vidctrl.h"
+#include "anim.h"
 
 #define GL_TEXTURE_STREAM_IMG  0x8C0D
 #define MAX_TEX_BUFS 16
@@ -141,8 +146,9 @@ void matrixRotateZ(float degrees, mat4 matrix)
 }
 
 /* shader global objects */
-static int ver_shader, frag_shader, frag_shader_rbswap;
-int program, program_rbswap;
+static int ver_shader, frag_shader, frag_shader_rbswap, frag_shader_yuv;
+int program, program_rbswap, program_yuv;
+static int yuvMatrixLocation, yuvOffsetLocation, yuvLayoutLocation, yuvSizeLocation;
 static int setup_shaders();
 char buf[1024];
 
@@ -150,13 +156,66 @@ char buf[1024];
 pthread_t     gfxtid[MAX_GFX_PLANES];
 gfxCfg_s  gfxCfg[MAX_GFX_PLANES];
 int gfx_plane_mdfd[MAX_GFX_PLANES];
+int gfx_damage_tracked[MAX_GFX_PLANES];   /* client reports what it draws */
+int disp_width, disp_height;              /* display, for out_g in pixels */
+int gfx_buf_count[MAX_GFX_PLANES];        /* buffers registered with bc_cat */
+volatile int gfx_buf_idx[MAX_GFX_PLANES]; /* buffer the client last finished */
+
+/* Frame callbacks: asked for on the config pipe, taken by the render loop
+   when it draws the plane and answered on the event pipe after the swap */
+pthread_mutex_t gfx_evt_lock = PTHREAD_MUTEX_INITIALIZER;
+int gfx_evt_fd[MAX_GFX_PLANES] = { -1, -1, -1, -1 };
+int gfx_frame_req[MAX_GFX_PLANES];        /* frame_request not drawn yet */
+int gfx_frame_drawn[MAX_GFX_PLANES];      /* drawn, answer after the swap */
+int gfx_frame_buf[MAX_GFX_PLANES];
+
+/* Composition on demand: whatever changes the screen sets scene_dirty, and
+   the render loop waits for it when nothing else needs a new frame */
+#define SCENE_IDLE_WAIT_MS 100
+pthread_mutex_t scene_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  scene_cond = PTHREAD_COND_INITIALIZER;
+int             scene_dirty = 1;
 
 /* Video Planes Global varibles */
 pthread_t     vidCfgtid[MAX_VID_PLANES];
+pthread_t     vidCtrltid[MAX_VID_PLANES];
+pthread_t     vidMuxtid;
 videoConfig_s vidCfg[MAX_VID_PLANES];
 int           vid_plane_mdfd[MAX_VID_PLANES];
+int           vid_plane_geom_mdfd[MAX_VID_PLANES];  /* texcoords/matrix only */
+float         vid_alpha[MAX_VID_PLANES];            /* global alpha, 1.0 = opaque */
+
+/* Plane animations: messages are handed from animThread to the render loop */
+pthread_t        animtid;
+pthread_mutex_t  anim_lock = PTHREAD_MUTEX_INITIALIZER;
+planeAnim_s      animMsg_vid[MAX_VID_PLANES], animMsg_gfx[MAX_GFX_PLANES];
+int              animMsg_vid_pending[MAX_VID_PLANES], animMsg_gfx_pending[MAX_GFX_PLANES];
+planeAnimation_s vid_anim[MAX_VID_PLANES], gfx_anim[MAX_GFX_PLANES];
+/* blending flags of a gfx plane from before a fade switched it to global
+   alpha; put back once the plane is opaque again */
+int              gfx_fade_saved[MAX_GFX_PLANES];
+int              gfx_saved_blending[MAX_GFX_PLANES], gfx_saved_global_alpha[MAX_GFX_PLANES];
 int           vid_data_idx [MAX_VID_PLANES];
 int           vid_plane_first_frame_recvd [MAX_VID_PLANES];
+int           vid_plane_release [MAX_VID_PLANES];
+pthread_mutex_t vid_release_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  vid_release_cond = PTHREAD_COND_INITIALIZER;
+int             vid_mux_wake[2] = { -1, -1 };   /* tells the shared socket thread */
+videoConfig_s vidCfgPending[MAX_VID_PLANES];          /* staged VID_MSG_RECONFIG */
+int           vid_plane_reconfig_pending [MAX_VID_PLANES];
+
+/* Frame accounting for the status messages: a frame is pending from its data
+   message until it is drawn, then shown until the swap that presents it */
+pthread_mutex_t vid_data_lock = PTHREAD_MUTEX_INITIALIZER;
+int           vid_data_pending [MAX_VID_PLANES];
+long long     vid_data_recv_us [MAX_VID_PLANES];
+int           vid_shown [MAX_VID_PLANES];
+int           vid_shown_idx [MAX_VID_PLANES];      /* -1 until a frame is drawn */
+long long     vid_shown_recv_us [MAX_VID_PLANES];
+unsigned int  vid_remap_mask [MAX_VID_PLANES];     /* VID_MSG_MAP'ed buffer indices */
+int           vid_plane_planar [MAX_VID_PLANES];   /* frame sampled by program_yuv */
+int           vid_tex_width [MAX_VID_PLANES];      /* texture size in texels */
+int           vid_tex_height [MAX_VID_PLANES];
 
 
 /* Vertex shader source */
@@ -198,6 +257,44 @@ static const char * fshader_src_palpha_single_texture_rbswap =
         "   gl_FragColor.r = blueComp; \n"
     "}";
 
+/* Planar YUV 4:2:0 (I420, YV12, NV12): bc_cat has no planar formats, so the
+ * whole frame is registered as an ARGB texture whose texels each hold four
+ * bytes of the buffer. Every component is fetched by its byte address and the
+ * result converted with BT.601 coefficients.
+ *   planeOffset: byte offset of Y, U, V and the chroma pixel step (2 for NV12)
+ *   planeLayout: Y stride, chroma stride, bytes per texture row, swapRB
+ *   frameSize:   frame width and height in pixels, texture width and height
+ */
+static const char * fshader_src_yuv_planar =
+    "#ifdef GL_IMG_texture_stream2\n"
+    "#extension GL_IMG_texture_stream2 : enable\n"
+    "#endif\n"
+    "precision highp float;\n"
+    "varying mediump vec2 TexCoord;\n"
+    "uniform samplerStreamIMG sTexture;\n"
+    "uniform vec4 planeOffset;\n"
+    "uniform vec4 planeLayout;\n"
+    "uniform vec4 frameSize;\n"
+    "float fetchByte(float addr)\n"
+    "{\n"
+        " float row = floor(addr / planeLayout.z);\n"
+        " float col = addr - row * planeLayout.z;\n"
+        " float texel = floor(col * 0.25);\n"
+        " lowp vec4 t = textureStreamIMG(sTexture, vec2((texel + 0.5) / frameSize.z, (row + 0.5) / frameSize.w));\n"
+        " lowp vec4 b = mix(t.bgra, t, planeLayout.w);\n"
+        " return dot(b, vec4(equal(vec4(col - texel * 4.0), vec4(0.0, 1.0, 2.0, 3.0))));\n"
+    "}\n"
+    "void main(void)\n"
+    "{\n"
+        " vec2 pix = floor(TexCoord * frameSize.xy);\n"
+        " vec2 chroma = floor(pix * 0.5);\n"
+        " float y = fetchByte(planeOffset.x + pix.y * planeLayout.x + pix.x);\n"
+        " float u = fetchByte(planeOffset.y + chroma.y * planeLayout.y + chroma.x * planeOffset.w) - 0.5;\n"
+        " float v = fetchByte(planeOffset.z + chroma.y * planeLayout.y + chroma.x * planeOffset.w) - 0.5;\n"
+        " y = 1.1643 * (y - 0.0625);\n"
+        " gl_FragColor = vec4(y + 1.5958 * v, y - 0.39173 * u - 0.81290 * v, y + 2.017 * u, 1.0);\n"
+    "}";
+
 
 /* Vertices for the video planes */
 GLfloat rect_vertices_vid[MAX_VID_PLANES][6][3] =
@@ -350,19 +447,71 @@ void usage(char *arg)
            "\t-h - print this message\n\n", arg);
 }
 
+/* Output window in pixels to normalized device co-ordinates, which the
+   vertices and the animations work with */
+static void gfx_out_to_ndc (struct out_g *out)
+{
+    if (!out->in_pixels || disp_width <= 0 || disp_height <= 0)
+        return;
+
+    out->xpos   = -1.0 + 2.0 * out->xpos / disp_width;
+    out->ypos   =  1.0 - 2.0 * out->ypos / disp_height;
+    out->width  = 2.0 * out->width / disp_width;
+    out->height = 2.0 * out->height / disp_height;
+    out->in_pixels = 0;
+}
+
+/* Place a gfx plane on the screen according to its output window */
+static void gfx_update_vertices (int gfx_plane_no)
+{
+    float xpos, ypos, width, height;
+
+    xpos   = gfxCfg[gfx_plane_no].out_g.xpos;
+    ypos   = gfxCfg[gfx_plane_no].out_g.ypos;
+    width  = gfxCfg[gfx_plane_no].out_g.width;
+    height = gfxCfg[gfx_plane_no].out_g.height;
+
+    rect_vertices_gfx [gfx_plane_no][0][0] = xpos;
+    rect_vertices_gfx [gfx_plane_no][0][1] = ypos;
+
+    rect_vertices_gfx [gfx_plane_no][1][0] = xpos;
+    rect_vertices_gfx [gfx_plane_no][1][1] = ypos - height;
+
+    rect_vertices_gfx [gfx_plane_no][2][0] = xpos + width;
+    rect_vertices_gfx [gfx_plane_no][2][1] = ypos;
+
+    rect_vertices_gfx [gfx_plane_no][3][0] = xpos + width;
+    rect_vertices_gfx [gfx_plane_no][3][1] = ypos;
+
+    rect_vertices_gfx [gfx_plane_no][4][0] = xpos;
+    rect_vertices_gfx [gfx_plane_no][4][1] = ypos - height;
+
+    rect_vertices_gfx [gfx_plane_no][5][0] = xpos + width;
+    rect_vertices_gfx [gfx_plane_no][5][1] = ypos - height;
+}
+
+static void scene_damage (void)
+{
+    pthread_mutex_lock(&scene_lock);
+    scene_dirty = 1;
+    pthread_cond_signal(&scene_cond);
+    pthread_mutex_unlock(&scene_lock);
+}
+
 /* Config thread to receive configuration for GFX planes  */
 void * gfxThread ( void *threadarg)
 {
     int   n, fd_gfxplane;
-    float xpos, ypos, width, height;
     int   gfx_plane_no;
     gfxCfg_s gfxCfgRecvd;
     char  gfx_config_fifo[] = GFX_CONFIG_NAMED_PIPE;
+    char  gfx_event_fifo[] = GFX_EVENT_NAMED_PIPE;
 
     gfx_plane_no = *(int *)threadarg;
 
     /* Seperate named pipe for each Graphics Plane */
     gfx_config_fifo[strlen(gfx_config_fifo)-1] = '0' + gfx_plane_no;
+    gfx_event_fifo[strlen(gfx_event_fifo)-1] = '0' + gfx_plane_no;
 
     while (1) {
         DEBUG_PRINTF((" Opening the Named Pipe For GFX plane Config:%d %s\n", gfx_plane_no, gfx_config_fifo));
@@ -386,16 +535,29 @@ void * gfxThread ( void *threadarg)
             if (n == 0) 
             {
                 gfxCfg[gfx_plane_no].enable = 0;
+                gfx_damage_tracked[gfx_plane_no] = 0;
+                pthread_mutex_lock(&gfx_evt_lock);
+                if (gfx_evt_fd[gfx_plane_no] >= 0)
+                    close (gfx_evt_fd[gfx_plane_no]);
+                gfx_evt_fd[gfx_plane_no] = -1;
+                gfx_frame_req[gfx_plane_no] = 0;
+                gfx_frame_drawn[gfx_plane_no] = 0;
+                pthread_mutex_unlock(&gfx_evt_lock);
+                scene_damage ();
                 DEBUG_PRINTF ((" closing : %d %s\n", gfx_plane_no, gfx_config_fifo));
                 close (fd_gfxplane);
                 break; 
             }
 
-            gfxCfg[gfx_plane_no] = gfxCfgRecvd;
+            gfxCfg[gfx_plane_no].enable = gfxCfgRecvd.enable;
 
             /* Set up to process the input parameters if they are valid only */
             if (gfxCfgRecvd.input_params_valid)
             {
+                gfxCfg[gfx_plane_no].input_params_valid = 1;
+                gfxCfg[gfx_plane_no].in_g = gfxCfgRecvd.in_g;
+                gfx_buf_idx[gfx_plane_no] = 0;
+                gfx_fade_saved[gfx_plane_no] = 0;
                 gfx_plane_mdfd[gfx_plane_no] = 1;
                 gettimeofday(&tvp_gfxconfig_delay[gfx_plane_no], NULL);
             }
@@ -404,30 +566,545 @@ void * gfxThread ( void *threadarg)
             /* Calculate the vertices based on the output parameters */
             if (gfxCfgRecvd.output_params_valid) 
             {  
-                xpos   = gfxCfgRecvd.out_g.xpos;
-                ypos   = gfxCfgRecvd.out_g.ypos;
-                width  = gfxCfgRecvd.out_g.width;
-                height = gfxCfgRecvd.out_g.height;
+                gfxCfg[gfx_plane_no].output_params_valid = 1;
+                gfxCfg[gfx_plane_no].out_g = gfxCfgRecvd.out_g;
+                gfx_out_to_ndc (&gfxCfg[gfx_plane_no].out_g);
 
- 
-                rect_vertices_gfx [gfx_plane_no][0][0] = xpos;
-                rect_vertices_gfx [gfx_plane_no][0][1] = ypos;
+                /* a new output window replaces a running animation */
+                pthread_mutex_lock(&anim_lock);
+                gfx_anim[gfx_plane_no].active = 0;
+                animMsg_gfx_pending[gfx_plane_no] = 0;
+                pthread_mutex_unlock(&anim_lock);
 
-                rect_vertices_gfx [gfx_plane_no][1][0] = xpos;
-                rect_vertices_gfx [gfx_plane_no][1][1] = ypos - height;
+                gfx_update_vertices (gfx_plane_no);
+            }   
 
-                rect_vertices_gfx [gfx_plane_no][2][0] = xpos + width;
-                rect_vertices_gfx [gfx_plane_no][2][1] = ypos;
+            /* blending and rotation only: the texture stays as it is */
+            if (gfxCfgRecvd.render_params_valid)
+            {
+                pthread_mutex_lock(&anim_lock);
+                gfx_anim[gfx_plane_no].active = 0;
+                animMsg_gfx_pending[gfx_plane_no] = 0;
+                gfx_fade_saved[gfx_plane_no] = 0;
+                gfxCfg[gfx_plane_no].in_g.enable_blending     = gfxCfgRecvd.render_g.enable_blending;
+                gfxCfg[gfx_plane_no].in_g.enable_global_alpha = gfxCfgRecvd.render_g.enable_global_alpha;
+                gfxCfg[gfx_plane_no].in_g.global_alpha        = gfxCfgRecvd.render_g.global_alpha;
+                gfxCfg[gfx_plane_no].in_g.rotate              = gfxCfgRecvd.render_g.rotate;
+                matrixRotateZ(gfxCfg[gfx_plane_no].in_g.rotate, matgfx[gfx_plane_no]);
+                pthread_mutex_unlock(&anim_lock);
+            }
 
-                rect_vertices_gfx [gfx_plane_no][3][0] = xpos + width;
-                rect_vertices_gfx [gfx_plane_no][3][1] = ypos;
+            /* Qt drew or the plane changed: the next frame picks it up. The
+               scene is composed as a whole, the back buffer holds an older
+               frame. */
+            if (gfxCfgRecvd.damage_valid)
+            {
+                gfx_damage_tracked[gfx_plane_no] = 1;
 
-                rect_vertices_gfx [gfx_plane_no][4][0] = xpos;
-                rect_vertices_gfx [gfx_plane_no][4][1] = ypos - height;
+                /* flip: show the buffer the client is done with */
+                if (gfxCfgRecvd.damage_g.buf_index >= 0 &&
+                    gfxCfgRecvd.damage_g.buf_index < gfxCfg[gfx_plane_no].in_g.count)
+                    gfx_buf_idx[gfx_plane_no] = gfxCfgRecvd.damage_g.buf_index;
+            }
 
-                rect_vertices_gfx [gfx_plane_no][5][0] = xpos + width;
-                rect_vertices_gfx [gfx_plane_no][5][1] = ypos - height;
-            }   
+            /* the client reads the event pipe by now, it asks for events
+               only once it has opened it. After the flip above: the frame
+               that answers must show the buffer of this message. */
+            if (gfxCfgRecvd.frame_request)
+            {
+                pthread_mutex_lock(&gfx_evt_lock);
+                if (gfx_evt_fd[gfx_plane_no] < 0)
+                    gfx_evt_fd[gfx_plane_no] = open(gfx_event_fifo, O_WRONLY | O_NONBLOCK);
+                if (gfx_evt_fd[gfx_plane_no] >= 0) {
+                    gfx_frame_req[gfx_plane_no] = gfxCfgRecvd.frame_request;
+                } else {
+                    DEBUG_PRINTF ((" Failed to open named pipe %s\n", gfx_event_fifo));
+                }
+                pthread_mutex_unlock(&gfx_evt_lock);
+            }
+            scene_damage ();
+        }
+    }
+}
+
+/* Place the plane on the screen according to its output window */
+static void vid_update_vertices (int vid_plane_no)
+{
+    float xpos, ypos, width, height;
+
+    xpos   = vidCfg[vid_plane_no].out.xpos;
+    ypos   = vidCfg[vid_plane_no].out.ypos;
+    width  = vidCfg[vid_plane_no].out.width;
+    height = vidCfg[vid_plane_no].out.height;
+
+    rect_vertices_vid [vid_plane_no][0][0] = xpos;
+    rect_vertices_vid [vid_plane_no][0][1] = ypos;
+
+    rect_vertices_vid [vid_plane_no][1][0] = xpos;
+    rect_vertices_vid [vid_plane_no][1][1] = ypos - height;
+
+    rect_vertices_vid [vid_plane_no][2][0] = xpos + width;
+    rect_vertices_vid [vid_plane_no][2][1] = ypos;
+
+    rect_vertices_vid [vid_plane_no][3][0] = xpos + width;
+    rect_vertices_vid [vid_plane_no][3][1] = ypos;
+
+    rect_vertices_vid [vid_plane_no][4][0] = xpos;
+    rect_vertices_vid [vid_plane_no][4][1] = ypos - height;
+
+    rect_vertices_vid [vid_plane_no][5][0] = xpos + width;
+    rect_vertices_vid [vid_plane_no][5][1] = ypos - height;
+}
+
+/* A new output window replaces a running animation of the plane */
+static void vid_cancel_anim (int vid_plane_no)
+{
+    pthread_mutex_lock(&anim_lock);
+    vid_anim[vid_plane_no].active = 0;
+    animMsg_vid_pending[vid_plane_no] = 0;
+    pthread_mutex_unlock(&anim_lock);
+}
+
+/* Take over a new plane configuration; the texture is rebuilt by the render loop */
+static void vid_apply_config (int vid_plane_no, videoConfig_s *cfg)
+{
+    vid_cancel_anim (vid_plane_no);
+    vidCfg[vid_plane_no] = *cfg;
+    vid_update_vertices (vid_plane_no);
+    vid_plane_mdfd[vid_plane_no] = 1;
+    /* the indices of the previous config no longer hold its frames */
+    pthread_mutex_lock(&vid_data_lock);
+    vid_shown_idx[vid_plane_no] = -1;
+    pthread_mutex_unlock(&vid_data_lock);
+}
+
+/* Take over the output window, rotation and crop of a geometry message */
+static void vid_apply_geometry (videoConfig_s *dst, videoConfig_s *geom)
+{
+    dst->out            = geom->out;
+    dst->in.rotate      = geom->in.rotate;
+    dst->in.crop_x      = geom->in.crop_x;
+    dst->in.crop_y      = geom->in.crop_y;
+    dst->in.crop_width  = geom->in.crop_width;
+    dst->in.crop_height = geom->in.crop_height;
+}
+
+/* End of the last byte fshader_src_yuv_planar reads from a planar frame */
+static unsigned int vid_planar_end (videoConfig_s *cfg)
+{
+    unsigned int end, chroma_end, i;
+    unsigned int step = (cfg->in.num_planes == 2) ? 2 : 1;
+    unsigned int cw = (cfg->in.width + 1) / 2, ch = (cfg->in.height + 1) / 2;
+
+    end = cfg->in.plane_offset[0] + cfg->in.plane_stride[0] * (cfg->in.height - 1) + cfg->in.width;
+    for (i = 1; i < 3; i++)
+    {
+        chroma_end = cfg->in.plane_offset[i] + cfg->in.plane_stride[1] * (ch - 1) + (cw - 1) * step + 1;
+        if (chroma_end > end)
+            end = chroma_end;
+    }
+    return end;
+}
+
+/* Whether the GPU can be given the buffers of a config as a texture, see
+   recreate_vid_texture(); planar frames are read as ARGB texels */
+static int vid_layout_valid (videoConfig_s *cfg)
+{
+    if (cfg->in.num_planes > 1)
+        return cfg->in.plane_stride[0] && !(cfg->in.plane_stride[0] & 3) && cfg->in.buf_size &&
+               vid_planar_end (cfg) <= (cfg->in.buf_size / cfg->in.plane_stride[0]) *
+                                       cfg->in.plane_stride[0];
+
+    if (cfg->in.num_planes == 1 && cfg->in.plane_stride[0] && cfg->in.buf_size)
+        return (int)(cfg->in.plane_stride[0] / 2) >= cfg->in.width &&
+               (int)(cfg->in.buf_size / cfg->in.plane_stride[0]) >= cfg->in.height;
+
+    return 1;
+}
+
+/* Apply a message received for a video plane either on its named pipe or
+   on its control socket. Returns 1 if the sender asked to close the channel */
+static int vid_handle_msg (int vid_plane_no, videoConfig_s *vidCfgRecvd)
+{
+    scene_damage ();
+
+    if ((vidCfgRecvd->config_data == VID_MSG_CONFIG ||
+         vidCfgRecvd->config_data == VID_MSG_RECONFIG) &&
+        !vid_layout_valid (vidCfgRecvd)) {
+        /* the plane keeps its previous config */
+        printf (" vid plane %d: dropping config with unsupported buffer layout\n", vid_plane_no);
+        vidctrl_send_status(vid_plane_no, VID_STATUS_REJECTED, -1, vidctrl_now_us(), 0, 0);
+        return 0;
+    }
+
+    if (vidCfgRecvd->config_data == VID_MSG_CLOSE) {
+        vidCfg[vid_plane_no].enable = 0;
+        vid_plane_reconfig_pending[vid_plane_no] = 0;
+        vid_cancel_anim (vid_plane_no);
+        vid_alpha[vid_plane_no] = 1.0;
+        pthread_mutex_lock(&vid_data_lock);
+        vid_data_pending[vid_plane_no] = 0;
+        pthread_mutex_unlock(&vid_data_lock);
+        return 1;
+    }
+
+    if (vidCfgRecvd->config_data == VID_MSG_MAP) {
+        int idx = vidCfgRecvd->buf_index;
+
+        if (idx < 0 || idx >= MAX_VIDEO_BUFFERS_PER_CHANNEL)
+            return 0;
+        pthread_mutex_lock(&vid_data_lock);
+        if (vid_plane_reconfig_pending[vid_plane_no]) {
+            /* registered with the staged buffers when they are applied */
+            vidCfgPending[vid_plane_no].in.phyaddr[idx] = vidCfgRecvd->in.phyaddr[idx];
+        } else if (idx < vidCfg[vid_plane_no].in.count) {
+            vidCfg[vid_plane_no].in.phyaddr[idx] = vidCfgRecvd->in.phyaddr[idx];
+            vid_remap_mask[vid_plane_no] |= 1 << idx;
+        }
+        pthread_mutex_unlock(&vid_data_lock);
+        return 0;
+    }
+
+    if (vidCfgRecvd->config_data == VID_MSG_GEOMETRY) {
+        /* a staged reconfiguration must not bring the old geometry back */
+        if (vid_plane_reconfig_pending[vid_plane_no])
+            vid_apply_geometry (&vidCfgPending[vid_plane_no], vidCfgRecvd);
+        vid_cancel_anim (vid_plane_no);
+        vid_apply_geometry (&vidCfg[vid_plane_no], vidCfgRecvd);
+        vid_update_vertices (vid_plane_no);
+        vid_plane_geom_mdfd[vid_plane_no] = 1;
+        return 0;
+    }
+
+    if (vidCfgRecvd->config_data == VID_MSG_RECONFIG &&
+        vid_plane_first_frame_recvd[vid_plane_no]) {
+        /* keep showing the last frame of the old stream until the new one
+           delivers its first frame */
+        vidCfgPending[vid_plane_no] = *vidCfgRecvd;
+        vid_plane_reconfig_pending[vid_plane_no] = 1;
+
+    } else if (vidCfgRecvd->config_data == VID_MSG_CONFIG ||
+               vidCfgRecvd->config_data == VID_MSG_RECONFIG) {
+        vid_plane_reconfig_pending[vid_plane_no] = 0;
+        vid_apply_config (vid_plane_no, vidCfgRecvd);
+        vid_plane_first_frame_recvd [vid_plane_no] = 0;         
+
+    } else {
+        pthread_mutex_lock(&vid_data_lock);
+        /* the previous frame never made it to the screen */
+        if (vid_data_pending[vid_plane_no])
+            vidctrl_send_status(vid_plane_no, VID_STATUS_SKIPPED, vid_data_idx[vid_plane_no],
+                                vid_data_recv_us[vid_plane_no], 0, 0);
+        vid_data_idx[vid_plane_no] = vidCfgRecvd->buf_index;
+        vid_data_recv_us[vid_plane_no] = vidctrl_now_us();
+        vid_data_pending[vid_plane_no] = 1;
+        pthread_mutex_unlock(&vid_data_lock);
+
+        if (vid_plane_reconfig_pending[vid_plane_no]) {
+            vid_plane_reconfig_pending[vid_plane_no] = 0;
+            vid_apply_config (vid_plane_no, &vidCfgPending[vid_plane_no]);
+        }
+        vid_plane_first_frame_recvd [vid_plane_no] = 1;
+    }
+    return 0;
+}
+
+/* Thread receiving plane animations from all clients */
+void * animThread (void *threadarg)
+{
+    int n, fd_anim;
+    planeAnim_s msg;
+
+    (void)threadarg;
+
+    while (1) {
+        fd_anim = open(ANIM_NAMED_PIPE, O_RDONLY);
+        if (fd_anim < 0)
+        {
+            printf (" Failed to open named pipe %s\n", ANIM_NAMED_PIPE);
+            return NULL;
+        }
+
+        while ((n = read(fd_anim, &msg, sizeof(msg))) == sizeof(msg))
+        {
+            pthread_mutex_lock(&anim_lock);
+            if (msg.plane_type == ANIM_PLANE_VID && msg.plane_no >= 0 && msg.plane_no < MAX_VID_PLANES) {
+                animMsg_vid[msg.plane_no] = msg;
+                animMsg_vid_pending[msg.plane_no] = 1;
+            } else if (msg.plane_type == ANIM_PLANE_GFX && msg.plane_no >= 0 && msg.plane_no < MAX_GFX_PLANES) {
+                animMsg_gfx[msg.plane_no] = msg;
+                animMsg_gfx_pending[msg.plane_no] = 1;
+            } else {
+                DEBUG_PRINTF ((" ignoring animation of plane %d type %d\n", msg.plane_no, msg.plane_type));
+            }
+            pthread_mutex_unlock(&anim_lock);
+            scene_damage ();
+        }
+
+        DEBUG_PRINTF ((" closing : %s\n", ANIM_NAMED_PIPE));
+        close (fd_anim);
+    }
+    return NULL;
+}
+
+/* Run the plane animations up to now_us, once per frame before drawing */
+static void anim_update (long long now_us)
+{
+    int i;
+    planeState_s st;
+
+    pthread_mutex_lock(&anim_lock);
+
+    for (i = 0; i < MAX_VID_PLANES; i++)
+    {
+        st.xpos   = vidCfg[i].out.xpos;
+        st.ypos   = vidCfg[i].out.ypos;
+        st.width  = vidCfg[i].out.width;
+        st.height = vidCfg[i].out.height;
+        st.alpha  = vid_alpha[i];
+        st.rotate = vidCfg[i].in.rotate;
+
+        if (animMsg_vid_pending[i]) {
+            animMsg_vid_pending[i] = 0;
+            anim_start (&vid_anim[i], &st, &animMsg_vid[i], now_us);
+        }
+        if (anim_step (&vid_anim[i], now_us, &st)) {
+            vidCfg[i].out.xpos   = st.xpos;
+            vidCfg[i].out.ypos   = st.ypos;
+            vidCfg[i].out.width  = st.width;
+            vidCfg[i].out.height = st.height;
+            vidCfg[i].in.rotate  = st.rotate;
+            vid_alpha[i]         = st.alpha;
+            vid_update_vertices (i);
+            matrixRotateZ(vidCfg[i].in.rotate, matvid[i]);
+        }
+    }
+
+    for (i = 0; i < MAX_GFX_PLANES; i++)
+    {
+        st.xpos   = gfxCfg[i].out_g.xpos;
+        st.ypos   = gfxCfg[i].out_g.ypos;
+        st.width  = gfxCfg[i].out_g.width;
+        st.height = gfxCfg[i].out_g.height;
+        st.alpha  = gfxCfg[i].in_g.enable_global_alpha ? gfxCfg[i].in_g.global_alpha : 1.0;
+        st.rotate = gfxCfg[i].in_g.rotate;
+
+        if (animMsg_gfx_pending[i]) {
+            animMsg_gfx_pending[i] = 0;
+            anim_start (&gfx_anim[i], &st, &animMsg_gfx[i], now_us);
+            if (gfx_anim[i].mask & ANIM_ALPHA) {
+                /* the alpha of a fade applies to the whole plane */
+                if (!gfx_fade_saved[i]) {
+                    gfx_saved_blending[i]     = gfxCfg[i].in_g.enable_blending;
+                    gfx_saved_global_alpha[i] = gfxCfg[i].in_g.enable_global_alpha;
+                    gfx_fade_saved[i] = 1;
+                }
+                gfxCfg[i].in_g.enable_blending     = 1;
+                gfxCfg[i].in_g.enable_global_alpha = 1;
+            }
+        }
+        if (anim_step (&gfx_anim[i], now_us, &st)) {
+            gfxCfg[i].out_g.xpos        = st.xpos;
+            gfxCfg[i].out_g.ypos        = st.ypos;
+            gfxCfg[i].out_g.width       = st.width;
+            gfxCfg[i].out_g.height      = st.height;
+            gfxCfg[i].in_g.global_alpha = st.alpha;
+            gfxCfg[i].in_g.rotate       = st.rotate;
+            gfx_update_vertices (i);
+            matrixRotateZ(gfxCfg[i].in_g.rotate, matgfx[i]);
+
+            /* faded back in: per pixel alpha, if it was used, applies again */
+            if (!gfx_anim[i].active && gfx_fade_saved[i] && st.alpha >= 1.0) {
+                gfxCfg[i].in_g.enable_blending     = gfx_saved_blending[i];
+                gfxCfg[i].in_g.enable_global_alpha = gfx_saved_global_alpha[i];
+                gfx_fade_saved[i] = 0;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&anim_lock);
+}
+
+/* Blend a video plane with its global alpha when it is not opaque */
+static void vid_blend_begin (int vid_plane_no)
+{
+    if (vid_alpha[vid_plane_no] < 1.0)
+    {
+        glEnable (GL_BLEND);
+        glBlendColor (0.0, 0.0, 0.0, vid_alpha[vid_plane_no]);
+        glBlendFunc (GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+    }
+}
+
+static void vid_blend_end (int vid_plane_no)
+{
+    if (vid_alpha[vid_plane_no] < 1.0)
+        glDisable (GL_BLEND);
+}
+
+/* Buffer index to draw for a video plane, or -1 if there is none to draw
+   yet; a new frame is marked as shown */
+static int vid_take_frame (int vid_plane_no)
+{
+    int idx;
+
+    pthread_mutex_lock(&vid_data_lock);
+    idx = vid_data_idx[vid_plane_no];
+    if (vid_remap_mask[vid_plane_no] & (1 << idx)) {
+        /* mapped after this frame's remap pass: keep the previous frame
+           up and draw this one next time */
+        idx = vid_shown_idx[vid_plane_no];
+    } else if (vid_data_pending[vid_plane_no]) {
+        vid_data_pending[vid_plane_no] = 0;
+        vid_shown[vid_plane_no] = 1;
+        vid_shown_idx[vid_plane_no] = idx;
+        vid_shown_recv_us[vid_plane_no] = vid_data_recv_us[vid_plane_no];
+    }
+    pthread_mutex_unlock(&vid_data_lock);
+
+    return idx;
+}
+
+/* Time from a buffer swap to the frame being on the display: the GPU
+   renders it after the swap returns (deferred rendering) and it is flipped
+   in at the first vsync after that. The vsync period is taken from the
+   swap cadence, the render time from a glFinish every
+   DISP_PROBE_FRAMES swaps, which is too costly to do on every frame. */
+#define DISP_PROBE_FRAMES 64
+
+static long long disp_last_swap_us, disp_period_us, disp_render_us;
+static int disp_probe;
+
+static long long disp_scanout_delay (long long swap_us)
+{
+    long long d, n;
+
+    d = swap_us - disp_last_swap_us;
+    if (disp_last_swap_us && d > 0 && d < 100000)
+        disp_period_us = disp_period_us ? (7 * disp_period_us + d) / 8 : d;
+    disp_last_swap_us = swap_us;
+
+    if (++disp_probe >= DISP_PROBE_FRAMES) {
+        disp_probe = 0;
+        glFinish();
+        d = vidctrl_now_us() - swap_us;
+        disp_render_us = disp_render_us ? (3 * disp_render_us + d) / 4 : d;
+        /* the stall must not count as a swap interval */
+        disp_last_swap_us = 0;
+    }
+
+    if (!disp_period_us)
+        return disp_render_us;
+    n = (disp_render_us + disp_period_us - 1) / disp_period_us;
+    return (n < 1 ? 1 : n) * disp_period_us;
+}
+
+/* Called after the buffer swap: report the frames it put on the screen */
+static void report_presented (int swapped)
+{
+    int i;
+    long long now = vidctrl_now_us();
+    long long scanout = swapped ? now + disp_scanout_delay (now) : 0;
+    gfxEvent_s evt;
+
+    for (i = 0; i < MAX_VID_PLANES; i++)
+    {
+        if (vid_shown[i]) {
+            vidctrl_send_status(i, VID_STATUS_PRESENTED, vid_shown_idx[i],
+                                vid_shown_recv_us[i], now, scanout);
+            vid_shown[i] = 0;
+        }
+    }
+
+    /* a full pipe means the client is behind, it gets the next one */
+    pthread_mutex_lock(&gfx_evt_lock);
+    for (i = 0; i < MAX_GFX_PLANES; i++)
+    {
+        if (gfx_frame_drawn[i] && gfx_evt_fd[i] >= 0) {
+            evt.type       = GFX_EVENT_FRAME_DONE;
+            evt.buf_index  = gfx_frame_buf[i];
+            evt.present_us = now;
+            evt.scanout_us = scanout;
+            evt.frame_seq  = gfx_frame_drawn[i];
+            if (write(gfx_evt_fd[i], &evt, sizeof(evt)) != sizeof(evt)) {
+                DEBUG_PRINTF ((" gfx plane %d: frame event dropped\n", i));
+            }
+        }
+        gfx_frame_drawn[i] = 0;
+    }
+    pthread_mutex_unlock(&gfx_evt_lock);
+}
+
+/* Whether the scene must be composed again: something changed on the screen
+   or is still changing, a gfx plane does not report damage and may have
+   been drawn at any time, or a raw video file (file_video) is played, which
+   shows a new frame on every pass. Otherwise waits up to SCENE_IDLE_WAIT_MS
+   for a change and returns 0 if none came, the last frame stays on the
+   display. */
+static int scene_wait_damage (int file_video)
+{
+    int i, dirty = file_video;
+    struct timeval tv;
+    struct timespec ts;
+
+    for (i = 0; i < MAX_GFX_PLANES; i++)
+        if (gfxCfg[i].enable && (!gfx_damage_tracked[i] ||
+                                 gfx_plane_mdfd[i] > 0 || gfx_anim[i].active))
+            dirty = 1;
+
+    for (i = 0; i < MAX_VID_PLANES; i++)
+        if (vidCfg[i].enable && (vid_data_pending[i] || vid_anim[i].active ||
+                                 vid_plane_mdfd[i] > 0 || vid_plane_geom_mdfd[i]))
+            dirty = 1;
+
+    pthread_mutex_lock(&scene_lock);
+    if (!dirty && !scene_dirty) {
+        gettimeofday(&tv, NULL);
+        ts.tv_sec  = tv.tv_sec + (tv.tv_usec + SCENE_IDLE_WAIT_MS * 1000) / 1000000;
+        ts.tv_nsec = (tv.tv_usec + SCENE_IDLE_WAIT_MS * 1000) % 1000000 * 1000;
+        pthread_cond_timedwait(&scene_cond, &scene_lock, &ts);
+    }
+    dirty |= scene_dirty;
+    scene_dirty = 0;
+    pthread_mutex_unlock(&scene_lock);
+
+    /* the swap cadence is only measured over back to back frames */
+    if (!dirty)
+        disp_last_swap_us = 0;
+    return dirty;
+}
+
+/* Wait until the render loop no longer draws a closed plane and the GPU is
+   done with its buffers */
+static void vid_retire_plane (int vid_plane_no)
+{
+    pthread_mutex_lock(&vid_release_lock);
+    vid_plane_release[vid_plane_no] = 1;
+    scene_damage ();
+    while (vid_plane_release[vid_plane_no] && !gQuit)
+        pthread_cond_wait(&vid_release_cond, &vid_release_lock);
+    pthread_mutex_unlock(&vid_release_lock);
+}
+
+/* Release the dma-bufs of closed video planes, now that they are no longer
+   drawn and the GPU has finished with them */
+static void vid_release_planes (void)
+{
+    int i;
+
+    for (i=0; i < MAX_VID_PLANES; i++)
+    {
+        if (vid_plane_release[i] && !vidCfg[i].enable)
+        {
+            glFinish();
+            vidctrl_release_bufs(i);
+            pthread_mutex_lock(&vid_release_lock);
+            vid_plane_release[i] = 0;
+            pthread_cond_broadcast(&vid_release_cond);
+            pthread_mutex_unlock(&vid_release_lock);
+            /* a full pipe means it is woken up already */
+            if (vid_mux_wake[1] >= 0 && write(vid_mux_wake[1], "", 1) < 0 && errno != EAGAIN)
+                printf(" Failed to wake the shared control thread\n");
         }
     }
 }
@@ -436,7 +1113,6 @@ void * gfxThread ( void *threadarg)
 void * vidConfigDataThread ( void *threadarg)
 {
     int   n, fd_vidplane;
-    float xpos, ypos, width, height;
     int   vid_plane_no;
     videoConfig_s vidCfgRecvd;
     char  vid_config_fifo[] = VIDEO_CONFIG_AND_DATA_FIFO_NAME;
@@ -465,55 +1141,329 @@ void * vidConfigDataThread ( void *threadarg)
         if (n == 0)
         {
             vidCfg[vid_plane_no].enable = 0;
+            scene_damage ();
             close (fd_vidplane);
             DEBUG_PRINTF ((" closing : %d %s\n", vid_plane_no, vid_config_fifo)); 
             break;
         }
 
-      if (vidCfgRecvd.config_data == 2) {
-            vidCfg[vid_plane_no].enable = 0;
+        if (vid_handle_msg(vid_plane_no, &vidCfgRecvd)) {
             close (fd_vidplane);
             DEBUG_PRINTF ((" closing on receiving command from gst: %d %s\n", vid_plane_no, vid_config_fifo));
-            usleep (100000);
+            vid_retire_plane (vid_plane_no);
             break;
-      }
+        }
+    }
+  }
+}
+
+/* Handle a message of a control socket, importing the dma-bufs a config or
+   a mapping comes with first; one whose buffers are not usable is dropped.
+   Returns 1 if the sender asked to close the channel */
+static int vid_handle_ctrl_msg (int vid_plane_no, videoConfig_s *cfg, int *fds, int nfds)
+{
+    if ((cfg->config_data == VID_MSG_CONFIG ||
+         cfg->config_data == VID_MSG_RECONFIG) && nfds) {
+        vidctrl_lock_bufs();
+        if (vidctrl_import_bufs(vid_plane_no, cfg, fds, nfds) == 0)
+            vid_handle_msg(vid_plane_no, cfg);
+        vidctrl_unlock_bufs();
+        return 0;
+    }
+
+    if (cfg->config_data == VID_MSG_MAP && nfds == 1) {
+        vidctrl_lock_bufs();
+        if (vidctrl_import_map(vid_plane_no, cfg, fds[0],
+                               vid_plane_reconfig_pending[vid_plane_no]) == 0)
+            vid_handle_msg(vid_plane_no, cfg);
+        vidctrl_unlock_bufs();
+        return 0;
+    }
+
+    while (nfds)
+        close(fds[--nfds]);
+    return vid_handle_msg(vid_plane_no, cfg);
+}
+
+/* Control socket thread for Video planes - same messages as the named pipe,
+   with the video buffers passed as dma-buf fds */
+void * vidCtrlSocketThread ( void *threadarg)
+{
+    int   n, sock, conn, nfds;
+    int   fds[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+    int   vid_plane_no;
+    videoConfig_s vidCfgRecvd;
+
+    vid_plane_no = *(int *)threadarg;
+
+    sock = vidctrl_listen(vid_plane_no);
+    if (sock < 0)
+        return NULL;
 
-      if (vidCfgRecvd.config_data) {
-        xpos   = vidCfgRecvd.out.xpos;
-        ypos   = vidCfgRecvd.out.ypos;
-        width  = vidCfgRecvd.out.width;
-        height = vidCfgRecvd.out.height;
+    while (1) {
+        conn = accept(sock, NULL, NULL);
+        if (conn < 0)
+            continue;
 
-        vidCfg[vid_plane_no] = vidCfgRecvd;
- 
-        rect_vertices_vid [vid_plane_no][0][0] = xpos;
-        rect_vertices_vid [vid_plane_no][0][1] = ypos;
+        if (vidctrl_claim(vid_plane_no, conn, 0) < 0) {
+            printf(" Video plane %d is driven through the shared control socket\n", vid_plane_no);
+            close (conn);
+            continue;
+        }
+        DEBUG_PRINTF ((" Accepted control connection for Video plane: %d\n", vid_plane_no));
 
-        rect_vertices_vid [vid_plane_no][1][0] = xpos;
-        rect_vertices_vid [vid_plane_no][1][1] = ypos - height;
+        while (1)
+        {
+            n = vidctrl_recv(conn, &vidCfgRecvd, fds, &nfds);
+            if (n <= 0)
+            {
+                vidCfg[vid_plane_no].enable = 0;
+                break;
+            }
 
-        rect_vertices_vid [vid_plane_no][2][0] = xpos + width;
-        rect_vertices_vid [vid_plane_no][2][1] = ypos;
+            if (vid_handle_ctrl_msg(vid_plane_no, &vidCfgRecvd, fds, nfds))
+                break;
+        }
 
-        rect_vertices_vid [vid_plane_no][3][0] = xpos + width;
-        rect_vertices_vid [vid_plane_no][3][1] = ypos;
+        /* the render loop drops the imported buffers once the GPU is done
+           with them; wait for it before taking the next client, and let a
+           client that asked to close know it can free its buffers */
+        vid_retire_plane (vid_plane_no);
+        if (n > 0)
+            vidctrl_send_status(vid_plane_no, VID_STATUS_CLOSED, -1, 0, vidctrl_now_us(), 0);
 
-        rect_vertices_vid [vid_plane_no][4][0] = xpos;
-        rect_vertices_vid [vid_plane_no][4][1] = ypos - height;
+        vidctrl_set_conn(vid_plane_no, -1);
+        close (conn);
+        DEBUG_PRINTF ((" closing control connection: %d\n", vid_plane_no));
+    }
+}
 
-        rect_vertices_vid [vid_plane_no][5][0] = xpos + width;
-        rect_vertices_vid [vid_plane_no][5][1] = ypos - height;
+/* Clients of the shared socket. Nothing the mux thread sends may block it,
+   one slow client would hold up every plane: the replies that must not be
+   dropped, attach answers and close acknowledgements, are queued and sent
+   as the client makes room for them. */
+#define VID_MUX_MAX_REPLIES (2 * MAX_VID_PLANES)
 
-        vid_plane_mdfd[vid_plane_no] = 1;
-        vid_plane_first_frame_recvd [vid_plane_no] = 0;         
+typedef struct
+{
+    int            fd;           /* -1 if the slot is free */
+    int            gone;         /* hung up, closed once its planes are retired */
+    vidMuxStatus_s reply[VID_MUX_MAX_REPLIES];
+    int            num_replies;
+} vidMuxConn_s;
+
+static vidMuxConn_s vid_mux_conns[MAX_VID_PLANES];
+static int vid_mux_retiring[MAX_VID_PLANES];     /* client slot + 1, 0 if not */
+static int vid_mux_retire_ack[MAX_VID_PLANES];
+
+/* Send the queued replies of a client as far as its socket takes them */
+static void vid_mux_flush_replies (vidMuxConn_s *c)
+{
+    int i, n = 0, ret = 1;
 
-     } else {
-        vid_data_idx[vid_plane_no] = vidCfgRecvd.buf_index;
-        vid_plane_first_frame_recvd [vid_plane_no] = 1;
+    while (n < c->num_replies &&
+           (ret = vidctrl_send_mux_status(c->fd, &c->reply[n])) > 0)
+        n++;
+    if (ret < 0)
+        n = c->num_replies;
 
-     }
+    for (i = n; i < c->num_replies; i++)
+        c->reply[i - n] = c->reply[i];
+    c->num_replies -= n;
+}
+
+static void vid_mux_reply (vidMuxConn_s *c, int vid_plane_no, int status, int buf_index)
+{
+    vidMuxStatus_s *ms;
+
+    if (c->gone)
+        return;
+    if (c->num_replies == VID_MUX_MAX_REPLIES) {
+        /* a client that reads nothing at all can't be waited for */
+        printf(" Dropping reply %d for video plane %d: client not reading\n",
+               status, vid_plane_no);
+        return;
+    }
+    ms = &c->reply[c->num_replies++];
+    memset(ms, 0, sizeof(*ms));
+    ms->plane            = vid_plane_no;
+    ms->status.status    = status;
+    ms->status.buf_index = buf_index;
+    if (status == VID_STATUS_CLOSED)
+        ms->status.present_us = vidctrl_now_us();
+    vid_mux_flush_replies (c);
+}
+
+/* Let go of a plane attached through the shared socket. The render loop
+   drops its buffers at its own pace, the plane stays with the client until
+   then (see vid_mux_retire_done) */
+static void vid_mux_release_plane (int slot, int vid_plane_no, int ack)
+{
+    pthread_mutex_lock(&vid_release_lock);
+    vid_plane_release[vid_plane_no] = 1;
+    pthread_mutex_unlock(&vid_release_lock);
+    scene_damage ();
+
+    vid_mux_retiring[vid_plane_no]   = slot + 1;
+    vid_mux_retire_ack[vid_plane_no] = ack;
+}
+
+/* Acknowledge the closes the render loop is done with, and close the
+   clients that hung up once none of their planes is left */
+static void vid_mux_retire_done (void)
+{
+    int i, j, busy;
+
+    for (i = 0; i < MAX_VID_PLANES; i++) {
+        if (!vid_mux_retiring[i])
+            continue;
+        pthread_mutex_lock(&vid_release_lock);
+        busy = vid_plane_release[i];
+        pthread_mutex_unlock(&vid_release_lock);
+        if (busy)
+            continue;
+
+        if (vid_mux_retire_ack[i])
+            vid_mux_reply (&vid_mux_conns[vid_mux_retiring[i] - 1], i, VID_STATUS_CLOSED, -1);
+        vidctrl_set_conn(i, -1);
+        vid_mux_retiring[i] = 0;
+    }
+
+    for (i = 0; i < MAX_VID_PLANES; i++) {
+        if (vid_mux_conns[i].fd < 0 || !vid_mux_conns[i].gone)
+            continue;
+        for (j = 0, busy = 0; j < MAX_VID_PLANES; j++)
+            busy |= (vid_mux_retiring[j] == i + 1);
+        if (busy)
+            continue;
+        /* the fd number stays taken until here, so that a new client
+           can't be mistaken for this one */
+        close (vid_mux_conns[i].fd);
+        DEBUG_PRINTF ((" closing shared control connection %d\n", vid_mux_conns[i].fd));
+        vid_mux_conns[i].fd = -1;
+    }
+}
+
+/* Handle one message of the shared socket; fds come with a lone config or
+   mapping */
+static void vid_mux_handle_msg (int slot, vidMuxMsg_s *msg, int *fds, int nfds)
+{
+    vidMuxConn_s *c = &vid_mux_conns[slot];
+    int vid_plane_no = msg->plane;
+
+    if (msg->cfg.config_data == VID_MSG_ATTACH) {
+        vid_plane_no = vidctrl_claim(msg->cfg.buf_index, c->fd, 1);
+        vid_mux_reply (c, vid_plane_no, VID_STATUS_ATTACHED, vid_plane_no);
+        DEBUG_PRINTF ((" Attach request for Video plane %d\n", msg->cfg.buf_index));
+        return;
+    }
+
+    if (vid_plane_no < 0 || vid_plane_no >= MAX_VID_PLANES ||
+        vidctrl_get_conn(vid_plane_no) != c->fd || vid_mux_retiring[vid_plane_no]) {
+        printf(" Dropping message %d for video plane %d: not attached\n",
+               msg->cfg.config_data, vid_plane_no);
+        while (nfds)
+            close(fds[--nfds]);
+        return;
+    }
+
+    if (vid_handle_ctrl_msg(vid_plane_no, &msg->cfg, fds, nfds))
+        vid_mux_release_plane (slot, vid_plane_no, 1);
+}
+
+/* Shared control socket thread: one connection per client process, which
+   drives any number of video planes with batched messages */
+void * vidMuxSocketThread ( void *threadarg)
+{
+    struct pollfd pfd[2 + MAX_VID_PLANES];
+    int   fds[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+    vidMuxMsg_s msgs[VID_MUX_MAX_BATCH];
+    vidMuxConn_s *c;
+    int   i, j, n, nfds, conn, sock;
+    char  buf[16];
+
+    (void)threadarg;
+
+    sock = vidctrl_listen_mux();
+    if (sock < 0)
+        return NULL;
+
+    if (pipe(vid_mux_wake) < 0) {
+        printf(" Failed to create the shared control wake-up pipe\n");
+        close (sock);
+        return NULL;
+    }
+    fcntl(vid_mux_wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(vid_mux_wake[1], F_SETFL, O_NONBLOCK);
+
+    for (i = 0; i < MAX_VID_PLANES; i++)
+        vid_mux_conns[i].fd = -1;
+
+    while (1) {
+        pfd[0].fd     = sock;
+        pfd[0].events = POLLIN;
+        pfd[1].fd     = vid_mux_wake[0];
+        pfd[1].events = POLLIN;
+        for (i = 0; i < MAX_VID_PLANES; i++) {
+            c = &vid_mux_conns[i];
+            pfd[i+2].fd      = c->fd;
+            pfd[i+2].events  = (c->gone ? 0 : POLLIN) | (c->num_replies ? POLLOUT : 0);
+            pfd[i+2].revents = 0;
+        }
+        if (poll(pfd, 2 + MAX_VID_PLANES, -1) < 0)
+            continue;
+
+        if (pfd[1].revents & POLLIN)
+            while (read(vid_mux_wake[0], buf, sizeof(buf)) > 0)
+                ;
+        vid_mux_retire_done ();
+
+        /* a client without a plane is of no use, so there are never more
+           clients than planes */
+        if (pfd[0].revents & POLLIN) {
+            conn = accept(sock, NULL, NULL);
+            for (i = 0; i < MAX_VID_PLANES && vid_mux_conns[i].fd >= 0; i++)
+                ;
+            if (conn >= 0 && i < MAX_VID_PLANES) {
+                vid_mux_conns[i].fd          = conn;
+                vid_mux_conns[i].gone        = 0;
+                vid_mux_conns[i].num_replies = 0;
+                DEBUG_PRINTF ((" Accepted shared control connection %d\n", conn));
+            } else if (conn >= 0) {
+                printf(" Too many video control clients\n");
+                close (conn);
+            }
+        }
+
+        for (i = 0; i < MAX_VID_PLANES; i++) {
+            c = &vid_mux_conns[i];
+            if (c->fd < 0 || c->gone || !pfd[i+2].revents)
+                continue;
+
+            if (pfd[i+2].revents & POLLOUT)
+                vid_mux_flush_replies (c);
+            if (!(pfd[i+2].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            n = vidctrl_recv_mux(c->fd, msgs, fds, &nfds);
+            if (n > 0) {
+                for (j = 0; j < n; j++)
+                    vid_mux_handle_msg (i, &msgs[j], fds, j ? 0 : nfds);
+                continue;
+            }
+
+            /* client gone: its planes go off like on a close */
+            c->gone = 1;
+            c->num_replies = 0;
+            for (j = 0; j < MAX_VID_PLANES; j++) {
+                if (vidctrl_get_conn(j) == c->fd && !vid_mux_retiring[j]) {
+                    vidCfg[j].enable = 0;
+                    vid_mux_release_plane (i, j, 0);
+                }
+            }
+        }
+        vid_mux_retire_done ();
     }
-  }
 }
 
 static int setup_shaders( )
@@ -524,6 +1474,7 @@ static int setup_shaders( )
     ver_shader     = glCreateShader(GL_VERTEX_SHADER);
     frag_shader    = glCreateShader(GL_FRAGMENT_SHADER);
     frag_shader_rbswap = glCreateShader(GL_FRAGMENT_SHADER);
+    frag_shader_yuv = glCreateShader(GL_FRAGMENT_SHADER);
 
     /* Attach and compile shaders */
     /* Vertex Shader */
@@ -556,8 +1507,19 @@ static int setup_shaders( )
         return -1;
     }
 
+    glShaderSource(frag_shader_yuv, 1, (const char **) &fshader_src_yuv_planar, NULL);
+
+    glCompileShader(frag_shader_yuv);
+    glGetShaderiv(frag_shader_yuv, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        glGetShaderInfoLog(frag_shader_yuv, sizeof (buf), NULL, buf);
+        printf("ERROR: Fragment shader compilation failed, info log:\n%s", buf);
+        return -1;
+    }
+
     program = glCreateProgram();
     program_rbswap = glCreateProgram();
+    program_yuv = glCreateProgram();
 
     /* Attach shader to the program */
     glAttachShader(program, ver_shader);
@@ -582,24 +1544,66 @@ static int setup_shaders( )
     /* link the program */
     glLinkProgram(program_rbswap);
 
+    /* Attach shader to the program */
+    glAttachShader(program_yuv, ver_shader);
+    glAttachShader(program_yuv, frag_shader_yuv);
+
+    glBindAttribLocation(program_yuv, 0, "vPosition");
+    glBindAttribLocation(program_yuv, 1, "inTexCoord");
+
+    /* link the program */
+    glLinkProgram(program_yuv);
+
+    yuvMatrixLocation = glGetUniformLocation(program_yuv, "matrix");
+    yuvOffsetLocation = glGetUniformLocation(program_yuv, "planeOffset");
+    yuvLayoutLocation = glGetUniformLocation(program_yuv, "planeLayout");
+    yuvSizeLocation   = glGetUniformLocation(program_yuv, "frameSize");
+
     return 0;
 }
 
+/* Select the program for drawing a video plane and load its uniforms */
+static void use_vid_program (int vid_plane_no, int matrixLocation, int swapRB_in_ARGB)
+{
+    videoConfig_s *cfg = &vidCfg[vid_plane_no];
+
+    if (!vid_plane_planar[vid_plane_no])
+    {
+        glUseProgram(program);
+        glUniformMatrix4fv( matrixLocation, 1, GL_FALSE, matvid[vid_plane_no]);
+        return;
+    }
+
+    glUseProgram(program_yuv);
+    glUniformMatrix4fv( yuvMatrixLocation, 1, GL_FALSE, matvid[vid_plane_no]);
+    glUniform4f(yuvOffsetLocation, cfg->in.plane_offset[0], cfg->in.plane_offset[1],
+                cfg->in.plane_offset[2], (cfg->in.num_planes == 2) ? 2.0 : 1.0);
+    glUniform4f(yuvLayoutLocation, cfg->in.plane_stride[0], cfg->in.plane_stride[1],
+                vid_tex_width[vid_plane_no] * 4, swapRB_in_ARGB ? 1.0 : 0.0);
+    glUniform4f(yuvSizeLocation, cfg->in.width, cfg->in.height,
+                vid_tex_width[vid_plane_no], vid_tex_height[vid_plane_no]);
+}
+
 GLuint tex_obj_gfx[MAX_GFX_PLANES];
 
 /* GFX plane update - recreates the texture based on the change in input parameters */
 void recreate_gfx_texture (int * bc_id_p, int gfx_plane_no) 
 {
-    int bc_id;
+    int bc_id, k, num_bufs;
     float crop_x_n, crop_w_n, crop_y_n, crop_h_n;
 
     bc_id = *bc_id_p;
 
+    /* a multi buffered client flips between buffers laid out back to back */
+    num_bufs = gfxCfg[gfx_plane_no].in_g.count;
+    if (num_bufs < 1 || num_bufs > GFX_MAX_BUFFERS)
+        num_bufs = 1;
+
     /* check whether the texture device is opened earlier or not */
     if (bc_id < 0)
     {
         /* open a device and initialize with texture parameters */
-        bc_id = init_bcdev (gfxCfg[gfx_plane_no].in_g.pixel_format,gfxCfg[gfx_plane_no].in_g.width, gfxCfg[gfx_plane_no].in_g.height, 1);
+        bc_id = init_bcdev (gfxCfg[gfx_plane_no].in_g.pixel_format,gfxCfg[gfx_plane_no].in_g.width, gfxCfg[gfx_plane_no].in_g.height, num_bufs);
         if ( bc_id < 0) {
             printf (" exiting due to failure in bc_id check for gfx \n");
             exit (0);
@@ -609,15 +1613,20 @@ void recreate_gfx_texture (int * bc_id_p, int gfx_plane_no)
     {
         /* close and re-open the device with the new texture parameters */
         glDeleteTextures(1, &tex_obj_gfx[gfx_plane_no]);
-        bc_id = reinit_bcdev (gfxCfg[gfx_plane_no].in_g.pixel_format,gfxCfg[gfx_plane_no].in_g.width, gfxCfg[gfx_plane_no].in_g.height, 1, bc_id);
+        bc_id = reinit_bcdev (gfxCfg[gfx_plane_no].in_g.pixel_format,gfxCfg[gfx_plane_no].in_g.width, gfxCfg[gfx_plane_no].in_g.height, num_bufs, bc_id);
     }
 
-    /* set the gfx plane buffer address as the texture address */
-    if ( modify_bufAddr (bc_id, 0, gfxCfg[gfx_plane_no].in_g.data_ph_addr) < 0)
+    /* set the gfx plane buffer addresses as the texture addresses */
+    for (k = 0; k < num_bufs; k++)
     {
-        printf (" exiting due to failure in modify_bufAddr for gfx plane \n");
-        exit(0);
+        if ( modify_bufAddr (bc_id, k, gfxCfg[gfx_plane_no].in_g.data_ph_addr +
+                                     k * gfxCfg[gfx_plane_no].in_g.buf_size) < 0)
+        {
+            printf (" exiting due to failure in modify_bufAddr for gfx plane \n");
+            exit(0);
+        }
     }
+    gfx_buf_count[gfx_plane_no] = num_bufs;
     glGenTextures(1, &tex_obj_gfx[gfx_plane_no]);
     glBindTexture(GL_TEXTURE_STREAM_IMG, tex_obj_gfx[gfx_plane_no]);
     glTexParameterf(GL_TEXTURE_STREAM_IMG, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -655,18 +1664,88 @@ void recreate_gfx_texture (int * bc_id_p, int gfx_plane_no)
 
 GLuint tex_obj_vid[MAX_VID_PLANES];
 
+/* Map the crop window of the plane onto its texture */
+static void vid_update_texcoords (int vid_plane_no)
+{
+    float crop_x_n, crop_w_n, crop_y_n, crop_h_n;
+    float w, h;
+
+    /* Packed frames are sampled straight from the texture, which includes
+       the padding of the lines and the extra lines; planar ones through
+       fshader_src_yuv_planar, which works in picture pixels */
+    if (vid_plane_planar[vid_plane_no])
+    {
+        w = vidCfg[vid_plane_no].in.width;
+        h = vidCfg[vid_plane_no].in.height;
+    } else
+    {
+        w = vid_tex_width[vid_plane_no];
+        h = vid_tex_height[vid_plane_no];
+    }
+
+    crop_x_n = (float) vidCfg[vid_plane_no].in.crop_x/w;
+    crop_w_n = (float) vidCfg[vid_plane_no].in.crop_width/w;
+    crop_y_n = (float) vidCfg[vid_plane_no].in.crop_y/h;
+    crop_h_n = (float) vidCfg[vid_plane_no].in.crop_height/h;
+
+    rect_tex_vid[vid_plane_no][0][0] = crop_x_n;
+    rect_tex_vid[vid_plane_no][0][1] = crop_y_n;
+
+    rect_tex_vid[vid_plane_no][1][0] = crop_x_n;
+    rect_tex_vid[vid_plane_no][1][1] = crop_y_n + crop_h_n;
+
+    rect_tex_vid[vid_plane_no][2][0] = crop_x_n + crop_w_n;
+    rect_tex_vid[vid_plane_no][2][1] = crop_y_n;
+
+
+    rect_tex_vid[vid_plane_no][3][0] = crop_x_n + crop_w_n;
+    rect_tex_vid[vid_plane_no][3][1] = crop_y_n;
+
+    rect_tex_vid[vid_plane_no][4][0] = crop_x_n;
+    rect_tex_vid[vid_plane_no][4][1] = crop_y_n + crop_h_n;
+
+    rect_tex_vid[vid_plane_no][5][0] = crop_x_n + crop_w_n;
+    rect_tex_vid[vid_plane_no][5][1] = crop_y_n + crop_h_n;
+}
+
 void recreate_vid_texture (int * bc_id_p, int vid_plane_no)
 {
     int bc_id, i;
-    float crop_x_n, crop_w_n, crop_y_n, crop_h_n;
+    unsigned int tex_fourcc;
 
     bc_id = *bc_id_p;
 
     DEBUG_PRINTF ((" bc_id: %d  vid_plane_no: %d  recreating the video textures \n", bc_id, vid_plane_no));
 
+    /* Planar frames are exposed to the GPU as ARGB texels covering the
+       whole buffer (see fshader_src_yuv_planar), packed ones as they are */
+    vid_plane_planar[vid_plane_no] = (vidCfg[vid_plane_no].in.num_planes > 1);
+    if (vid_plane_planar[vid_plane_no])
+    {
+        /* the layout was checked by vid_layout_valid() on receipt */
+        tex_fourcc = BC_PIX_FMT_ARGB;
+        vid_tex_width[vid_plane_no]  = vidCfg[vid_plane_no].in.plane_stride[0] / 4;
+        /* whole lines only, a partial last line would reach past the
+           buffer; the planes must still lie within them */
+        vid_tex_height[vid_plane_no] = vidCfg[vid_plane_no].in.buf_size / vidCfg[vid_plane_no].in.plane_stride[0];
+    } else if (vidCfg[vid_plane_no].in.num_planes == 1 && vidCfg[vid_plane_no].in.plane_stride[0] &&
+               vidCfg[vid_plane_no].in.buf_size)
+    {
+        /* 16 bpp lines, possibly padded, and possibly extra lines: the
+           texture covers all of them and the picture is cropped out of it */
+        tex_fourcc = vidCfg[vid_plane_no].in.fourcc;
+        vid_tex_width[vid_plane_no]  = vidCfg[vid_plane_no].in.plane_stride[0] / 2;
+        vid_tex_height[vid_plane_no] = vidCfg[vid_plane_no].in.buf_size / vidCfg[vid_plane_no].in.plane_stride[0];
+    } else
+    {
+        tex_fourcc = vidCfg[vid_plane_no].in.fourcc;
+        vid_tex_width[vid_plane_no]  = vidCfg[vid_plane_no].in.width;
+        vid_tex_height[vid_plane_no] = vidCfg[vid_plane_no].in.height;
+    }
+
     if (bc_id < 0)
     {
-        bc_id = init_bcdev (vidCfg[vid_plane_no].in.fourcc, vidCfg[vid_plane_no].in.width, vidCfg[vid_plane_no].in.height, vidCfg[vid_plane_no].in.count);
+        bc_id = init_bcdev (tex_fourcc, vid_tex_width[vid_plane_no], vid_tex_height[vid_plane_no], vidCfg[vid_plane_no].in.count);
         if ( bc_id < 0) {
            printf (" exiting due to bc_id check failure for vid \n");
            exit (0);
@@ -676,7 +1755,7 @@ void recreate_vid_texture (int * bc_id_p, int vid_plane_no)
     {
         glDeleteTextures(1, &tex_obj_vid[vid_plane_no]);
 
-        bc_id = reinit_bcdev (vidCfg[vid_plane_no].in.fourcc, vidCfg[vid_plane_no].in.width, vidCfg[vid_plane_no].in.height, vidCfg[vid_plane_no].in.count, bc_id);
+        bc_id = reinit_bcdev (tex_fourcc, vid_tex_width[vid_plane_no], vid_tex_height[vid_plane_no], vidCfg[vid_plane_no].in.count, bc_id);
 
     }
     *bc_id_p = bc_id;
@@ -691,34 +1770,61 @@ void recreate_vid_texture (int * bc_id_p, int vid_plane_no)
      
     }
 
-    crop_x_n = (float) vidCfg[vid_plane_no].in.crop_x/vidCfg[vid_plane_no].in.width;
-    crop_w_n = (float) vidCfg[vid_plane_no].in.crop_width/vidCfg[vid_plane_no].in.width;
-    crop_y_n = (float) vidCfg[vid_plane_no].in.crop_y/vidCfg[vid_plane_no].in.height;
-    crop_h_n = (float) vidCfg[vid_plane_no].in.crop_height/vidCfg[vid_plane_no].in.height;
-
-    rect_tex_vid[vid_plane_no][0][0] = crop_x_n;
-    rect_tex_vid[vid_plane_no][0][1] = crop_y_n;
-
-    rect_tex_vid[vid_plane_no][1][0] = crop_x_n;
-    rect_tex_vid[vid_plane_no][1][1] = crop_y_n + crop_h_n;
-
-    rect_tex_vid[vid_plane_no][2][0] = crop_x_n + crop_w_n;
-    rect_tex_vid[vid_plane_no][2][1] = crop_y_n;
-
-
-    rect_tex_vid[vid_plane_no][3][0] = crop_x_n + crop_w_n;
-    rect_tex_vid[vid_plane_no][3][1] = crop_y_n;
+    vid_update_texcoords (vid_plane_no);
 
-    rect_tex_vid[vid_plane_no][4][0] = crop_x_n;
-    rect_tex_vid[vid_plane_no][4][1] = crop_y_n + crop_h_n;
+    glGenTextures (1, &tex_obj_vid[vid_plane_no]);
+    glBindTexture(GL_TEXTURE_STREAM_IMG, tex_obj_vid[vid_plane_no]);
+    glTexParameterf(GL_TEXTURE_STREAM_IMG, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_STREAM_IMG, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
 
-    rect_tex_vid[vid_plane_no][5][0] = crop_x_n + crop_w_n;
-    rect_tex_vid[vid_plane_no][5][1] = crop_y_n + crop_h_n;
+/* Point the buffers of a plane moved by VID_MSG_MAP at their new memory.
+   The GPU picks up a new address of a bc buffer when the stream texture is
+   recreated, which is much cheaper than reopening the bc device. */
+static void vid_remap_buffers (int bc_id, int vid_plane_no)
+{
+    unsigned int mask;
+    unsigned long phyaddr[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+    int i;
+
+    pthread_mutex_lock(&vid_data_lock);
+    mask = vid_remap_mask[vid_plane_no];
+    pthread_mutex_unlock(&vid_data_lock);
+
+    if (!mask || bc_id < 0)
+        return;
+
+    /* a mapped dma-buf replaces the one registered at the index once the
+       new address is */
+    vidctrl_lock_bufs();
+    pthread_mutex_lock(&vid_data_lock);
+    mask = vid_remap_mask[vid_plane_no];
+    memcpy (phyaddr, vidCfg[vid_plane_no].in.phyaddr, sizeof (phyaddr));
+    pthread_mutex_unlock(&vid_data_lock);
+
+    for (i = 0; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++)
+    {
+        if ((mask & (1 << i)) && modify_bufAddr (bc_id, i, phyaddr[i]) < 0)
+        {
+           printf (" exiting due to failure in modify buf addr for video \n");
+           exit(0);
+        }
+    }
 
+    glDeleteTextures(1, &tex_obj_vid[vid_plane_no]);
     glGenTextures (1, &tex_obj_vid[vid_plane_no]);
     glBindTexture(GL_TEXTURE_STREAM_IMG, tex_obj_vid[vid_plane_no]);
     glTexParameterf(GL_TEXTURE_STREAM_IMG, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_STREAM_IMG, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    /* an index mapped again meanwhile stays marked */
+    pthread_mutex_lock(&vid_data_lock);
+    for (i = 0; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++)
+        if ((mask & (1 << i)) && vidCfg[vid_plane_no].in.phyaddr[i] == phyaddr[i])
+            vid_remap_mask[vid_plane_no] &= ~(1 << i);
+    pthread_mutex_unlock(&vid_data_lock);
+    vidctrl_commit_map(vid_plane_no, mask);
+    vidctrl_unlock_bufs();
 }
 
 int main(int argc, char *argv[])
@@ -735,9 +1841,9 @@ int main(int argc, char *argv[])
     int   profiling   = 0;
     int swapRB_in_ARGB = 1;
     int active_planes;
+    int file_video = 0;
 
 #ifdef FILE_RAW_VIDEO_YUV422
-    int file_video = 0;
     int file_buf_idx = 0;
     int bcdevid_file_vid = -1;;
     GLuint tex_obj_file_vid; 
@@ -760,6 +1866,8 @@ int main(int argc, char *argv[])
     char opts[] = "f:i:a:b:p:l:m:n:o:s:d:h";
 
     signal(SIGINT, signalHandler);
+    /* a gfx client may go away with its event pipe: fail the write instead */
+    signal(SIGPIPE, SIG_IGN);
 
     for (;;) {
         c = getopt_long(argc, argv, opts, (void *)NULL, &idx);
@@ -893,8 +2001,15 @@ int main(int argc, char *argv[])
     for (i = 0; i < MAX_VID_PLANES; i++)
     {
         vid_plane_mdfd[i] = -1;
+        vid_plane_geom_mdfd[i] = 0;
+        vid_alpha[i] = 1.0;
         vid_data_idx[i] = 0;
         vid_plane_first_frame_recvd[i] = 0;
+        vid_plane_release[i] = 0;
+        vid_plane_reconfig_pending[i] = 0;
+        vid_data_pending[i] = 0;
+        vid_shown[i] = 0;
+        vid_shown_idx[i] = -1;
     } 
 
     /* Threads for video config Planes */
@@ -904,6 +2019,16 @@ int main(int argc, char *argv[])
         pthread_create(&vidCfgtid[i], NULL, vidConfigDataThread, (void *) &vidCfgPlanes[i]);
 
         DEBUG_PRINTF ((" Created Thread for Video plane %d\n", i));
+
+        pthread_create(&vidCtrltid[i], NULL, vidCtrlSocketThread, (void *) &vidCfgPlanes[i]);
+    }
+    pthread_create(&vidMuxtid, NULL, vidMuxSocketThread, NULL);
+
+    /* gfx planes may be placed in pixels */
+    if (get_disp_resolution(&disp_width, &disp_height))
+    {
+        printf (" exiting due to failure in reading the display resolution\n");
+        exit (0);
     }
 
     /* Threads for Graphics Planes */
@@ -915,6 +2040,9 @@ int main(int argc, char *argv[])
         DEBUG_PRINTF ((" Created Thread for GFX plane %d\n", i));
     }
 
+    /* Thread for plane animations */
+    pthread_create(&animtid, NULL, animThread, NULL);
+
     /* EGL Initialization */
     if (initEGL(NULL, NULL, profiling)) {
         printf("ERROR: init EGL failed\n");
@@ -964,6 +2092,11 @@ int main(int argc, char *argv[])
 
     gettimeofday(&tvp, NULL);
     while (!gQuit) {
+        if (!scene_wait_damage (file_video)) {
+            vid_release_planes ();
+            continue;
+        }
+
         active_planes = 0; 
         /* Check for active planes */
         for (i=0; i < MAX_VID_PLANES; i++)
@@ -987,6 +2120,7 @@ int main(int argc, char *argv[])
         /* ------------------------------------------------------------------*/
         if (file_video ) 
         {
+            glUseProgram(program);
             glBindTexture(GL_TEXTURE_STREAM_IMG, tex_obj_file_vid);
             glTexBindStreamIMG (bcdevid_file_vid, file_buf_idx);
 
@@ -1013,11 +2147,28 @@ int main(int argc, char *argv[])
                 if (vid_plane_mdfd[i] > 0)
                 {
                     DEBUG_PRINTF ((" Vid plane %d Updated \n", i));
+                    /* registers every buffer address, mapped ones included */
+                    pthread_mutex_lock(&vid_data_lock);
+                    vid_remap_mask[i] = 0;
+                    pthread_mutex_unlock(&vid_data_lock);
+                    vidctrl_lock_bufs();
+                    vid_plane_mdfd[i] = 0;
                     recreate_vid_texture (&bcdevid_vid[i], i);
+                    /* the buffers of the previous config are unused now */
+                    vidctrl_commit_bufs(i);
+                    vidctrl_unlock_bufs();
                     matrixRotateZ(vidCfg[i].in.rotate, matvid[i]);
-                    vid_plane_mdfd[i] = 0;
+                    vid_plane_geom_mdfd[i] = 0;
 
+                } else if (vid_plane_geom_mdfd[i])
+                {
+                    /* geometry only: the buffers stay registered */
+                    vid_plane_geom_mdfd[i] = 0;
+                    vid_update_texcoords (i);
+                    matrixRotateZ(vidCfg[i].in.rotate, matvid[i]);
                 }
+
+                vid_remap_buffers (bcdevid_vid[i], i);
             }
         }
 
@@ -1048,20 +2199,25 @@ int main(int argc, char *argv[])
             }
         }
 
+        /* ------------------------------------------------------------------*/
+        /* Plane animations                                                  */
+        /* ------------------------------------------------------------------*/
+        anim_update (vidctrl_now_us());
+
         /* -----------------------------------------------------------------------------*/
         /* Video Texturing  for overlayongfx=0, i.e., gfx planes on top of video planes */
         /* -----------------------------------------------------------------------------*/
 
-        glUseProgram(program);
-
         for (i=0; i < MAX_VID_PLANES; i++)
         {
-            if (vidCfg[i].enable && vid_plane_first_frame_recvd[i] && !vidCfg[i].overlayongfx)
+            if (vidCfg[i].enable && vid_plane_first_frame_recvd[i] && !vidCfg[i].overlayongfx &&
+                (idx = vid_take_frame(i)) >= 0)
             {
-                glUniformMatrix4fv( matrixLocation, 1, GL_FALSE, matvid[i]);
+                use_vid_program (i, matrixLocation, swapRB_in_ARGB);
+                vid_blend_begin (i);
 
                 glBindTexture(GL_TEXTURE_STREAM_IMG, tex_obj_vid[i]);
-                glTexBindStreamIMG(bcdevid_vid[i], vid_data_idx[i]);
+                glTexBindStreamIMG(bcdevid_vid[i], idx);
 
                 glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
                                       rect_vertices_vid[i]);
@@ -1074,6 +2230,7 @@ int main(int argc, char *argv[])
                 glDrawArrays(GL_TRIANGLES, 0, 6);
                 glDisableVertexAttribArray (0);
                 glDisableVertexAttribArray (1);
+                vid_blend_end (i);
             }
         }
 
@@ -1095,7 +2252,17 @@ int main(int argc, char *argv[])
                     glUniformMatrix4fv( matrixLocation, 1, GL_FALSE, matgfx[i]);
                 }
                 glBindTexture(GL_TEXTURE_STREAM_IMG, tex_obj_gfx[i]);
-                glTexBindStreamIMG (bcdevid_gfx[i], 0);
+                glTexBindStreamIMG (bcdevid_gfx[i], gfx_buf_idx[i] < gfx_buf_count[i] ? gfx_buf_idx[i] : 0);
+
+                pthread_mutex_lock(&gfx_evt_lock);
+                if (gfx_frame_req[i])
+                {
+                    /* the last request drawn answers for those before it */
+                    gfx_frame_drawn[i] = gfx_frame_req[i];
+                    gfx_frame_req[i]   = 0;
+                    gfx_frame_buf[i]   = gfx_buf_idx[i];
+                }
+                pthread_mutex_unlock(&gfx_evt_lock);
 
                 /* Configure pixel/global blending if enabled */
                 if (gfxCfg[i].in_g.enable_blending)
@@ -1136,16 +2303,16 @@ int main(int argc, char *argv[])
         /* Video Texturing  for overlayongfx=1, i.e., video planes on top of gfx planes */
         /* -----------------------------------------------------------------------------*/
 
-        glUseProgram(program);
-
         for (i=0; i < MAX_VID_PLANES; i++)
         {
-            if (vidCfg[i].enable && vid_plane_first_frame_recvd[i] && vidCfg[i].overlayongfx)
+            if (vidCfg[i].enable && vid_plane_first_frame_recvd[i] && vidCfg[i].overlayongfx &&
+                (idx = vid_take_frame(i)) >= 0)
             {
-                glUniformMatrix4fv( matrixLocation, 1, GL_FALSE, matvid[i]);
+                use_vid_program (i, matrixLocation, swapRB_in_ARGB);
+                vid_blend_begin (i);
 
                 glBindTexture(GL_TEXTURE_STREAM_IMG, tex_obj_vid[i]);
-                glTexBindStreamIMG(bcdevid_vid[i], vid_data_idx[i]);
+                glTexBindStreamIMG(bcdevid_vid[i], idx);
 
                 glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
                                       rect_vertices_vid[i]);
@@ -1158,6 +2325,7 @@ int main(int argc, char *argv[])
                 glDrawArrays(GL_TRIANGLES, 0, 6);
                 glDisableVertexAttribArray (0);
                 glDisableVertexAttribArray (1);
+                vid_blend_end (i);
             }
         }
 
@@ -1165,6 +2333,9 @@ int main(int argc, char *argv[])
 
         if (active_planes)  eglSwapBuffers(dpy, surface);
         else usleep (10000);
+        report_presented (active_planes);
+
+        vid_release_planes ();
 
         if (profiling == 0)
             continue;
@@ -1180,6 +2351,11 @@ int main(int argc, char *argv[])
     }
     printf ("\n");
 
+    /* wake up the threads waiting on a plane to be retired */
+    pthread_mutex_lock(&vid_release_lock);
+    pthread_cond_broadcast(&vid_release_cond);
+    pthread_mutex_unlock(&vid_release_lock);
+
     deInitEGL();
     /* clean up shaders */
     glDeleteProgram(program);
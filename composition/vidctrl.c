@@ -0,0 +1,484 @@
+/*****************************************************************************
+ * vidctrl.c
+ *
+ *    video plane control socket
+ *        - SCM_RIGHTS reception of dma-buf fds
+ *        - per buffer index import cache (fd -> physical address)
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *   
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *   
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <cmem.h>
+#include "vidctrl.h"
+
+#define PAGE_SZ 4096
+
+/* One imported dma-buf per video buffer index */
+typedef struct
+{
+    int           fd;        /* our reference on the dma-buf */
+    dev_t         dev;       /* identity of the dma-buf, to import only once */
+    ino_t         ino;
+    unsigned long offset;
+    void         *map;       /* page aligned mapping of the buffer, NULL if unused */
+    size_t        map_len;
+    unsigned long phyaddr;
+    int           borrowed;  /* next only: still owned by cur at the same index */
+} vidImport_s;
+
+/* cur  - buffers registered with the bccat device and sampled by the GPU
+ * next - buffers of a config not yet applied by the render loop
+ * map  - buffers of VID_MSG_MAP messages not yet registered
+ * All are only changed with import_lock held, see vidctrl_lock_bufs       */
+static vidImport_s import_cur [MAX_VID_PLANES][MAX_VIDEO_BUFFERS_PER_CHANNEL];
+static vidImport_s import_next[MAX_VID_PLANES][MAX_VIDEO_BUFFERS_PER_CHANNEL];
+static vidImport_s import_map [MAX_VID_PLANES][MAX_VIDEO_BUFFERS_PER_CHANNEL];
+static pthread_mutex_t import_lock = PTHREAD_MUTEX_INITIALIZER;
+static int cmem_initialized = 0;
+
+/* connected client of each plane, for the status messages; ctrl_mux[] is
+   set for the planes attached through the shared socket */
+static int ctrl_conn[MAX_VID_PLANES] = { -1, -1, -1, -1 };
+static int ctrl_mux[MAX_VID_PLANES];
+static pthread_mutex_t ctrl_conn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int listen_at (const char *vid_ctrl_socket, int backlog)
+{
+    int sock;
+    struct sockaddr_un addr;
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (sock < 0) {
+        perror("vidctrl_listen: socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, vid_ctrl_socket, sizeof(addr.sun_path)-1);
+    unlink(vid_ctrl_socket);
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(sock, backlog) < 0) {
+        printf(" Failed to set up control socket %s\n", vid_ctrl_socket);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int vidctrl_listen (int vid_plane_no)
+{
+    char vid_ctrl_socket[] = VIDEO_CTRL_SOCKET_NAME;
+
+    vid_ctrl_socket[strlen(vid_ctrl_socket)-1] = '0' + vid_plane_no;
+    return listen_at(vid_ctrl_socket, 1);
+}
+
+int vidctrl_listen_mux (void)
+{
+    return listen_at(VIDEO_MUX_SOCKET_NAME, MAX_VID_PLANES);
+}
+
+/* Receive one record of up to len bytes; fds passed along with it are
+   returned in fds[]. A truncated record is dropped with its fds. */
+static int recv_record (int sock, void *buf, size_t len, int *fds, int *nfds)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char cbuf[CMSG_SPACE(sizeof(int) * MAX_VIDEO_BUFFERS_PER_CHANNEL)];
+    int n;
+
+    iov.iov_base = buf;
+    iov.iov_len  = len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    *nfds = 0;
+    n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0)
+        return n;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int cnt = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds + *nfds, CMSG_DATA(cmsg), cnt * sizeof(int));
+            *nfds += cnt;
+        }
+    }
+
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        while (*nfds)
+            close(fds[--(*nfds)]);
+        return -1;
+    }
+    return n;
+}
+
+/* Receive one message; fds passed along with it are returned in fds[]. */
+int vidctrl_recv (int sock, videoConfig_s *cfg, int *fds, int *nfds)
+{
+    int n = recv_record(sock, cfg, sizeof(*cfg), fds, nfds);
+
+    /* fds are only meaningful on a complete config message */
+    if (n > 0 && n != sizeof(*cfg)) {
+        while (*nfds)
+            close(fds[--(*nfds)]);
+        return -1;
+    }
+    return n;
+}
+
+/* Receive one record of the shared socket into msgs[VID_MUX_MAX_BATCH],
+   returns the number of messages in it */
+int vidctrl_recv_mux (int sock, vidMuxMsg_s *msgs, int *fds, int *nfds)
+{
+    int n = recv_record(sock, msgs, sizeof(*msgs) * VID_MUX_MAX_BATCH, fds, nfds);
+
+    if (n <= 0)
+        return n;
+    if (n % sizeof(*msgs) || (*nfds && n != (int)sizeof(*msgs))) {
+        while (*nfds)
+            close(fds[--(*nfds)]);
+        return -1;
+    }
+    return n / sizeof(*msgs);
+}
+
+static void release_import (vidImport_s *imp)
+{
+    if (imp->map && !imp->borrowed) {
+        munmap(imp->map, imp->map_len);
+        close(imp->fd);
+    }
+    memset(imp, 0, sizeof(*imp));
+}
+
+/* Map the buffer and resolve its physical address. The buffer must fit
+   inside the dma-buf and be physically contiguous, as the bccat device
+   takes a single base address per buffer. */
+static int import_buf (vidImport_s *imp, int fd, unsigned long offset, unsigned int size)
+{
+    struct stat st;
+    off_t dmabuf_size;
+    unsigned long aligned, pa;
+    char *va;
+    size_t i;
+
+    dmabuf_size = lseek(fd, 0, SEEK_END);
+    if (dmabuf_size < 0 || size == 0 || offset + size > (unsigned long)dmabuf_size) {
+        printf(" vidctrl: buffer (offset %lu size %u) outside of dma-buf\n", offset, size);
+        return -1;
+    }
+
+    aligned       = offset & ~(PAGE_SZ - 1);
+    imp->map_len  = size + (offset - aligned);
+    imp->map      = mmap(NULL, imp->map_len, PROT_READ, MAP_SHARED, fd, aligned);
+    if (imp->map == MAP_FAILED) {
+        imp->map = NULL;
+        perror("vidctrl: mmap dma-buf");
+        return -1;
+    }
+
+    va = (char *)imp->map;
+    pa = CMEM_getPhys(va);
+    for (i = PAGE_SZ; i < imp->map_len; i += PAGE_SZ) {
+        if (CMEM_getPhys(va + i) != pa + i) {
+            printf(" vidctrl: dma-buf is not physically contiguous\n");
+            munmap(imp->map, imp->map_len);
+            imp->map = NULL;
+            return -1;
+        }
+    }
+
+    fstat(fd, &st);
+    imp->fd      = fd;
+    imp->dev     = st.st_dev;
+    imp->ino     = st.st_ino;
+    imp->offset  = offset;
+    imp->phyaddr = pa + (offset - aligned);
+    return 0;
+}
+
+/* Held by a control thread from importing the buffers of a config until
+   the config is handed to the render loop, and by the render loop while it
+   registers the buffers and commits them. A config replaced before the
+   render loop got to it thus never has its buffers registered. */
+void vidctrl_lock_bufs (void)
+{
+    pthread_mutex_lock(&import_lock);
+}
+
+void vidctrl_unlock_bufs (void)
+{
+    pthread_mutex_unlock(&import_lock);
+}
+
+/* Import the dma-bufs of a config message into the pending set and fill in
+   cfg->in.phyaddr[]. A buffer already registered at the same index is not
+   imported again. Takes ownership of fds. Called with the buffers locked. */
+int vidctrl_import_bufs (int vid_plane_no, videoConfig_s *cfg, int *fds, int nfds)
+{
+    int i, ret = 0;
+    struct stat st;
+    vidImport_s *cur  = import_cur[vid_plane_no];
+    vidImport_s *next = import_next[vid_plane_no];
+
+    if (!cmem_initialized) {
+        CMEM_init();
+        cmem_initialized = 1;
+    }
+
+    for (i = 0; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++)
+        release_import(&next[i]);
+
+    if (nfds != cfg->in.count || nfds > MAX_VIDEO_BUFFERS_PER_CHANNEL) {
+        printf(" vidctrl: got %d fds for %d buffers\n", nfds, cfg->in.count);
+        ret = -1;
+        goto exit;
+    }
+
+    for (i = 0; i < nfds; i++) {
+        if (fstat(fds[i], &st) == 0 && cur[i].map &&
+            cur[i].dev == st.st_dev && cur[i].ino == st.st_ino &&
+            cur[i].offset == cfg->in.offset[i]) {
+            /* same buffer as before - reuse the import, cur keeps owning
+               it until the commit, the GPU may still sample it */
+            next[i] = cur[i];
+            next[i].borrowed = 1;
+            close(fds[i]);
+        } else if (import_buf(&next[i], fds[i], cfg->in.offset[i], cfg->in.buf_size) < 0) {
+            ret = -1;
+            goto exit;
+        }
+        fds[i] = -1;
+        cfg->in.phyaddr[i] = next[i].phyaddr;
+        DEBUG_PRINTF((" vidctrl: plane %d buffer %d -> %lx\n", vid_plane_no, i, next[i].phyaddr));
+    }
+    return 0;
+
+exit:
+    for (; i < nfds; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+    for (i = 0; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++)
+        release_import(&next[i]);
+    return ret;
+}
+
+/* Import the dma-buf of a VID_MSG_MAP message for index cfg->buf_index and
+   fill in cfg->in.phyaddr[] of it. The buffer joins the pending config if
+   staged is set, otherwise it replaces the registered one at the next
+   vidctrl_commit_map(). Takes ownership of fd. Called with the buffers
+   locked. */
+int vidctrl_import_map (int vid_plane_no, videoConfig_s *cfg, int fd, int staged)
+{
+    int idx = cfg->buf_index;
+    vidImport_s *imp;
+
+    if (idx < 0 || idx >= MAX_VIDEO_BUFFERS_PER_CHANNEL) {
+        close(fd);
+        return -1;
+    }
+
+    imp = staged ? &import_next[vid_plane_no][idx] : &import_map[vid_plane_no][idx];
+    release_import(imp);
+    if (import_buf(imp, fd, cfg->in.offset[idx], cfg->in.buf_size) < 0) {
+        close(fd);
+        return -1;
+    }
+    cfg->in.phyaddr[idx] = imp->phyaddr;
+    DEBUG_PRINTF((" vidctrl: plane %d buffer %d mapped to %lx\n", vid_plane_no, idx, imp->phyaddr));
+    return 0;
+}
+
+/* Called from the render loop once the buffers of mask are registered at
+   their mapped address, with the buffers locked */
+void vidctrl_commit_map (int vid_plane_no, unsigned int mask)
+{
+    int i;
+    vidImport_s *cur = import_cur[vid_plane_no];
+    vidImport_s *map = import_map[vid_plane_no];
+
+    for (i = 0; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++) {
+        if ((mask & (1 << i)) && map[i].map) {
+            release_import(&cur[i]);
+            cur[i] = map[i];
+            memset(&map[i], 0, sizeof(vidImport_s));
+        }
+    }
+}
+
+/* Called from the render loop once the pending buffers are registered with
+   the bccat device, with the buffers locked; the previous set is no longer
+   referenced by the GPU. */
+void vidctrl_commit_bufs (int vid_plane_no)
+{
+    int i;
+    vidImport_s *cur  = import_cur[vid_plane_no];
+    vidImport_s *next = import_next[vid_plane_no];
+
+    for (i = 0; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++) {
+        /* mappings of the previous config are obsolete */
+        release_import(&import_map[vid_plane_no][i]);
+        if (!next[i].borrowed)
+            release_import(&cur[i]);
+        cur[i] = next[i];
+        cur[i].borrowed = 0;
+        memset(&next[i], 0, sizeof(vidImport_s));
+    }
+}
+
+void vidctrl_release_bufs (int vid_plane_no)
+{
+    int i;
+
+    pthread_mutex_lock(&import_lock);
+    for (i = 0; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++) {
+        release_import(&import_map[vid_plane_no][i]);
+        release_import(&import_next[vid_plane_no][i]);
+        release_import(&import_cur[vid_plane_no][i]);
+    }
+    pthread_mutex_unlock(&import_lock);
+}
+
+/* Make conn the client of the plane, or of the lowest free plane if
+   vid_plane_no is -1. Returns the plane or -1 if it is taken. */
+int vidctrl_claim (int vid_plane_no, int conn, int mux)
+{
+    int i, plane = -1;
+
+    pthread_mutex_lock(&ctrl_conn_lock);
+    for (i = 0; i < MAX_VID_PLANES; i++) {
+        if ((vid_plane_no < 0 || i == vid_plane_no) && ctrl_conn[i] < 0) {
+            ctrl_conn[i] = conn;
+            ctrl_mux[i]  = mux;
+            plane = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ctrl_conn_lock);
+    return plane;
+}
+
+int vidctrl_get_conn (int vid_plane_no)
+{
+    int conn;
+
+    pthread_mutex_lock(&ctrl_conn_lock);
+    conn = ctrl_conn[vid_plane_no];
+    pthread_mutex_unlock(&ctrl_conn_lock);
+    return conn;
+}
+
+void vidctrl_set_conn (int vid_plane_no, int conn)
+{
+    pthread_mutex_lock(&ctrl_conn_lock);
+    ctrl_conn[vid_plane_no] = conn;
+    ctrl_mux[vid_plane_no]  = 0;
+    pthread_mutex_unlock(&ctrl_conn_lock);
+}
+
+/* Send a reply on the shared socket without blocking. Returns 1 once it
+   is sent, 0 if the client's socket buffer is full, -1 if it is gone. */
+int vidctrl_send_mux_status (int conn, vidMuxStatus_s *ms)
+{
+    if (send(conn, ms, sizeof(*ms), MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(*ms))
+        return 1;
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+}
+
+/* Report on a frame to the client of the plane. Never blocks the render
+   loop: a frame status that does not fit in the socket buffer is dropped.
+   The close acknowledgement is always delivered; it is sent without the
+   lock, which the other status senders must not wait on. */
+void vidctrl_send_status (int vid_plane_no, int status, int buf_index,
+                          long long recv_us, long long present_us, long long scanout_us)
+{
+    videoStatus_s st;
+    vidMuxStatus_s ms;
+    int conn, mux;
+
+    memset(&st, 0, sizeof(st));
+    st.status     = status;
+    st.buf_index  = buf_index;
+    st.recv_us    = recv_us;
+    st.present_us = present_us;
+    st.scanout_us = scanout_us;
+    ms.plane  = vid_plane_no;
+    ms.status = st;
+
+    pthread_mutex_lock(&ctrl_conn_lock);
+    conn = ctrl_conn[vid_plane_no];
+    mux  = ctrl_mux[vid_plane_no];
+    if (conn >= 0 && status != VID_STATUS_CLOSED) {
+        if (mux)
+            send(conn, &ms, sizeof(ms), MSG_DONTWAIT | MSG_NOSIGNAL);
+        else
+            send(conn, &st, sizeof(st), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    pthread_mutex_unlock(&ctrl_conn_lock);
+
+    /* only the thread of the connection closes it, after this returns */
+    if (conn >= 0 && status == VID_STATUS_CLOSED) {
+        if (mux)
+            send(conn, &ms, sizeof(ms), MSG_NOSIGNAL);
+        else
+            send(conn, &st, sizeof(st), MSG_NOSIGNAL);
+    }
+}
+
+long long vidctrl_now_us (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,62 @@
+/*****************************************************************************
+ * vidctrl.h
+ *
+ *    video plane control socket - dma-buf import
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *   
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *   
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+#ifndef __VIDCTRL_H__
+#define __VIDCTRL_H__
+
+#include "../gpucomp.h"
+
+int  vidctrl_listen (int vid_plane_no);
+int  vidctrl_listen_mux (void);
+int  vidctrl_recv (int sock, videoConfig_s *cfg, int *fds, int *nfds);
+int  vidctrl_recv_mux (int sock, vidMuxMsg_s *msgs, int *fds, int *nfds);
+void vidctrl_lock_bufs (void);
+void vidctrl_unlock_bufs (void);
+int  vidctrl_import_bufs (int vid_plane_no, videoConfig_s *cfg, int *fds, int nfds);
+int  vidctrl_import_map (int vid_plane_no, videoConfig_s *cfg, int fd, int staged);
+void vidctrl_commit_map (int vid_plane_no, unsigned int mask);
+void vidctrl_commit_bufs (int vid_plane_no);
+void vidctrl_release_bufs (int vid_plane_no);
+int  vidctrl_claim (int vid_plane_no, int conn, int mux);
+int  vidctrl_get_conn (int vid_plane_no);
+void vidctrl_set_conn (int vid_plane_no, int conn);
+int  vidctrl_send_mux_status (int conn, vidMuxStatus_s *ms);
+void vidctrl_send_status (int vid_plane_no, int status, int buf_index,
+                          long long recv_us, long long present_us, long long scanout_us);
+long long vidctrl_now_us (void);
+
+#endif /* __VIDCTRL_H__ */
@@ -52,9 +52,28 @@
 
 #define GFX_CONFIG_NAMED_PIPE    "/opt/gpu-compositing/named_pipes/gfx_cfg_plane_X"
 
+/* Named pipe back to the client of a gfx plane (gfxEvent_s messages). The
+   client opens it for reading before it asks for events; the compositor
+   never blocks on it and drops the events a client does not read */
+#define GFX_EVENT_NAMED_PIPE     "/opt/gpu-compositing/named_pipes/gfx_evt_plane_X"
+
 #define VIDEO_CONFIG_AND_DATA_FIFO_NAME "/opt/gpu-compositing/named_pipes/video_cfg_and_data_plane_X"
 #define VIDEODATA_FIFO_NAME "/opt/gpu-compositing/named_pipes/video_data_plane_X"
 
+/* Unix domain (SOCK_SEQPACKET) control socket for video planes. Carries the
+   same videoConfig_s messages as the named pipe, and in addition lets the
+   client hand over its buffers as dma-buf file descriptors (SCM_RIGHTS)
+   instead of raw physical addresses */
+#define VIDEO_CTRL_SOCKET_NAME "/opt/gpu-compositing/named_pipes/video_ctrl_plane_X"
+
+/* Shared (SOCK_SEQPACKET) control socket, one connection per client process
+   for all the video planes it drives: see vidMuxMsg_s */
+#define VIDEO_MUX_SOCKET_NAME "/opt/gpu-compositing/named_pipes/video_ctrl_mux"
+
+/* Named pipe for plane animations (planeAnim_s messages), shared by all
+   clients: messages are smaller than PIPE_BUF so writes never interleave */
+#define ANIM_NAMED_PIPE "/opt/gpu-compositing/named_pipes/plane_anim"
+
 #define MAX_GFX_PLANES 4
 #define MAX_VID_PLANES 4
 
@@ -75,7 +94,7 @@
 /* Default values for gpuvsink (video)  parameters */
 #define VID_GPUVSINK_XPOS   (-1.0)   /* default value for x-pos */
 #define VID_GPUVSINK_YPOS   (1.0)    /* y-pos */
-#define VID_GPUVSINK_CHANNEL_NO  0   /* default value for channel-no */
+#define VID_GPUVSINK_CHANNEL_NO  (-1) /* default value for channel-no: any free plane */
 #define VID_GPUVSINK_WIDTH  (2.0)    /* width */
 #define VID_GPUVSINK_HEIGHT (2.0)    /* height */
 #define VID_GPUVSINK_ROTATE (0.0)    /* rotate */
@@ -95,12 +114,21 @@
 
 #define BC_PIX_FMT_RGB565   BC_FOURCC('R', 'G', 'B', 'P') /*RGB 5:6:5*/
 #define BC_PIX_FMT_ARGB     BC_FOURCC('A', 'R', 'G', 'B') /*ARGB 8:8:8:8*/
+
+#define GFX_MAX_DAMAGE_RECTS 8
+#define GFX_MAX_BUFFERS      3   /* triple buffered gfx surface */
+
+/* A message only updates the sections marked valid. A client that sends
+   damage has its plane composed again only when it reports some; the planes
+   of clients that never do are composed every frame. */
 typedef struct
 {
     int enable;                      /* 1 - enable the gfx plane; 0 - disable */
     int input_params_valid;          /* 1 - valid i/p parameters; 0 - invalid */
     struct in_g { 
         unsigned long data_ph_addr;  /* physical address of the gfx  buffer   */
+        int count;                   /* buffers, 0 or 1 - single buffered;    */
+        unsigned long buf_size;      /* buffer i at data_ph_addr + i*buf_size */
         int width;                   /* gfx plane width in pixels             */
         int height;                  /* gfx plane height in pixels            */
         int crop_x;                  /* top-left position where the cropping  */ 
@@ -121,13 +149,96 @@ typedef struct
         float ypos;   /* y position [-1.0 to 1.0] */
         float width;  /*  width  - [0.0 to 2.0], 2.0 correspond to fullscreen width */
         float height; /*  height - [0.0 to 2.0], 2.0 correspond to fullscreen height */
+        int in_pixels;/* 1 - all four are in pixels of the display instead, from
+                         its top-left corner, e.g. a window sized plane at 1:1 */
     } out_g;
+
+    /* blending and rotation of a running plane; replaces the same fields of
+       in_g without recreating the plane's texture */
+    int render_params_valid;         /* 1 - valid render parameters; 0 - invalid */
+    struct render_g {
+        int enable_blending;         /* as in in_g */
+        int enable_global_alpha;
+        float global_alpha;
+        float rotate;
+    } render_g;
+
+    /* areas of the gfx buffer drawn since the last damage message; with
+       several buffers, the client is done with buf_index and shows it from
+       now on, and draws into another one */
+    int damage_valid;                /* 1 - valid damage; 0 - invalid */
+    struct damage_g {
+        int buf_index;               /* buffer to show, 0 if single buffered */
+        int count;                   /* rects used, 0 - the whole buffer */
+        struct {
+            short x, y;              /* top-left, in pixels of the buffer */
+            short width, height;
+        } rect[GFX_MAX_DAMAGE_RECTS];
+    } damage_g;
+
+    /* not 0 - send GFX_EVENT_FRAME_DONE once a frame with this message
+       applied is on the screen; the plane is composed again even without
+       damage. The value comes back in frame_seq, a client numbering its
+       requests tells a late event from the answer to its last one. */
+    int frame_request;
 } gfxCfg_s;
 
+/* Events on GFX_EVENT_NAMED_PIPE */
+#define GFX_EVENT_FRAME_DONE 0  /* the frame asked for with frame_request was
+                                   swapped: a good time to draw the next one */
+typedef struct
+{
+    int type;               /* GFX_EVENT_xxx */
+    int buf_index;          /* gfx buffer the frame showed */
+    long long present_us;   /* CLOCK_MONOTONIC time of the swap, in us */
+    long long scanout_us;   /* when it reaches the display, estimated as for
+                               VID_STATUS_PRESENTED; 0 if unknown */
+    int frame_seq;          /* frame_request of the last message the frame
+                               applied; earlier requests get no event */
+} gfxEvent_s;
+
 #define MAX_VIDEO_BUFFERS_PER_CHANNEL 16
+
+/* Frame layout: plane_offset[]/plane_stride[] are indexed by component (Y, U,
+ * V) as gst_video_format_get_component_offset() reports them, so for NV12 the
+ * U and V entries point one byte apart into the same interleaved plane.
+ * num_planes == 0 is sent by legacy clients and means a packed 16 bpp frame.
+ * Strides may be larger than a line of the picture and buf_size may include
+ * lines beyond in.height, as decoders working on aligned blocks need; the
+ * picture is always the top-left in.width x in.height pixels.
+ */
+#define VID_MAX_COMPONENTS 3
+
+/* videoConfig_s.config_data message types */
+#define VID_MSG_DATA    0   /* buf_index is ready to be displayed        */
+#define VID_MSG_CONFIG  1   /* (re)configure the plane and its buffers   */
+#define VID_MSG_CLOSE   2   /* disable the plane and close the channel   */
+#define VID_MSG_RECONFIG 3  /* new buffers/format for a running plane; the
+                               last frame stays on screen and the change is
+                               applied with the next VID_MSG_DATA          */
+#define VID_MSG_MAP     4   /* buffer buf_index now lives at in.phyaddr[buf_index];
+                               used for frames imported from upstream and by
+                               a pool growing or shrinking within in.count,
+                               the index must not be on screen or in flight */
+
+#define VID_MSG_GEOMETRY 5  /* only out.*, in.rotate and in.crop_* changed:
+                               moves the plane without touching its buffers */
+
+#define VID_MSG_ATTACH  6   /* shared socket only: take plane buf_index, or the
+                               lowest free plane if -1; answered with
+                               VID_STATUS_ATTACHED                          */
+
+/* On the control socket a VID_MSG_(RE)CONFIG message may carry in.count dma-buf
+ * fds as SCM_RIGHTS ancillary data, one per buffer index. Buffer i then lives
+ * at in.offset[i] bytes into the i-th fd and in.phyaddr[] is ignored; the
+ * compositor imports each fd once and keeps it until the next config or the
+ * close of the channel. A VID_MSG_MAP message may carry the one fd of buffer
+ * buf_index, which replaces the import of that index. Data messages never
+ * carry fds.
+ */
 typedef struct 
 {
-    int config_data;   /* 1 - config   0 - data  2 - close the named pipe */
+    int config_data;   /* VID_MSG_xxx */
     int buf_index;     /* if data, buffer index */
     int enable;        /* 1 - enable the video plane; 0 - disable */
     int overlayongfx;  /* 0 - gfx on video; 1 - video on gfx */
@@ -144,6 +255,12 @@ typedef struct
         int crop_height;
         unsigned int fourcc;    /* pixel format */
         unsigned long phyaddr[MAX_VIDEO_BUFFERS_PER_CHANNEL]; /* Physical addresses of video buffers */
+        unsigned long offset[MAX_VIDEO_BUFFERS_PER_CHANNEL];  /* offset of each buffer in its dma-buf */
+        unsigned int  buf_size;  /* size of one video buffer in bytes */
+        unsigned int  num_planes;      /* memory planes: 1 packed, 2 NV12, 3 I420/YV12 */
+        unsigned long plane_offset[VID_MAX_COMPONENTS]; /* byte offset of the Y, U, V */
+        unsigned int  plane_stride[VID_MAX_COMPONENTS]; /* components in a buffer and */
+                                                        /* their line strides         */
     } in;
 
     /* output video window position and resolution in normalized device co-ordinates */
@@ -155,4 +272,83 @@ typedef struct
     } out;
 } videoConfig_s;
 
+/* Plane animation: the compositor moves the plane from its current state to
+   the target over duration_ms, interpolating every frame. Only the fields
+   selected in mask are animated; a new animation or a new output config of
+   the plane replaces a running one. A duration of 0 jumps to the target. */
+#define ANIM_PLANE_VID  0
+#define ANIM_PLANE_GFX  1
+
+#define ANIM_POSITION   0x1     /* out.xpos, out.ypos   */
+#define ANIM_SIZE       0x2     /* out.width, out.height */
+#define ANIM_ALPHA      0x4     /* global alpha          */
+#define ANIM_ROTATE     0x8     /* rotation              */
+
+#define ANIM_EASE_LINEAR      0
+#define ANIM_EASE_IN          1   /* quadratic, starts slowly */
+#define ANIM_EASE_OUT         2   /* quadratic, ends slowly   */
+#define ANIM_EASE_IN_OUT      3   /* smoothstep               */
+
+typedef struct
+{
+    int plane_type;            /* ANIM_PLANE_xxx */
+    int plane_no;
+    int mask;                  /* ANIM_POSITION | ANIM_SIZE | ... */
+    int easing;                /* ANIM_EASE_xxx */
+    unsigned int duration_ms;
+    struct {
+        float xpos;            /* normalized device co-ordinates, as in */
+        float ypos;            /* the plane output config               */
+        float width;
+        float height;
+        float alpha;           /* [0.0 to 1.0] */
+        float rotate;          /* decimal degrees */
+    } target;
+} planeAnim_s;
+
+/* Status sent back by the compositor on the control socket, per data message */
+#define VID_STATUS_PRESENTED 0  /* buf_index went on screen with the swap at present_us */
+#define VID_STATUS_SKIPPED   1  /* buf_index was replaced by a newer frame before
+                                   it could be drawn                            */
+#define VID_STATUS_CLOSED    2  /* answer to VID_MSG_CLOSE: the plane is disabled
+                                   and the GPU is done with its buffers, which
+                                   may be freed now; buf_index is -1            */
+#define VID_STATUS_ATTACHED  3  /* answer to VID_MSG_ATTACH: buf_index is the
+                                   plane now driven by the client, -1 if none
+                                   was free                                     */
+#define VID_STATUS_REJECTED  4  /* a config or reconfig was dropped, the GPU cannot
+                                   texture its buffer layout; the plane keeps
+                                   its previous config; buf_index is -1         */
+typedef struct
+{
+    int status;             /* VID_STATUS_xxx */
+    int buf_index;          /* the frame the status is about */
+    long long recv_us;      /* CLOCK_MONOTONIC time its data message arrived, in us */
+    long long present_us;   /* CLOCK_MONOTONIC time of the swap that showed it */
+    long long scanout_us;   /* PRESENTED: when it reaches the display, estimated
+                               from the swap period and the GPU render time
+                               the compositor measures; 0 if unknown        */
+} videoStatus_s;
+
+/* On the shared socket every record holds one or more messages back to back,
+ * all the messages a client has for one display refresh being written at
+ * once. A record carrying dma-buf fds holds that one config or mapping
+ * message only. Messages for a plane are accepted once the connection has
+ * attached it; the plane is free again after its close or when the
+ * connection goes away. Status comes back tagged with the plane as well.
+ */
+#define VID_MUX_MAX_BATCH 16   /* messages in one record */
+
+typedef struct
+{
+    int plane;              /* video plane, ignored for VID_MSG_ATTACH */
+    videoConfig_s cfg;
+} vidMuxMsg_s;
+
+typedef struct
+{
+    int plane;
+    videoStatus_s status;
+} vidMuxStatus_s;
+
 #endif /* __GPUCOMP_H__ */
@@ -0,0 +1,148 @@
+/******************************************************************************
+*****************************************************************************
+ * gst_bc_freelist.c
+ * Lock-free free-list of buffer indices
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "gst_bc_freelist.h"
+
+#define HEAD(tag, top)  ((gint) (((guint) (tag) << 8) | (top)))
+#define HEAD_TOP(head)  ((guint) (head) & 0xff)
+#define HEAD_TAG(head)  ((guint) (head) >> 8)
+
+static void
+futex_wait (volatile gint * addr, gint val)
+{
+  syscall (SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void
+futex_wake (volatile gint * addr, gint count)
+{
+  syscall (SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+void
+gst_bc_freelist_init (GstBcFreeList * list)
+{
+  list->head = HEAD (0, GST_BC_FREELIST_EMPTY);
+  list->length = 0;
+  list->seq = 0;
+  list->waiters = 0;
+  list->closed = 0;
+}
+
+/**
+ * Give an index back to the list, waking up a thread waiting for one
+ */
+void
+gst_bc_freelist_push (GstBcFreeList * list, guint index)
+{
+  gint old;
+
+  g_return_if_fail (index < GST_BC_FREELIST_CAPACITY);
+
+  do {
+    old = g_atomic_int_get (&list->head);
+    list->next[index] = HEAD_TOP (old);
+  } while (!g_atomic_int_compare_and_exchange (&list->head, old,
+          HEAD (HEAD_TAG (old) + 1, index)));
+
+  g_atomic_int_inc (&list->length);
+  g_atomic_int_inc (&list->seq);
+  if (g_atomic_int_get (&list->waiters))
+    futex_wake (&list->seq, 1);
+}
+
+/**
+ * Take an index from the list
+ *
+ * @wait  sleep until one is pushed if the list is empty
+ * @return the index, or -1 if the list is empty and @wait is FALSE or the
+ *         list has been closed
+ */
+gint
+gst_bc_freelist_pop (GstBcFreeList * list, gboolean wait)
+{
+  gint old, seq;
+  guint top;
+
+  for (;;) {
+    seq = g_atomic_int_get (&list->seq);
+
+    do {
+      old = g_atomic_int_get (&list->head);
+      top = HEAD_TOP (old);
+      if (top == GST_BC_FREELIST_EMPTY)
+        break;
+    } while (!g_atomic_int_compare_and_exchange (&list->head, old,
+            HEAD (HEAD_TAG (old) + 1, list->next[top])));
+
+    if (top != GST_BC_FREELIST_EMPTY) {
+      g_atomic_int_add (&list->length, -1);
+      return top;
+    }
+
+    if (!wait || g_atomic_int_get (&list->closed))
+      return -1;
+
+    /* a push between reading seq and sleeping changes seq, so the wait
+       returns at once rather than missing it */
+    g_atomic_int_inc (&list->waiters);
+    futex_wait (&list->seq, seq);
+    g_atomic_int_add (&list->waiters, -1);
+  }
+}
+
+/**
+ * Make waiting and future pops of an empty list return -1 instead of
+ * sleeping, for a pool that is shutting down
+ */
+void
+gst_bc_freelist_close (GstBcFreeList * list)
+{
+  g_atomic_int_set (&list->closed, 1);
+  g_atomic_int_inc (&list->seq);
+  futex_wake (&list->seq, INT_MAX);
+}
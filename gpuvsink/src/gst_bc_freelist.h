@@ -0,0 +1,77 @@
+/******************************************************************************
+*****************************************************************************
+ * gst_bc_freelist.h
+ * Lock-free free-list of buffer indices
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+#ifndef __GST_BC_FREELIST_H__
+#define __GST_BC_FREELIST_H__
+
+#include <glib.h>
+#include "../../gpucomp.h"
+
+G_BEGIN_DECLS
+
+#define GST_BC_FREELIST_CAPACITY  MAX_VIDEO_BUFFERS_PER_CHANNEL
+#define GST_BC_FREELIST_EMPTY     0xff
+
+/**
+ * GstBcFreeList:
+ *
+ * Fixed capacity LIFO of buffer indices. Push and pop are a single
+ * compare-and-swap on @head, which packs the index on top of the list in
+ * its low byte and a modification count in the upper bits against ABA.
+ * A thread finding the list empty sleeps on a futex on @seq, which every
+ * push bumps; pushers only enter the kernel while someone is waiting.
+ */
+typedef struct
+{
+  volatile gint head;
+  volatile guint8 next[GST_BC_FREELIST_CAPACITY];
+  volatile gint length;
+  volatile gint seq;
+  volatile gint waiters;
+  volatile gint closed;
+} GstBcFreeList;
+
+void gst_bc_freelist_init (GstBcFreeList * list);
+void gst_bc_freelist_push (GstBcFreeList * list, guint index);
+gint gst_bc_freelist_pop (GstBcFreeList * list, gboolean wait);
+void gst_bc_freelist_close (GstBcFreeList * list);
+
+#define gst_bc_freelist_length(list) g_atomic_int_get (&(list)->length)
+
+G_END_DECLS
+#endif /* __GST_BC_FREELIST_H__ */
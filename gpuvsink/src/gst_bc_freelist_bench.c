@@ -0,0 +1,147 @@
+/******************************************************************************
+*****************************************************************************
+ * gst_bc_freelist_bench.c
+ * Acquire/release throughput of the buffer free-list against GAsyncQueue
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+/*
+ * Build with "make gst_bc_freelist_bench" and run on the target as
+ *
+ *   gst_bc_freelist_bench [threads] [iterations per thread]
+ *
+ * Every thread repeatedly takes a buffer index and gives it back, as the
+ * decoder (buffer_alloc) and the sink (finalize) threads of several
+ * channels do on a shared pool; the list starts full, so neither side
+ * ever has to wait and only the cost of the hand-over is measured.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <glib.h>
+
+#include "gst_bc_freelist.h"
+
+typedef struct
+{
+  GstBcFreeList list;
+  GAsyncQueue *queue;
+  guint iterations;
+} BenchState;
+
+static BenchState state;
+
+static gpointer
+freelist_worker (gpointer data)
+{
+  guint i;
+  gint idx;
+
+  for (i = 0; i < state.iterations; i++) {
+    idx = gst_bc_freelist_pop (&state.list, TRUE);
+    gst_bc_freelist_push (&state.list, idx);
+  }
+  return NULL;
+}
+
+static gpointer
+queue_worker (gpointer data)
+{
+  guint i;
+  gpointer item;
+
+  for (i = 0; i < state.iterations; i++) {
+    item = g_async_queue_pop (state.queue);
+    g_async_queue_push (state.queue, item);
+  }
+  return NULL;
+}
+
+static double
+now_sec (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+run (GThreadFunc worker, guint nthreads)
+{
+  GThread *threads[64];
+  double start;
+  guint i;
+
+  start = now_sec ();
+  for (i = 0; i < nthreads; i++)
+    threads[i] = g_thread_create (worker, NULL, TRUE, NULL);
+  for (i = 0; i < nthreads; i++)
+    g_thread_join (threads[i]);
+
+  return now_sec () - start;
+}
+
+int
+main (int argc, char **argv)
+{
+  guint nthreads = argc > 1 ? atoi (argv[1]) : 4;
+  guint i;
+  double t_list, t_queue, ops;
+
+  state.iterations = argc > 2 ? atoi (argv[2]) : 1000000;
+  nthreads = CLAMP (nthreads, 1, 64);
+
+  g_thread_init (NULL);
+
+  gst_bc_freelist_init (&state.list);
+  state.queue = g_async_queue_new ();
+  for (i = 0; i < GST_BC_FREELIST_CAPACITY; i++) {
+    gst_bc_freelist_push (&state.list, i);
+    g_async_queue_push (state.queue, GUINT_TO_POINTER (i + 1));
+  }
+
+  t_queue = run (queue_worker, nthreads);
+  t_list = run (freelist_worker, nthreads);
+
+  ops = (double) nthreads * state.iterations;
+  printf ("%u threads x %u acquire/release\n", nthreads, state.iterations);
+  printf ("  GAsyncQueue: %8.3f s  %10.0f ops/s\n", t_queue, ops / t_queue);
+  printf ("  free-list  : %8.3f s  %10.0f ops/s  (x%.2f)\n", t_list,
+      ops / t_list, t_queue / t_list);
+
+  g_async_queue_unref (state.queue);
+  return 0;
+}
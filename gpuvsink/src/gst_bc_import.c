@@ -0,0 +1,254 @@
+/******************************************************************************
+*****************************************************************************
+ * gst_bc_import.c
+ * Registration of physically contiguous upstream buffers with the compositor
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <cmem.h>
+
+#include "gst_bc_import.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gpuvsink_debug);
+#define GST_CAT_DEFAULT gpuvsink_debug
+
+/**
+ * Forget all upstream buffers and index mappings, for a new pool
+ */
+void
+gst_bc_import_reset (GstBcImportCache * cache)
+{
+  memset (cache, 0, sizeof (*cache));
+}
+
+/**
+ * Look at upstream buffers again after the zero-copy path was given up on,
+ * on renegotiation. The index mappings, which belong to the pool, stay.
+ */
+void
+gst_bc_import_retry (GstBcImportCache * cache)
+{
+  cache->num_entries = 0;
+  cache->misses = 0;
+  cache->maps_in_row = 0;
+  cache->disabled = FALSE;
+}
+
+/*
+ * Physical address of a buffer, or 0 if it is not one contiguous CMEM
+ * block. CMEM only knows blocks mapped into this process, which is the
+ * case for the buffers of the DMAI based decoders and capture elements.
+ * Every page is looked at, two blocks can be adjacent at their ends only.
+ */
+static unsigned long
+gst_bc_import_phys (gconstpointer data, guint size)
+{
+  unsigned long first, off;
+
+  first = CMEM_getPhys ((void *) data);
+  if (!first || size == 0)
+    return 0;
+
+  off = GST_BC_IMPORT_PAGE_SIZE - (first & (GST_BC_IMPORT_PAGE_SIZE - 1));
+  for (; off < size; off += GST_BC_IMPORT_PAGE_SIZE)
+    if (CMEM_getPhys ((guint8 *) data + off) != first + off)
+      return 0;
+  if (CMEM_getPhys ((guint8 *) data + size - 1) != first + size - 1)
+    return 0;
+
+  return first;
+}
+
+/*
+ * Whether a cached entry still describes the memory at its address: a
+ * buffer freed and allocated again at the same address may be another
+ * block. The ends of the block are checked, a block is contiguous.
+ */
+static gboolean
+gst_bc_import_valid (GstBcImportEntry * e)
+{
+  if (!e->phys)
+    return TRUE;
+
+  return CMEM_getPhys ((void *) e->data) == e->phys &&
+      CMEM_getPhys ((guint8 *) e->data + e->size - 1) ==
+      e->phys + e->size - 1;
+}
+
+/* Whether a compositor index is mapped to @phys */
+static gboolean
+gst_bc_import_mapped (GstBcImportCache * cache, unsigned long phys)
+{
+  guint i;
+
+  for (i = cache->first_slot; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++)
+    if (cache->slot_phys[i] == phys)
+      return TRUE;
+
+  return FALSE;
+}
+
+/**
+ * Physical address of an upstream buffer. An entry found again is only
+ * checked against CMEM when no index is mapped to it, i.e. before it is
+ * (re)mapped: upstream reuses its buffers while the stream runs, and a
+ * new stream comes with new caps, which reset the cache.
+ *
+ * @return the address, or 0 if the buffer has to be copied
+ */
+unsigned long
+gst_bc_import_lookup (GstBcImportCache * cache, gconstpointer data, guint size)
+{
+  GstBcImportEntry *e, *lru = NULL;
+  guint i;
+
+  if (cache->disabled)
+    return 0;
+
+  cache->clock++;
+  for (i = 0; i < cache->num_entries; i++) {
+    e = &cache->entries[i];
+    if (e->data == data && e->size == size) {
+      if (!gst_bc_import_mapped (cache, e->phys) && !gst_bc_import_valid (e)) {
+        GST_LOG ("memory at %p was reallocated", data);
+        break;
+      }
+      e->last_use = cache->clock;
+      return e->phys;
+    }
+    if (!lru || e->last_use < lru->last_use)
+      lru = e;
+  }
+
+  if (i < cache->num_entries)
+    e = &cache->entries[i];
+  else if (cache->num_entries < GST_BC_IMPORT_CACHE_SIZE)
+    e = &cache->entries[cache->num_entries++];
+  else
+    e = lru;
+
+  e->data = data;
+  e->size = size;
+  e->phys = gst_bc_import_phys (data, size);
+  e->last_use = cache->clock;
+
+  if (!e->phys && ++cache->misses >= GST_BC_IMPORT_PROBES &&
+      cache->misses == cache->num_entries) {
+    /* nothing upstream sent so far was contiguous: stop asking CMEM */
+    GST_DEBUG ("upstream buffers are not physically contiguous, copying");
+    cache->disabled = TRUE;
+  }
+
+  return e->phys;
+}
+
+/**
+ * Compositor buffer index to render a physically contiguous frame from
+ *
+ * @buf   the upstream buffer, remembered to tell which indices are busy
+ * @phys  its physical address
+ * @busy  mask of the indices the compositor may still be reading
+ * @map   set to TRUE if the index has to be mapped to @phys first
+ * @return the index, or -1 if all of them are busy
+ */
+gint
+gst_bc_import_slot (GstBcImportCache * cache, GstBuffer * buf,
+    unsigned long phys, guint32 busy, gboolean * map)
+{
+  gint i, slot = -1;
+
+  cache->clock++;
+  *map = FALSE;
+
+  for (i = cache->first_slot; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++) {
+    if (cache->slot_phys[i] == phys) {
+      slot = i;
+      break;
+    }
+  }
+
+  if (slot < 0) {
+    /* once every index has been mapped, a working set that fits would
+       only hit: upstream cycles more buffers than there are indices, and
+       remapping one for every frame costs the compositor more than a copy */
+    if (++cache->maps_in_row >
+        2 * (MAX_VIDEO_BUFFERS_PER_CHANNEL - cache->first_slot)) {
+      GST_DEBUG ("upstream cycles more buffers than indices, copying");
+      cache->disabled = TRUE;
+      return -1;
+    }
+    for (i = cache->first_slot; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++) {
+      if (busy & (1u << i))
+        continue;
+      if (slot < 0 || cache->slot_use[i] < cache->slot_use[slot])
+        slot = i;
+    }
+    if (slot < 0)
+      return -1;
+    cache->slot_phys[slot] = phys;
+    *map = TRUE;
+  } else {
+    cache->maps_in_row = 0;
+  }
+
+  /* slot_buf[] holds no refs: a buffer freed since may have been allocated
+     again as this one, and must not mark its old index as busy */
+  for (i = cache->first_slot; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++)
+    if (cache->slot_buf[i] == buf)
+      cache->slot_buf[i] = NULL;
+
+  cache->slot_buf[slot] = buf;
+  cache->slot_use[slot] = cache->clock;
+  return slot;
+}
+
+/**
+ * Index an imported buffer was last rendered from, or -1 if it is not one
+ */
+gint
+gst_bc_import_find (GstBcImportCache * cache, GstBuffer * buf)
+{
+  gint i;
+
+  for (i = cache->first_slot; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++)
+    if (cache->slot_buf[i] == buf)
+      return i;
+
+  return -1;
+}
@@ -0,0 +1,105 @@
+/******************************************************************************
+*****************************************************************************
+ * gst_bc_import.h
+ * Registration of physically contiguous upstream buffers with the compositor
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+#ifndef __GST_BC_IMPORT_H__
+#define __GST_BC_IMPORT_H__
+
+#include <gst/gst.h>
+#include "../../gpucomp.h"
+
+G_BEGIN_DECLS
+
+/* upstream memory areas remembered; decoders cycle through more buffers
+   than the compositor has indices for a channel */
+#define GST_BC_IMPORT_CACHE_SIZE  64
+
+/* distinct buffers looked up in vain before the stream is given up on */
+#define GST_BC_IMPORT_PROBES      4
+
+/* granularity CMEM maps blocks at */
+#define GST_BC_IMPORT_PAGE_SIZE   4096
+
+typedef struct
+{
+  gconstpointer data;           /* upstream buffer memory */
+  guint size;
+  unsigned long phys;           /* 0 if not physically contiguous */
+  guint64 last_use;
+} GstBcImportEntry;
+
+/**
+ * GstBcImportCache:
+ *
+ * Per channel state of the zero-copy path. @entries caches the physical
+ * address of upstream buffers by their virtual one, so that the CMEM lookup
+ * is done once per buffer rather than once per frame; the least recently
+ * used entry makes room for a new one, and an entry found again is checked
+ * against CMEM before an index is mapped to it, in case the memory was
+ * freed and allocated again. @slot_phys is the address each compositor
+ * buffer index was last mapped to; an index is reused for
+ * another address least recently used first, and only when none of the
+ * frames held for the SGX is on it (see gst_bc_import_slot()).
+ */
+typedef struct
+{
+  GstBcImportEntry entries[GST_BC_IMPORT_CACHE_SIZE];
+  guint num_entries;
+  guint misses;                 /* lookups that found no contiguous memory */
+  gboolean disabled;            /* upstream buffers are not CMEM backed,
+                                   until the caps are set again */
+
+  guint first_slot;             /* indices below belong to the pool, set
+                                   once it has reserved the others */
+  unsigned long slot_phys[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+  gconstpointer slot_buf[MAX_VIDEO_BUFFERS_PER_CHANNEL];  /* not a ref */
+  guint64 slot_use[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+  guint maps_in_row;            /* frames in a row that needed a map */
+
+  guint64 clock;
+} GstBcImportCache;
+
+void gst_bc_import_reset (GstBcImportCache * cache);
+void gst_bc_import_retry (GstBcImportCache * cache);
+unsigned long gst_bc_import_lookup (GstBcImportCache * cache,
+    gconstpointer data, guint size);
+gint gst_bc_import_slot (GstBcImportCache * cache, GstBuffer * buf,
+    unsigned long phys, guint32 busy, gboolean * map);
+gint gst_bc_import_find (GstBcImportCache * cache, GstBuffer * buf);
+
+G_END_DECLS
+#endif /* __GST_BC_IMPORT_H__ */
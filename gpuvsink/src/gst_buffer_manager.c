@@ -58,6 +58,7 @@
 #include <unistd.h>
 
 #include "gst_render_bridge.h"
+#include "gst_comp_link.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -79,6 +80,8 @@ static CMEM_AllocParams cmem_params = { CMEM_POOL, CMEM_CACHED, 4096 };
  */
 static GstBufferClass *buffer_parent_class = NULL;
 
+static void gst_buffer_manager_drain (GstBufferClassBufferPool * pool);
+
 
 
 static void
@@ -89,25 +92,26 @@ gst_bcbuffer_finalize (GstBufferClassBuffer * buffer)
 
   GST_LOG_OBJECT (pool->elem, "finalizing buffer %p %d", buffer, buffer->index);
 
-
-  GST_BCBUFFERPOOL_LOCK (pool);
-  if (pool->running) {
+  /* No pool lock here: this runs for every frame on the compositor status
+     thread and upstream, and the free-list is safe to push to without it.
+     A buffer of a chunk being dropped is never in use (see shrink). */
+  if (g_atomic_int_get (&pool->running) && buffer->index >= 0) {
+    GST_LOG_OBJECT (pool->elem, "reviving buffer %p, %d", buffer,
+        buffer->index);
     GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_READONLY);
-    g_async_queue_push (pool->avail_buffers, buffer);
+    gst_buffer_ref (GST_BUFFER (buffer));
+    g_atomic_int_add (&pool->outstanding, -1);
+    gst_bc_freelist_push (&pool->avail_buffers, buffer->index);
     resuscitated = TRUE;
+
+    /* dispose may have drained the list between the check and the push */
+    if (!g_atomic_int_get (&pool->running))
+      gst_buffer_manager_drain (pool);
   } else {
     GST_LOG_OBJECT (pool->elem, "the pool is shutting down");
     resuscitated = FALSE;
   }
 
-  if (resuscitated) {
-    GST_LOG_OBJECT (pool->elem, "reviving buffer %p, %d", buffer,
-        buffer->index);
-    gst_buffer_ref (GST_BUFFER (buffer));
-  }
-
-  GST_BCBUFFERPOOL_UNLOCK (pool);
-
   if (!resuscitated) {
     GST_LOG_OBJECT (pool->elem, "buffer %p not recovered, unmapping", buffer);
     gst_mini_object_unref (GST_MINI_OBJECT (pool));
@@ -185,17 +189,32 @@ fail:
 static GstMiniObjectClass *buffer_pool_parent_class = NULL;
 
 
+static void
+gst_buffer_manager_free_chunk (GstBufferClassChunk * chunk)
+{
+  if (chunk->dmabuf_fd >= 0)
+    close (chunk->dmabuf_fd);
+  chunk->dmabuf_fd = -1;
+
+  if (chunk->va) {
+    CMEM_free (chunk->va, &cmem_params);
+    DEBUG_PRINTF ((" Freeing Video Memory - CMEM allocated \n"));
+    chunk->va = NULL;
+  }
+}
+
+
 static void
 gst_buffer_manager_finalize (GstBufferClassBufferPool * pool)
 {
+  /* every buffer holds a reference on the pool, so none of them is in use
+     by upstream or the compositor any more */
+  while (pool->num_chunks > 0)
+    gst_buffer_manager_free_chunk (&pool->chunks[--pool->num_chunks]);
+
   g_mutex_free (pool->lock);
   pool->lock = NULL;
 
-  if (pool->avail_buffers) {
-    g_async_queue_unref (pool->avail_buffers);
-    pool->avail_buffers = NULL;
-  }
-
   if (pool->buffers) {
     g_free (pool->buffers);
     pool->buffers = NULL;
@@ -214,6 +233,7 @@ gst_buffer_manager_init (GstBufferClassBufferPool * pool, gpointer g_class)
 {
   pool->lock = g_mutex_new ();
   pool->running = FALSE;
+  gst_bc_freelist_init (&pool->avail_buffers);
 }
 
 
@@ -253,55 +273,235 @@ gst_buffer_manager_get_type (void)
   return _gst_buffer_manager_type;
 }
 
+/*
+ * Allocate a chunk of count buffers behind the last one and enter them in the
+ * pool and in its compositor configuration. Called with the pool lock held.
+ */
+static gboolean
+gst_buffer_manager_add_chunk (GstBufferClassBufferPool * pool, guint count)
+{
+  GstBufferClassChunk *chunk = &pool->chunks[pool->num_chunks];
+  CMEM_AllocParams params = cmem_params;
+  guint i;
+
+  chunk->first = pool->num_buffers;
+  chunk->count = count;
+  chunk->dmabuf_fd = -1;
+
+  /* The buffers are allocated from CMEM as the gpu composition requires contiguous memory */
+  params.flags = pool->cached ? CMEM_CACHED : CMEM_NONCACHED;
+  chunk->va = CMEM_alloc((pool->buf_size*count), &params);
+  if (!chunk->va)
+  {
+    printf ("CMEM_alloc for Video Stream buffer returned NULL \n");
+    return FALSE;
+  }
+  chunk->pa = CMEM_getPhys(chunk->va);
+
+#ifdef HAVE_CMEM_DMABUF
+  /* Share the block with the compositor as a dma-buf rather than by its
+     physical address; all the chunks of a pool are shared the same way */
+  if (pool->num_chunks == 0 || pool->chunks[0].dmabuf_fd >= 0) {
+    chunk->dmabuf_fd = CMEM_export_dmabuf (chunk->va);
+    if (chunk->dmabuf_fd < 0 && pool->num_chunks > 0) {
+      GST_WARNING_OBJECT (pool->elem, "dma-buf export failed, not growing");
+      gst_buffer_manager_free_chunk (chunk);
+      return FALSE;
+    }
+    if (chunk->dmabuf_fd < 0)
+      GST_WARNING_OBJECT (pool->elem, "dma-buf export failed, passing physical addresses");
+  }
+#endif
+
+  /* Divide the chunk into buffers */
+  for (i = 0; i < count; i++)
+  {
+    guint idx = chunk->first + i;
+    GstBufferClassBuffer *buf;
+
+    if (chunk->dmabuf_fd >= 0) {
+      pool->config.in.phyaddr[idx] = 0;
+      pool->config.in.offset[idx] = pool->buf_size*i;
+    } else {
+      pool->config.in.phyaddr[idx] = chunk->pa + (pool->buf_size*i);
+      pool->config.in.offset[idx] = 0;
+    }
+    DEBUG_PRINTF ((" TextureBufAddr %d: %lx\n", idx, chunk->pa + (pool->buf_size*i)));
+
+    /* mini objects are allocated with g_malloc, this cannot fail */
+    buf = gst_bcbuffer_new (pool, idx, pool->buf_size, pool->config.in.phyaddr[idx]);
+    GST_BUFFER_DATA (buf) = ((guint8 *) chunk->va + pool->buf_size*i);
+    gst_buffer_set_caps (GST_BUFFER (buf), pool->caps);
+    pool->buffers[idx] = buf;
+  }
+
+  pool->num_chunks++;
+  pool->num_buffers += count;
+
+  for (i = 0; i < count; i++)
+    gst_bc_freelist_push (&pool->avail_buffers, chunk->first + i);
+
+  return TRUE;
+}
+
+/*
+ * The chunk buffer idx lives in; indices the pool does not have point at
+ * the first buffer, in the first chunk
+ */
+static GstBufferClassChunk *
+gst_buffer_manager_chunk_of (GstBufferClassBufferPool * pool, guint idx)
+{
+  guint c;
+
+  for (c = pool->num_chunks; c-- > 1;)
+    if (idx >= pool->chunks[c].first && idx < pool->num_buffers)
+      return &pool->chunks[c];
+  return &pool->chunks[0];
+}
+
+/*
+ * Point index idx of the compositor configuration at the first buffer, for
+ * an index the pool does not have (any more). Called with the pool lock held.
+ */
+static void
+gst_buffer_manager_unmap_index (GstBufferClassBufferPool * pool, guint idx)
+{
+  pool->config.in.phyaddr[idx] = pool->config.in.phyaddr[0];
+  pool->config.in.offset[idx] = pool->config.in.offset[0];
+}
+
+/*
+ * Send the pool configuration to the compositor, with the dma-buf of every
+ * buffer index when the pool shares its chunks that way
+ */
+static void
+gst_buffer_manager_announce (GstBufferClassBufferPool * pool, int msg)
+{
+  GstBufferClassSink *gpuvsink = GST_BCSINK (pool->elem);
+  int fds[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+  int nfds = 0;
+  guint i;
+
+  if (pool->chunks[0].dmabuf_fd >= 0)
+    for (i = 0; i < (guint) pool->config.in.count; i++)
+      fds[nfds++] = gst_buffer_manager_chunk_of (pool, i)->dmabuf_fd;
+
+  pool->config.config_data = msg;
+  if (!gst_comp_link_send (gpuvsink->fd_video_cfg, &pool->config, fds, nfds))
+  {
+    printf("Error in sending the config to channel %d \n", gpuvsink->channel_no);
+  }
+
+  DEBUG_PRINTF ((" sending the config to channel %d is successful\n", gpuvsink->channel_no));
+}
+
+/*
+ * Tell the compositor where buffer index idx lives now. Unlike a
+ * reconfiguration this keeps the channel as it is, the compositor only
+ * registers the new address. Called with the pool lock held.
+ */
+static void
+gst_buffer_manager_map (GstBufferClassBufferPool * pool, guint idx)
+{
+  GstBufferClassSink *gpuvsink = GST_BCSINK (pool->elem);
+  GstBufferClassChunk *chunk = gst_buffer_manager_chunk_of (pool, idx);
+  videoConfig_s cfg = pool->config;
+
+  cfg.config_data = VID_MSG_MAP;
+  cfg.buf_index = idx;
+  if (!gst_comp_link_send (gpuvsink->fd_video_cfg, &cfg,
+          chunk->dmabuf_fd >= 0 ? &chunk->dmabuf_fd : NULL,
+          chunk->dmabuf_fd >= 0 ? 1 : 0))
+  {
+    printf("Error in mapping buffer %d of channel %d \n", idx, gpuvsink->channel_no);
+  }
+}
+
 /*
  * Construct new bufferpool and allocate buffers from driver
  *
  * @elem      the parent element that owns this buffer
- * @fd        the file descriptor of the device file
- * @count     the requested number of buffers in the pool
- * @caps      the requested buffer caps
+ * @videoConfig the display configuration of the channel
+ * @count     the number of buffers to start with
+ * @max_count the number of buffers the pool may grow to
+ * @caps      the requested buffer caps, with a "rowstride" field if the
+ *            lines are padded
+ * @min_size  the buffer size upstream allocates, 0 if unknown; with a
+ *            rowstride, more than the frame takes means extra lines after
+ *            the picture, otherwise room at the end of the buffer
+ * @cached    allocate CPU cached memory, for frames written by the CPU
+ *            rather than by a DMA engine
  * @return the bufferpool or <code>NULL</code> if error
  */
 GstBufferClassBufferPool *
-gst_buffer_manager_new (GstElement * elem, videoConfig_s videoConfig, int count, GstCaps * caps)
+gst_buffer_manager_new (GstElement * elem, videoConfig_s videoConfig, int count, int max_count, GstCaps * caps, guint min_size, gboolean cached)
 {
   GstBufferClassBufferPool *pool = NULL;
   GstVideoFormat format;
-  gint width, height;
-  unsigned long vidStreamBufPa;
-  void *vidStreamBufVa;
-  int n, i;
+  gint width, height, rowstride = 0, rows;
+  guint buf_size;
+  int c;
+  GstFrameLayout layout;
 
   GstBufferClassSink *gpuvsink = GST_BCSINK (elem);
 
   if (gst_video_format_parse_caps(caps, &format, &width, &height)) {
 
-  /* The buffers are allocated from CMEM as the gpu composition requires contiguous memory */
-  CMEM_init();
+  /* Size and plane layout of one frame as GStreamer lays it out, so that
+     planar 4:2:0 formats take 12 bits per pixel instead of 16 */
+  if (!gst_frame_layout_init (&layout, format, width, height)) {
+    GST_WARNING_OBJECT (elem, "unsupported format in caps: %" GST_PTR_FORMAT, caps);
+    return NULL;
+  }
 
-  /* Allocate single block of contiguous memory for all the buffers */
-  vidStreamBufVa = CMEM_alloc((width*height*BPP*count), &cmem_params);
-  if (!vidStreamBufVa)
-  {
-    printf ("CMEM_alloc for Video Stream buffer returned NULL \n");
-    return NULL; 
+  /* Decoders working on aligned blocks ask for padded lines through the
+     caps and for extra lines through a larger buffer size: lay the pool
+     out the same way so that they decode straight into it. Without a
+     rowstride a larger size does not tell where the planes are, it only
+     makes the buffers larger. */
+  gst_structure_get_int (gst_caps_get_structure (caps, 0), "rowstride", &rowstride);
+  rows = height;
+  if (rowstride > 0 && !gst_frame_layout_pad (&layout, format, rowstride, rows)) {
+    GST_WARNING_OBJECT (elem, "unusable rowstride %d in caps: %" GST_PTR_FORMAT,
+        rowstride, caps);
+    return NULL;
+  }
+  while (rowstride > 0 && layout.size < min_size && rows < 2 * height) {
+    rows += 2;
+    gst_frame_layout_pad (&layout, format, rowstride, rows);
   }
+  if (rows > height || rowstride > 0)
+    GST_DEBUG_OBJECT (elem, "padded frames: stride %d, %d lines, %d bytes",
+        layout.stride[0], rows, (int) layout.size);
 
-  vidStreamBufPa = CMEM_getPhys(vidStreamBufVa);
- 
-  DEBUG_PRINTF((" Number of texture buffers: %d\n", count)); 
+  /* upstream writes as much as it allocated */
+  buf_size = MAX ((guint) layout.size, min_size);
+
+  videoConfig.in.num_planes = layout.n_planes;
+
+  for (c = 0; c < VID_MAX_COMPONENTS; c++) {
+    if (videoConfig.in.num_planes == 1 && c > 0) {
+      videoConfig.in.plane_offset[c] = 0;
+      videoConfig.in.plane_stride[c] = 0;
+      continue;
+    }
+    /* NV12: V is the byte after U in the interleaved plane */
+    if (format == GST_VIDEO_FORMAT_NV12 && c == 2) {
+      videoConfig.in.plane_offset[c] = layout.offset[1] + 1;
+      videoConfig.in.plane_stride[c] = layout.stride[1];
+      continue;
+    }
+    videoConfig.in.plane_offset[c] = layout.offset[c];
+    videoConfig.in.plane_stride[c] = layout.stride[c];
+  }
+
+  DEBUG_PRINTF((" Number of texture buffers: %d (up to %d)\n", count, max_count)); 
   DEBUG_PRINTF((" Video Frame Width: %d\n", width));
   DEBUG_PRINTF((" Video Frame Height: %d\n", height));
+  DEBUG_PRINTF((" Video Frame Size: %d, planes: %d\n", (int) layout.size, videoConfig.in.num_planes));
 
-  /* Divide the single block of contiguous memory into the requested number of buffers */
-  for (i = 0; i < count; i++)
-  {
-    videoConfig.in.phyaddr[i] = vidStreamBufPa + (width*height*BPP*i); 
-    DEBUG_PRINTF ((" TextureBufAddr %d: %lx\n", i, videoConfig.in.phyaddr[i]));
-  }
   videoConfig.enable = 1;
-  videoConfig.config_data = 1;
-  videoConfig.in.count   = count;
+  videoConfig.in.buf_size = buf_size;
   videoConfig.in.height  = height;
   videoConfig.in.width   = width;
    
@@ -322,29 +522,8 @@ gst_buffer_manager_new (GstElement * elem, videoConfig_s videoConfig, int count,
   else
   videoConfig.in.fourcc  = gst_video_format_to_fourcc (format);
 
-  /* Send the video configuration via named pipe to the composition module */
-  gpuvsink->video_config_fifo[strlen(gpuvsink->video_config_fifo)-1] = '0' +  gpuvsink->channel_no;
-
-  DEBUG_PRINTF ((" gst_buffer_manager_new: video buffers allocation successfull for channel_no: %d \n",  gpuvsink->channel_no));
-  DEBUG_PRINTF ((" Opening the video config fifo - %s\n", gpuvsink->video_config_fifo));
-
-  gpuvsink->fd_video_cfg = open(gpuvsink->video_config_fifo, O_WRONLY);
-  if(gpuvsink->fd_video_cfg < 0)
-  {
-    printf (" Failed to open fd_video_cfg FIFO - fd: %d\n", gpuvsink->fd_video_cfg);
-    exit(0);
-  }
-
-  DEBUG_PRINTF ((" writing to the config fifo - %s \n", gpuvsink->video_config_fifo));
-
-  n = write(gpuvsink->fd_video_cfg, &videoConfig, sizeof(videoConfig));
-
-  if(n != sizeof(videoConfig))
-  {
-    printf("Error in writing to named pipe: %s \n", VIDEO_CONFIG_AND_DATA_FIFO_NAME);
-  }
-
-  DEBUG_PRINTF ((" writing to the config fifo - %s is successful\n", gpuvsink->video_config_fifo));
+  /* CMEM_init is reference counted, the pool never calls CMEM_exit */
+  CMEM_init();
 
   /* construct bufferpool */
   pool = (GstBufferClassBufferPool *)
@@ -353,37 +532,53 @@ gst_buffer_manager_new (GstElement * elem, videoConfig_s videoConfig, int count,
   //TODO: Remove fd from pool -not required any more.
    pool->fd = -1;
    pool->elem = elem;
-   pool->num_buffers = count;
-   pool->vidStreamBufVa = vidStreamBufVa;
-
+   pool->num_buffers = 0;
+   pool->import_first = 0;
+   pool->min_buffers = count;
+   pool->max_buffers = MIN (max_count, MAX_VIDEO_BUFFERS_PER_CHANNEL);
+   pool->buf_size = buf_size;
+   pool->cached = cached;
+   pool->config = videoConfig;
+   pool->format = format;
+   pool->width = width;
+   pool->height = height;
+   pool->layout = layout;
 
    GST_DEBUG_OBJECT (pool->elem, "orig caps: %" GST_PTR_FORMAT, caps);
-   GST_DEBUG_OBJECT (pool->elem, "requested %d buffers, got %d buffers", count,
-        count);
     
     pool->caps = gst_caps_ref(caps);
 
     /* and allocate buffers:
      */
-    pool->buffers = g_new0 (GstBufferClassBuffer *, count);
-    pool->avail_buffers = g_async_queue_new_full (
-        (GDestroyNotify) gst_mini_object_unref);
-
-    for (i = 0; i < count; i++) {
-     // TODO: Find correct size here
-	GstBufferClassBuffer *buf = gst_bcbuffer_new (pool, i, width*height*BPP, videoConfig.in.phyaddr[i]);
-	GST_BUFFER_DATA (buf) = (vidStreamBufVa +  width*height*BPP*i);
-	GST_BUFFER_SIZE (buf) = width*height*BPP;
-
-      if (G_UNLIKELY (!buf)) {
-        GST_WARNING_OBJECT (pool->elem, "Buffer %d allocation failed", i);
-        goto fail;
-      }
-      gst_buffer_set_caps (GST_BUFFER (buf), caps);
-      pool->buffers[i] = buf;
-      g_async_queue_push (pool->avail_buffers, buf);
+    pool->buffers = g_new0 (GstBufferClassBuffer *, pool->max_buffers);
+
+    if (!gst_buffer_manager_add_chunk (pool, count))
+      goto fail;
+
+    /* The compositor is set up for as many buffers as the pool may grow
+       to, so that growing and shrinking only map indices (see
+       gst_buffer_manager_map); the ones not allocated yet show the first
+       buffer */
+    pool->config.in.count = pool->max_buffers;
+    for (c = pool->num_buffers; c < (int) pool->max_buffers; c++)
+      gst_buffer_manager_unmap_index (pool, c);
+
+    GST_DEBUG_OBJECT (pool->elem, "requested %d buffers, got %d buffers", count,
+        pool->num_buffers);
+
+    /* Send the video configuration over the control socket to the composition module */
+    DEBUG_PRINTF ((" gst_buffer_manager_new: video buffers allocation successfull for channel_no: %d \n",  gpuvsink->channel_no));
+
+    if (gpuvsink->pool == NULL)
+    {
+      gst_buffer_manager_announce (pool, VID_MSG_CONFIG);
+    } else {
+      /* a running channel is switched over to the new buffers in place */
+      gst_buffer_manager_announce (pool, VID_MSG_RECONFIG);
     }
 
+    g_atomic_int_set (&pool->running, TRUE);
+
     return pool;
   } else {
     GST_WARNING_OBJECT (elem, "failed to parse caps: %" GST_PTR_FORMAT, caps);
@@ -398,45 +593,157 @@ fail:
 
 /**
  * Stop and dispose of this pool object.
+ *
+ * Buffers still held by upstream or by the render hold chain stay valid;
+ * the memory is released with the last of them (see finalize).
  */
 void
 gst_buffer_manager_dispose (GstBufferClassBufferPool * pool)
 {
-  int n;
-  GstBufferClassBuffer *buf;
-  GstBufferClassSink *gpuvsink = GST_BCSINK (pool->elem);
   g_return_if_fail (pool);
 
-  pool->running = FALSE;
+  GST_BCBUFFERPOOL_LOCK (pool);
+  g_atomic_int_set (&pool->running, FALSE);
+  GST_BCBUFFERPOOL_UNLOCK (pool);
 
-  while ((buf = g_async_queue_try_pop (pool->avail_buffers)) != NULL) {
-    gst_buffer_unref (GST_BUFFER (buf));
-  }
+  /* wake up a buffer_alloc waiting for the compositor */
+  gst_bc_freelist_close (&pool->avail_buffers);
+  gst_buffer_manager_drain (pool);
 
   gst_mini_object_unref (GST_MINI_OBJECT (pool));
- 
-  if (pool->vidStreamBufVa) {
-      CMEM_free (pool->vidStreamBufVa, &cmem_params); 
-      DEBUG_PRINTF ((" Freeing Video Memory - CMEM allocated \n"));
-      pool->vidStreamBufVa = NULL;
-
-      gpuvsink->videoConfig.config_data = 2;
-      n = write(gpuvsink->fd_video_cfg, &gpuvsink->videoConfig, sizeof(gpuvsink->videoConfig));
-
-      if(n != sizeof(gpuvsink->videoConfig))
-      {
-          printf("Error in writing to named pipe: %s \n", VIDEO_CONFIG_AND_DATA_FIFO_NAME);
-      }
-      DEBUG_PRINTF ((" sending close command to the config fifo - %s is successful\n", gpuvsink->video_config_fifo));
-
-      usleep (50000);
-      close(gpuvsink->fd_video_cfg);
-      usleep (100000); 
-  }
 
   GST_DEBUG ("end");
 }
 
+/*
+ * Release the idle buffers of a stopped pool; with running FALSE they are
+ * finalized rather than revived.
+ */
+static void
+gst_buffer_manager_drain (GstBufferClassBufferPool * pool)
+{
+  gint idx;
+
+  while ((idx = gst_bc_freelist_pop (&pool->avail_buffers, FALSE)) >= 0)
+    gst_buffer_unref (GST_BUFFER (pool->buffers[idx]));
+}
+
+/*
+ * Drop the last chunk if all of its buffers are idle in the queue. Its
+ * indices are mapped back to the first buffer before the memory goes away.
+ */
+static void
+gst_buffer_manager_shrink (GstBufferClassBufferPool * pool)
+{
+  GstBufferClassBuffer *bufs[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+  GstBufferClassBuffer *retired[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+  GstBufferClassChunk *chunk, old;
+  gint idx;
+  guint i, n = 0, nretired = 0;
+
+  memset (&old, 0, sizeof (old));
+  old.dmabuf_fd = -1;
+
+  GST_BCBUFFERPOOL_LOCK (pool);
+  if (pool->num_chunks < 2 || !pool->running || pool->import_first) {
+    GST_BCBUFFERPOOL_UNLOCK (pool);
+    return;
+  }
+  chunk = &pool->chunks[pool->num_chunks - 1];
+
+  /* Buffers are pushed back concurrently without the pool lock, so a chunk
+     is only dropped when every one of its buffers was taken off the list
+     here; none of them can then be in use. A get() finding the list empty
+     meanwhile checks it again under the lock before growing. */
+  while ((idx = gst_bc_freelist_pop (&pool->avail_buffers, FALSE)) >= 0)
+    bufs[n++] = pool->buffers[idx];
+  for (i = 0; i < n; i++)
+    if ((guint) bufs[i]->index >= chunk->first)
+      nretired++;
+  if (nretired == chunk->count) {
+    nretired = 0;
+    for (i = 0; i < n; i++) {
+      if ((guint) bufs[i]->index >= chunk->first)
+        retired[nretired++] = bufs[i];
+      else
+        gst_bc_freelist_push (&pool->avail_buffers, bufs[i]->index);
+    }
+  } else {
+    nretired = 0;
+    for (i = 0; i < n; i++)
+      gst_bc_freelist_push (&pool->avail_buffers, bufs[i]->index);
+  }
+
+  if (nretired) {
+    pool->num_buffers = chunk->first;
+    for (i = 0; i < nretired; i++) {
+      pool->buffers[retired[i]->index] = NULL;
+      gst_buffer_manager_unmap_index (pool, retired[i]->index);
+      gst_buffer_manager_map (pool, retired[i]->index);
+      retired[i]->index = -1;
+    }
+    old = *chunk;
+    chunk->va = NULL;
+    chunk->dmabuf_fd = -1;
+    pool->num_chunks--;
+    GST_DEBUG_OBJECT (pool->elem, "pool shrunk to %d buffers", pool->num_buffers);
+  }
+  GST_BCBUFFERPOOL_UNLOCK (pool);
+
+  if (nretired) {
+    /* retired buffers (index -1) are not revived */
+    for (i = 0; i < nretired; i++)
+      gst_buffer_unref (GST_BUFFER (retired[i]));
+    gst_buffer_manager_free_chunk (&old);
+  }
+}
+
+/**
+ * Hand the buffer indices the pool does not use over to frames imported
+ * from upstream: the pool stops growing and shrinking, and the channel is
+ * extended to MAX_VIDEO_BUFFERS_PER_CHANNEL buffers, the new ones pointing
+ * at the first pool buffer until they are mapped (VID_MSG_MAP).
+ *
+ * @pool      the "this" object
+ * @min_free  the least number of indices that makes importing worthwhile
+ * @return TRUE if pool->import_first.. MAX_VIDEO_BUFFERS_PER_CHANNEL-1 are
+ *         free for imports
+ */
+gboolean
+gst_buffer_manager_reserve (GstBufferClassBufferPool * pool, guint min_free)
+{
+  guint i;
+
+  GST_BCBUFFERPOOL_LOCK (pool);
+  if (pool->import_first) {
+    GST_BCBUFFERPOOL_UNLOCK (pool);
+    return TRUE;
+  }
+
+  /* imported frames are registered by physical address, which cannot be
+     mixed with dma-buf shared chunks in one configuration */
+  if (!g_atomic_int_get (&pool->running) ||
+      pool->num_buffers + min_free > MAX_VIDEO_BUFFERS_PER_CHANNEL ||
+      pool->chunks[0].dmabuf_fd >= 0) {
+    GST_BCBUFFERPOOL_UNLOCK (pool);
+    return FALSE;
+  }
+
+  pool->import_first = pool->num_buffers;
+  pool->max_buffers = pool->num_buffers;
+  for (i = pool->num_buffers; i < MAX_VIDEO_BUFFERS_PER_CHANNEL; i++) {
+    pool->config.in.phyaddr[i] = pool->config.in.phyaddr[0];
+    pool->config.in.offset[i] = 0;
+  }
+  pool->config.in.count = MAX_VIDEO_BUFFERS_PER_CHANNEL;
+  gst_buffer_manager_announce (pool, VID_MSG_RECONFIG);
+  GST_DEBUG_OBJECT (pool->elem, "indices %d.. reserved for imported frames",
+      pool->import_first);
+  GST_BCBUFFERPOOL_UNLOCK (pool);
+
+  return TRUE;
+}
+
 /**
  * Get the current caps of the pool, they should be unref'd when done
  *
@@ -456,36 +763,85 @@ gst_buffer_manager_get_caps (GstBufferClassBufferPool * pool)
 GstBufferClassBuffer *
 gst_buffer_manager_get (GstBufferClassBufferPool * pool)
 {
-  GstBufferClassBuffer *buf = g_async_queue_pop (pool->avail_buffers);
+  gint idx = gst_bc_freelist_pop (&pool->avail_buffers, FALSE);
+  GstBufferClassBuffer *buf;
+  guint outstanding, first, i;
+  gboolean shrink = FALSE;
+
+  if (idx < 0) {
+    /* rather than waiting for the compositor, add buffers while allowed;
+       the list may only look empty while shrink() is sorting it */
+    GST_BCBUFFERPOOL_LOCK (pool);
+    idx = gst_bc_freelist_pop (&pool->avail_buffers, FALSE);
+    first = pool->num_buffers;
+    if (idx < 0 && g_atomic_int_get (&pool->running) &&
+        pool->num_buffers < pool->max_buffers &&
+        gst_buffer_manager_add_chunk (pool,
+            MIN (GST_BC_GROW_STEP, pool->max_buffers - pool->num_buffers))) {
+      for (i = first; i < pool->num_buffers; i++)
+        gst_buffer_manager_map (pool, i);
+      GST_DEBUG_OBJECT (pool->elem, "pool grown to %d buffers", pool->num_buffers);
+    }
+    GST_BCBUFFERPOOL_UNLOCK (pool);
+
+    if (idx < 0)
+      idx = gst_bc_freelist_pop (&pool->avail_buffers, FALSE);
+    if (idx < 0) {
+      /* at the maximum: wait for the compositor to give one back */
+      GstBufferClassSink *gpuvsink = GST_BCSINK (pool->elem);
 
-  if (buf) {
-    GST_BUFFER_FLAG_UNSET (buf, 0xffffffff);
+      GST_OBJECT_LOCK (gpuvsink);
+      gpuvsink->pool_empty_waits++;
+      GST_OBJECT_UNLOCK (gpuvsink);
+
+      idx = gst_bc_freelist_pop (&pool->avail_buffers, TRUE);
+      if (idx < 0)
+        return NULL;            /* the pool was disposed of meanwhile */
+    }
   }
 
-  pool->running = TRUE;
+  buf = pool->buffers[idx];
+  GST_BUFFER_FLAG_UNSET (buf, 0xffffffff);
+  outstanding = g_atomic_int_exchange_and_add (&pool->outstanding, 1) + 1;
+
+  GST_BCBUFFERPOOL_LOCK (pool);
+  pool->high_water = MAX (pool->high_water, outstanding);
+  pool->window_high = MAX (pool->window_high, outstanding);
+  if (++pool->window_requests >= GST_BC_SHRINK_PERIOD) {
+    /* low demand: the whole period fitted without the last chunk */
+    shrink = (pool->num_chunks > 1 &&
+        pool->window_high < pool->chunks[pool->num_chunks - 1].first);
+    pool->window_high = 0;
+    pool->window_requests = 0;
+  }
+  GST_BCBUFFERPOOL_UNLOCK (pool);
+
+  if (shrink)
+    gst_buffer_manager_shrink (pool);
 
   return buf;
 }
 
 /**
  * cause buffer to be flushed before rendering
+ *
+ * Writes the CPU cache back for the lines of picture of every plane, so
+ * that the GPU does not read stale memory; the padding after the last line
+ * of a plane and the extra lines are left alone. Uncached buffers need
+ * nothing.
  */
 void
 gst_bcbuffer_flush (GstBufferClassBuffer * buffer)
 {
-//  GstBufferClassBufferPool *pool = buffer->pool;
-
-// DEBUG_PRINTF ((" gst_bcbuffer_flush not implemented \n"));
-  
-#if 0
-  BCIO_package param;
+  GstBufferClassBufferPool *pool = buffer->pool;
+  const GstFrameLayout *layout = &pool->layout;
+  gint p;
 
-  param.input = buffer->index;
+  if (!pool->cached)
+    return;
 
-  if (ioctl (pool->fd, BCIO_FLUSH, &param) < 0) {
-    GST_WARNING_OBJECT (pool->elem, "Failed BCIO_FLUSH: %s",
-        g_strerror (errno));
-  }
-#endif
+  for (p = 0; p < layout->n_planes; p++)
+    CMEM_cacheWb (GST_BUFFER_DATA (buffer) + layout->offset[p],
+        (layout->lines[p] - 1) * layout->stride[p] + layout->line_bytes[p]);
 }
 
@@ -44,6 +44,8 @@
 
 #include <gst/gst.h>
 #include "../gpucomp.h"
+#include "gst_frame_copy.h"
+#include "gst_bc_freelist.h"
 
 G_BEGIN_DECLS
 
@@ -103,6 +105,17 @@ void gst_bcbuffer_flush (GstBufferClassBuffer * buffer);
 
 
 
+/* One CMEM block holding a run of consecutive pool buffers. The pool starts
+ * with one chunk and grows/shrinks by adding/dropping the last one. */
+typedef struct
+{
+  void *va;
+  unsigned long pa;
+  int dmabuf_fd;                /* -1 if shared by physical address */
+  guint first;                  /* index of the first buffer in the chunk */
+  guint count;
+} GstBufferClassChunk;
+
 /**
  * GstBufferClassBuffer:
  *
@@ -116,12 +129,31 @@ struct _GstBufferClassBufferPool
   GstElement *elem;
   GstCaps *caps;
   GMutex *lock;
-  gboolean running;
+  volatile gint running;        /* read without the lock, see finalize */
   int fd;
-  guint32 num_buffers;
+  guint32 num_buffers;          /* buffers currently in the pool */
+  guint32 min_buffers;          /* never shrink below the initial size */
+  guint32 max_buffers;          /* never grow beyond queue-size */
+  volatile gint outstanding;    /* buffers handed out by get() and not back */
+  guint32 import_first;         /* indices from here on hold upstream
+                                   buffers, 0 = none (see reserve) */
   GstBufferClassBuffer **buffers;
-  GAsyncQueue *avail_buffers;   /* pool of available buffers */
-  void *vidStreamBufVa;
+  GstBcFreeList avail_buffers;  /* indices of the available buffers */
+  GstBufferClassChunk chunks[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+  guint num_chunks;
+  gint buf_size;
+  gboolean cached;              /* CPU cached: written back before rendering */
+  videoConfig_s config;         /* as last sent to the compositor */
+
+  /* demand tracking: buffers out of the pool at the same time */
+  guint high_water;
+  guint window_high;
+  guint window_requests;
+
+  GstVideoFormat format;
+  gint width, height;
+  GstFrameLayout layout;        /* plane layout of every buffer, padded
+                                   as upstream asked for */
 
 };
 
@@ -132,10 +164,11 @@ struct _GstBufferClassBufferPoolClass
 
 GType gst_buffer_manager_get_type (void);
 
-GstBufferClassBufferPool *gst_buffer_manager_new (GstElement * elem, videoConfig_s videoConfig, int count, GstCaps * caps);
+GstBufferClassBufferPool *gst_buffer_manager_new (GstElement * elem, videoConfig_s videoConfig, int count, int max_count, GstCaps * caps, guint min_size, gboolean cached);
 void gst_buffer_manager_dispose (GstBufferClassBufferPool *pool);
 GstCaps *gst_buffer_manager_get_caps (GstBufferClassBufferPool * pool);
 GstBufferClassBuffer *gst_buffer_manager_get (GstBufferClassBufferPool * pool);
+gboolean gst_buffer_manager_reserve (GstBufferClassBufferPool * pool, guint min_free);
 
 #define GST_BCBUFFERPOOL_LOCK(pool)     g_mutex_lock ((pool)->lock)
 #define GST_BCBUFFERPOOL_UNLOCK(pool)   g_mutex_unlock ((pool)->lock)
@@ -0,0 +1,801 @@
+/******************************************************************************
+*****************************************************************************
+ * gst_comp_link.c
+ * Control link to the gpu composition module - all the sinks of a process
+ * share one connection to the compositor, which batches their messages and
+ * passes the video buffers as dma-buf fds
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "gst_comp_link.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gpuvsink_debug);
+#define GST_CAT_DEFAULT gpuvsink_debug
+
+/* Longest a message waits for the frames of the other channels before it is
+ * sent on its own; well below a display refresh, so a frame that is late for
+ * the batch still makes the same vsync */
+#define GST_COMP_LINK_BATCH_US 2000
+
+/* Records waiting for the socket before the senders wait for room */
+#define GST_COMP_LINK_MAX_QUEUED 32
+
+/* Longest the last user waits for the queued records to go out */
+#define GST_COMP_LINK_DRAIN_MS 500
+
+/*
+ * One channel per attached plane. The sink gets one end of a socket pair as
+ * its link; the reader thread forwards the frame status of the plane to the
+ * other end, so the sink reads it as from a socket of its own.
+ */
+typedef struct
+{
+  gint fd;                      /* the sink's end */
+  gint status_fd;               /* ours, -1 once the connection is lost */
+  gboolean closing;             /* VID_MSG_CLOSE sent */
+  gboolean ack_pending;         /* ack did not fit into status_fd yet */
+  videoStatus_s ack;
+} GstCompLinkChannel;
+
+/* One record for the socket, with our own duplicates of its fds */
+typedef struct
+{
+  vidMuxMsg_s *msgs;
+  guint n;
+  gint fds[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+  gint nfds;
+} GstCompLinkRecord;
+
+/*
+ * The connection of the process, everything under link_lock. Only the
+ * reader thread writes to the socket, which never blocks: the senders
+ * queue records and go on, so that no sink waits for the compositor, let
+ * alone with the lock held.
+ */
+static pthread_mutex_t link_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t link_cond = PTHREAD_COND_INITIALIZER;
+static gint link_fd = -1;
+static gboolean link_alive;             /* the compositor is still there */
+static guint link_users;
+static GThread *link_reader;
+static gint link_wake[2] = { -1, -1 };  /* new record or batch deadline */
+static gboolean link_attaching;         /* one VID_MSG_ATTACH at a time */
+static gint link_attach_reply;          /* -2 until it is answered */
+static GstCompLinkChannel link_chan[MAX_VID_PLANES];
+static guint link_open;                 /* planes with a channel */
+static GSList *link_lost;               /* sink ends of channels whose
+                                           connection went away */
+static GQueue link_out = G_QUEUE_INIT;  /* records not sent yet */
+
+/* messages queued for the next record */
+static vidMuxMsg_s link_batch[VID_MUX_MAX_BATCH];
+static guint link_batch_len;
+static guint link_batch_frames;         /* planes with a frame in the batch */
+static guint link_batch_expect;         /* planes with a frame in the last
+                                           record, waited for by the next */
+static gint64 link_batch_deadline;
+
+static gint64
+gst_comp_link_now_us (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+gst_comp_link_record_free (GstCompLinkRecord * rec)
+{
+  while (rec->nfds)
+    close (rec->fds[--rec->nfds]);
+  g_free (rec->msgs);
+  g_slice_free (GstCompLinkRecord, rec);
+}
+
+static void
+gst_comp_link_drop_queue (void)
+{
+  GstCompLinkRecord *rec;
+
+  while ((rec = g_queue_pop_head (&link_out)))
+    gst_comp_link_record_free (rec);
+}
+
+/* Have the reader thread look at the queue and the batch again */
+static void
+gst_comp_link_wake (void)
+{
+  /* a full pipe wakes it up just as well */
+  if (write (link_wake[1], "", 1) < 0 && errno != EAGAIN)
+    GST_WARNING ("failed to wake the link reader: %s", g_strerror (errno));
+}
+
+/*
+ * Write one record without blocking, only done by the reader thread and
+ * without the lock. Returns 1 once it is sent, 0 if the socket is full and
+ * -1 if it can't be sent at all.
+ */
+static gint
+gst_comp_link_write (gint fd, GstCompLinkRecord * rec)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  gchar cbuf[CMSG_SPACE (sizeof (gint) * MAX_VIDEO_BUFFERS_PER_CHANNEL)];
+  ssize_t ret;
+
+  iov.iov_base = rec->msgs;
+  iov.iov_len = sizeof (*rec->msgs) * rec->n;
+
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (rec->nfds > 0) {
+    msg.msg_control = cbuf;
+    msg.msg_controllen = CMSG_SPACE (sizeof (gint) * rec->nfds);
+    cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (gint) * rec->nfds);
+    memcpy (CMSG_DATA (cmsg), rec->fds, sizeof (gint) * rec->nfds);
+  }
+
+  do {
+    ret = sendmsg (fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return 0;
+  if (ret != (ssize_t) iov.iov_len) {
+    GST_WARNING ("failed to send %u messages: %s", rec->n, g_strerror (errno));
+    return -1;
+  }
+  return 1;
+}
+
+/* Queue a record for the reader thread to send, called with the lock held */
+static gboolean
+gst_comp_link_enqueue (const vidMuxMsg_s * msgs, guint n, const gint * fds,
+    gint nfds)
+{
+  GstCompLinkRecord *rec = g_slice_new0 (GstCompLinkRecord);
+
+  /* the caller may close its fds as soon as this returns */
+  for (rec->nfds = 0; rec->nfds < nfds; rec->nfds++) {
+    rec->fds[rec->nfds] = dup (fds[rec->nfds]);
+    if (rec->fds[rec->nfds] < 0) {
+      GST_WARNING ("failed to pass on fd %d: %s", fds[rec->nfds],
+          g_strerror (errno));
+      gst_comp_link_record_free (rec);
+      return FALSE;
+    }
+  }
+  rec->msgs = g_memdup (msgs, sizeof (*msgs) * n);
+  rec->n = n;
+
+  g_queue_push_tail (&link_out, rec);
+  gst_comp_link_wake ();
+  return TRUE;
+}
+
+/* Queue the batched messages as one record, called with the lock held */
+static gboolean
+gst_comp_link_flush (void)
+{
+  guint n = link_batch_len;
+
+  if (n == 0)
+    return TRUE;
+
+  link_batch_len = 0;
+  link_batch_expect = link_batch_frames;
+  link_batch_frames = 0;
+  return gst_comp_link_enqueue (link_batch, n, NULL, 0);
+}
+
+/*
+ * Wait until the queue has room, called with the lock held. A compositor
+ * that falls behind slows the senders down rather than the memory use of
+ * the queue growing.
+ */
+static void
+gst_comp_link_wait_room (void)
+{
+  while (link_alive && g_queue_get_length (&link_out) >= GST_COMP_LINK_MAX_QUEUED)
+    pthread_cond_wait (&link_cond, &link_lock);
+}
+
+static void
+gst_comp_link_queue (gint plane, const videoConfig_s * cfg)
+{
+  if (link_batch_len == VID_MUX_MAX_BATCH)
+    gst_comp_link_flush ();
+
+  if (link_batch_len == 0) {
+    link_batch_deadline = gst_comp_link_now_us () + GST_COMP_LINK_BATCH_US;
+    gst_comp_link_wake ();
+  }
+
+  link_batch[link_batch_len].plane = plane;
+  link_batch[link_batch_len].cfg = *cfg;
+  link_batch_len++;
+}
+
+/* Hand a status from the compositor on, called with the lock held */
+static void
+gst_comp_link_dispatch (vidMuxStatus_s * ms)
+{
+  GstCompLinkChannel *chan;
+
+  if (ms->status.status == VID_STATUS_ATTACHED) {
+    link_attach_reply = ms->status.buf_index;
+    pthread_cond_broadcast (&link_cond);
+    return;
+  }
+
+  if (ms->plane < 0 || ms->plane >= MAX_VID_PLANES ||
+      !(link_open & (1 << ms->plane)))
+    return;
+
+  /* never blocks: the sink may not be reading, e.g. while its channel is
+     parked, and the compositor drops frame statuses the same way. The
+     close acknowledgement is kept until the sink makes room for it. */
+  chan = &link_chan[ms->plane];
+  if (chan->status_fd < 0)
+    return;
+  if (send (chan->status_fd, &ms->status, sizeof (ms->status),
+          MSG_DONTWAIT | MSG_NOSIGNAL) < 0 &&
+      (errno == EAGAIN || errno == EWOULDBLOCK) &&
+      ms->status.status == VID_STATUS_CLOSED) {
+    chan->ack = ms->status;
+    chan->ack_pending = TRUE;
+  }
+}
+
+/* Retry a close acknowledgement, called with the lock held */
+static void
+gst_comp_link_send_ack (GstCompLinkChannel * chan)
+{
+  if (send (chan->status_fd, &chan->ack, sizeof (chan->ack),
+          MSG_DONTWAIT | MSG_NOSIGNAL) < 0 &&
+      (errno == EAGAIN || errno == EWOULDBLOCK))
+    return;
+  chan->ack_pending = FALSE;
+}
+
+/*
+ * Reads the status of all the channels, sends the queued records as the
+ * socket takes them and queues batches that are due
+ */
+static gpointer
+gst_comp_link_reader (gpointer data)
+{
+  gint fd = GPOINTER_TO_INT (data);
+  struct pollfd pfd[2 + MAX_VID_PLANES];
+  GstCompLinkRecord *rec;
+  vidMuxStatus_s ms;
+  gboolean blocked = FALSE;
+  gint64 left;
+  gint timeout, p, i, np, ret;
+  ssize_t n = 0;
+  gchar c[16];
+
+  pthread_mutex_lock (&link_lock);
+  while (link_fd == fd) {
+    timeout = -1;
+    if (link_batch_len) {
+      left = link_batch_deadline - gst_comp_link_now_us ();
+      if (left <= 0) {
+        gst_comp_link_flush ();
+        continue;
+      }
+      timeout = (left + 999) / 1000;
+    }
+
+    /* in order, as far as the socket takes them; only we take records
+       off the queue, so the head stays while the lock is released */
+    while (!blocked && (rec = g_queue_peek_head (&link_out))) {
+      pthread_mutex_unlock (&link_lock);
+      ret = gst_comp_link_write (fd, rec);
+      pthread_mutex_lock (&link_lock);
+      if (ret == 0) {
+        blocked = TRUE;
+        break;
+      }
+      gst_comp_link_record_free (g_queue_pop_head (&link_out));
+      pthread_cond_broadcast (&link_cond);
+    }
+    if (link_fd != fd)
+      break;
+
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN | (blocked ? POLLOUT : 0);
+    pfd[1].fd = link_wake[0];
+    pfd[1].events = POLLIN;
+    for (p = 0, np = 2; p < MAX_VID_PLANES; p++) {
+      if ((link_open & (1 << p)) && link_chan[p].ack_pending &&
+          link_chan[p].status_fd >= 0) {
+        pfd[np].fd = link_chan[p].status_fd;
+        pfd[np].events = POLLOUT;
+        np++;
+      }
+    }
+    for (i = 0; i < np; i++)
+      pfd[i].revents = 0;
+    pthread_mutex_unlock (&link_lock);
+
+    n = 0;
+    if (poll (pfd, np, timeout) > 0) {
+      if (pfd[1].revents)
+        while (read (pfd[1].fd, c, sizeof (c)) > 0);
+      if (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+        do {
+          n = recv (fd, &ms, sizeof (ms), MSG_DONTWAIT);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+          pfd[0].revents = 0;
+      }
+    }
+
+    pthread_mutex_lock (&link_lock);
+    if (link_fd != fd)
+      continue;
+    if (pfd[0].revents & (POLLOUT | POLLHUP | POLLERR))
+      blocked = FALSE;
+
+    /* the channel may have been closed and opened again meanwhile */
+    for (i = 2; i < np; i++) {
+      for (p = 0; p < MAX_VID_PLANES; p++) {
+        if (pfd[i].revents && (link_open & (1 << p)) &&
+            link_chan[p].ack_pending && link_chan[p].status_fd == pfd[i].fd)
+          gst_comp_link_send_ack (&link_chan[p]);
+      }
+    }
+
+    if (!(pfd[0].revents & (POLLIN | POLLHUP | POLLERR)))
+      continue;
+    if (n != sizeof (ms)) {
+      GST_WARNING ("compositor link lost");
+      break;
+    }
+    gst_comp_link_dispatch (&ms);
+  }
+
+  /* the compositor went away: the sinks see their links close, and the
+     next channel opened connects again (see gst_comp_link_open) */
+  if (link_fd == fd) {
+    link_alive = FALSE;
+    link_batch_len = 0;
+    link_batch_frames = 0;
+    link_batch_expect = 0;
+    gst_comp_link_drop_queue ();
+    for (p = 0; p < MAX_VID_PLANES; p++) {
+      if (!(link_open & (1 << p)))
+        continue;
+      if (link_chan[p].status_fd >= 0)
+        close (link_chan[p].status_fd);
+      link_lost = g_slist_prepend (link_lost,
+          GINT_TO_POINTER (link_chan[p].fd));
+    }
+    link_open = 0;
+    pthread_cond_broadcast (&link_cond);
+  }
+  pthread_mutex_unlock (&link_lock);
+  return NULL;
+}
+
+/* Connect to the shared socket of the compositor, called with the lock held */
+static gboolean
+gst_comp_link_connect (void)
+{
+  struct sockaddr_un addr;
+  GError *error = NULL;
+  gint fd;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strncpy (addr.sun_path, VIDEO_MUX_SOCKET_NAME, sizeof (addr.sun_path) - 1);
+
+  fd = socket (AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0) {
+    GST_ERROR ("socket failed: %s", g_strerror (errno));
+    return FALSE;
+  }
+
+  if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+    GST_ERROR ("failed to connect to %s: %s", addr.sun_path,
+        g_strerror (errno));
+    close (fd);
+    return FALSE;
+  }
+
+  if (pipe (link_wake) < 0) {
+    GST_ERROR ("pipe failed: %s", g_strerror (errno));
+    close (fd);
+    return FALSE;
+  }
+  fcntl (fd, F_SETFL, O_NONBLOCK);
+  fcntl (link_wake[0], F_SETFL, O_NONBLOCK);
+  fcntl (link_wake[1], F_SETFL, O_NONBLOCK);
+
+  link_fd = fd;
+  link_alive = TRUE;
+  link_batch_len = 0;
+  link_batch_frames = 0;
+  link_batch_expect = 0;
+  link_reader = g_thread_create (gst_comp_link_reader, GINT_TO_POINTER (fd),
+      TRUE, &error);
+  if (!link_reader) {
+    GST_ERROR ("no link reader: %s", error->message);
+    g_error_free (error);
+    link_fd = -1;
+    link_alive = FALSE;
+    close (fd);
+    close (link_wake[0]);
+    close (link_wake[1]);
+    return FALSE;
+  }
+
+  GST_DEBUG ("connected to %s", addr.sun_path);
+  return TRUE;
+}
+
+/*
+ * Take down a connection the compositor has gone away from, called with the
+ * lock held. Its reader has stopped: it marked the link dead last thing.
+ */
+static void
+gst_comp_link_disconnect (void)
+{
+  g_thread_join (link_reader);
+  close (link_fd);
+  close (link_wake[0]);
+  close (link_wake[1]);
+  link_fd = -1;
+  link_reader = NULL;
+  GST_DEBUG ("dropped the lost connection");
+}
+
+/*
+ * Drop a user of the connection, the last one takes it down once what is
+ * queued has gone out. Called with the lock held, returns with it released.
+ */
+static void
+gst_comp_link_unref (void)
+{
+  GThread *reader = NULL;
+  gint fd = -1, wake[2];
+  struct timespec ts;
+
+  if (--link_users == 0 && link_alive) {
+    gst_comp_link_flush ();
+    clock_gettime (CLOCK_REALTIME, &ts);
+    ts.tv_sec += GST_COMP_LINK_DRAIN_MS / 1000;
+    ts.tv_nsec += (GST_COMP_LINK_DRAIN_MS % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    while (link_alive && !g_queue_is_empty (&link_out) &&
+        pthread_cond_timedwait (&link_cond, &link_lock, &ts) == 0);
+  }
+
+  /* a new user may have come along while the queue drained */
+  if (link_users == 0 && link_fd >= 0) {
+    fd = link_fd;
+    reader = link_reader;
+    wake[0] = link_wake[0];
+    wake[1] = link_wake[1];
+    link_fd = -1;
+    link_reader = NULL;
+    link_alive = FALSE;
+    gst_comp_link_drop_queue ();
+  }
+  pthread_mutex_unlock (&link_lock);
+
+  if (fd >= 0) {
+    shutdown (fd, SHUT_RDWR);
+    g_thread_join (reader);
+    close (fd);
+    close (wake[0]);
+    close (wake[1]);
+    GST_DEBUG ("disconnected");
+  }
+}
+
+static gint
+gst_comp_link_find (gint fd)
+{
+  gint p;
+
+  for (p = 0; p < MAX_VID_PLANES; p++)
+    if ((link_open & (1 << p)) && link_chan[p].fd == fd)
+      return p;
+  return -1;
+}
+
+/**
+ * Attach a video channel through the connection of the process, which is
+ * set up on the first one, and again on the first one after the compositor
+ * went away
+ *
+ * @channel_no  the video plane of the composition module, -1 for any free
+ *              one; set to the plane attached
+ * @return the link of the channel or -1 if the compositor is not listening
+ *         or the plane is taken
+ */
+gint
+gst_comp_link_open (gint * channel_no)
+{
+  vidMuxMsg_s msg;
+  gint sv[2], plane = -1;
+
+  pthread_mutex_lock (&link_lock);
+  while (link_attaching)
+    pthread_cond_wait (&link_cond, &link_lock);
+
+  if (link_fd >= 0 && !link_alive)
+    gst_comp_link_disconnect ();
+  if (link_fd < 0 && !gst_comp_link_connect ()) {
+    pthread_mutex_unlock (&link_lock);
+    return -1;
+  }
+  link_users++;
+
+  gst_comp_link_wait_room ();
+  if (link_alive) {
+    memset (&msg, 0, sizeof (msg));
+    msg.plane = -1;
+    msg.cfg.config_data = VID_MSG_ATTACH;
+    msg.cfg.buf_index = *channel_no;
+
+    link_attaching = TRUE;
+    link_attach_reply = -2;
+    gst_comp_link_flush ();
+    if (gst_comp_link_enqueue (&msg, 1, NULL, 0)) {
+      while (link_attach_reply == -2 && link_alive)
+        pthread_cond_wait (&link_cond, &link_lock);
+      plane = link_attach_reply < 0 ? -1 : link_attach_reply;
+    }
+    link_attaching = FALSE;
+    pthread_cond_broadcast (&link_cond);
+  }
+
+  if (plane < 0 || plane >= MAX_VID_PLANES || !link_alive) {
+    GST_ERROR ("failed to attach video plane %d", *channel_no);
+    gst_comp_link_unref ();
+    return -1;
+  }
+
+  if (socketpair (AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+    GST_ERROR ("socketpair failed: %s", g_strerror (errno));
+    memset (&msg, 0, sizeof (msg));
+    msg.plane = plane;
+    msg.cfg.config_data = VID_MSG_CLOSE;
+    gst_comp_link_enqueue (&msg, 1, NULL, 0);
+    gst_comp_link_unref ();
+    return -1;
+  }
+
+  link_chan[plane].fd = sv[0];
+  link_chan[plane].status_fd = sv[1];
+  link_chan[plane].closing = FALSE;
+  link_chan[plane].ack_pending = FALSE;
+  link_open |= 1 << plane;
+  pthread_mutex_unlock (&link_lock);
+
+  GST_DEBUG ("attached video plane %d", plane);
+  *channel_no = plane;
+  return sv[0];
+}
+
+/**
+ * Send one message to the compositor. Frames, buffer mappings and geometry
+ * changes are batched: they go out together once every channel that had a
+ * frame in the last record has one queued, a channel queues its next
+ * frame, or GST_COMP_LINK_BATCH_US after the first of them. Everything
+ * else is sent right away, after the batch. Nothing is written here, the
+ * reader thread sends what is queued; this only waits if the compositor is
+ * that far behind.
+ *
+ * @fd    the link returned by gst_comp_link_open()
+ * @cfg   the message
+ * @fds   dma-buf fds to pass along (config and map messages only), or NULL
+ * @nfds  number of entries in @fds
+ * @return FALSE if the channel is closed or the message can't be queued
+ */
+gboolean
+gst_comp_link_send (gint fd, videoConfig_s * cfg, const gint * fds, gint nfds)
+{
+  vidMuxMsg_s msg;
+  gboolean ret = TRUE;
+  gint plane;
+
+  g_return_val_if_fail (nfds <= MAX_VIDEO_BUFFERS_PER_CHANNEL, FALSE);
+
+  pthread_mutex_lock (&link_lock);
+  gst_comp_link_wait_room ();
+  plane = gst_comp_link_find (fd);
+  if (plane < 0 || !link_alive) {
+    pthread_mutex_unlock (&link_lock);
+    GST_WARNING ("message %d on a closed link", cfg->config_data);
+    return FALSE;
+  }
+
+  switch (cfg->config_data) {
+    case VID_MSG_DATA:
+      /* a second frame of a channel is for the next refresh */
+      if (link_batch_frames & (1 << plane))
+        ret = gst_comp_link_flush ();
+      gst_comp_link_queue (plane, cfg);
+      link_batch_frames |= 1 << plane;
+      /* channels without a frame in the last record, paused or parked
+         ones or those at a lower rate, are not waited for */
+      if (!(link_batch_expect & link_open & ~link_batch_frames))
+        ret = gst_comp_link_flush () && ret;
+      break;
+
+    case VID_MSG_MAP:
+    case VID_MSG_GEOMETRY:
+      if (nfds == 0) {
+        gst_comp_link_queue (plane, cfg);
+        break;
+      }
+      /* a mapping with its dma-buf goes out on its own */
+      /* fall through */
+    default:
+      if (cfg->config_data == VID_MSG_CLOSE)
+        link_chan[plane].closing = TRUE;
+      memset (&msg, 0, sizeof (msg));
+      msg.plane = plane;
+      msg.cfg = *cfg;
+      ret = gst_comp_link_flush ();
+      ret = gst_comp_link_enqueue (&msg, 1, fds, nfds) && ret;
+      break;
+  }
+  pthread_mutex_unlock (&link_lock);
+  return ret;
+}
+
+/**
+ * Wait for the next frame status from the compositor
+ *
+ * @fd          the link returned by gst_comp_link_open()
+ * @wake_fd     stop waiting as soon as this becomes readable, or -1
+ * @timeout_ms  longest wait in milliseconds, -1 to wait for ever
+ * @status      filled in with the status
+ * @return FALSE once woken up or timed out, or the link is shut down or
+ *         closed by the compositor
+ */
+gboolean
+gst_comp_link_recv_status (gint fd, gint wake_fd, gint timeout_ms,
+    videoStatus_s * status)
+{
+  struct pollfd pfd[2];
+  ssize_t n;
+
+  pfd[0].fd = fd;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = wake_fd;
+  pfd[1].events = POLLIN;
+  do {
+    pfd[0].revents = pfd[1].revents = 0;
+    n = poll (pfd, wake_fd >= 0 ? 2 : 1, timeout_ms);
+  } while (n < 0 && errno == EINTR);
+
+  if (n <= 0 || pfd[1].revents)
+    return FALSE;
+
+  do {
+    n = recv (fd, status, sizeof (*status), 0);
+  } while (n < 0 && errno == EINTR);
+
+  if (n == 0)
+    return FALSE;
+  if (n != sizeof (*status)) {
+    if (n < 0)
+      GST_DEBUG ("status link closed: %s", g_strerror (errno));
+    else
+      GST_WARNING ("short status message (%d bytes)", (gint) n);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * Detach the channel; one that was not closed with VID_MSG_CLOSE is closed
+ * here without waiting for the acknowledgement
+ *
+ * @fd  the link returned by gst_comp_link_open()
+ */
+void
+gst_comp_link_close (gint fd)
+{
+  vidMuxMsg_s msg;
+  gint plane;
+
+  if (fd < 0)
+    return;
+
+  pthread_mutex_lock (&link_lock);
+  plane = gst_comp_link_find (fd);
+  if (plane < 0) {
+    if (g_slist_find (link_lost, GINT_TO_POINTER (fd))) {
+      /* the compositor is gone, the plane along with it */
+      link_lost = g_slist_remove (link_lost, GINT_TO_POINTER (fd));
+      close (fd);
+      gst_comp_link_unref ();
+      return;
+    }
+    pthread_mutex_unlock (&link_lock);
+    close (fd);
+    return;
+  }
+
+  if (link_alive && !link_chan[plane].closing) {
+    memset (&msg, 0, sizeof (msg));
+    msg.plane = plane;
+    msg.cfg.config_data = VID_MSG_CLOSE;
+    gst_comp_link_flush ();
+    gst_comp_link_enqueue (&msg, 1, NULL, 0);
+  }
+
+  if (link_chan[plane].status_fd >= 0)
+    close (link_chan[plane].status_fd);
+  link_chan[plane].ack_pending = FALSE;
+  link_open &= ~(1 << plane);
+  link_batch_frames &= ~(1 << plane);
+  link_batch_expect &= ~(1 << plane);
+  close (fd);
+
+  GST_DEBUG ("detached video plane %d", plane);
+  gst_comp_link_unref ();
+}
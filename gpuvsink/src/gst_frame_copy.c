@@ -0,0 +1,397 @@
+/******************************************************************************
+*****************************************************************************
+ * gst_frame_copy.c
+ * Frame copy engine for the slow path (buffers not allocated by the sink)
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <cmem.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "gst_frame_copy.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gpuvsink_debug);
+#define GST_CAT_DEFAULT gpuvsink_debug
+
+/* A run of lines of one plane, copied by one thread */
+typedef struct
+{
+  GstFrameCopier *copier;
+  guint8 *dst;
+  const guint8 *src;
+  gint dst_stride;
+  gint src_stride;
+  gint line_bytes;
+  gint lines;
+  gboolean write_back;          /* dst is CPU cached */
+} GstCopyBand;
+
+struct _GstFrameCopier
+{
+  GThreadPool *workers;         /* NULL when copying on the caller only */
+  gint n_threads;
+  GstCopyBand *bands;
+  GMutex *lock;
+  GCond *done;
+  gint pending;                 /* bands handed to workers, not yet copied */
+};
+
+/**
+ * Describe the memory planes of a frame as GStreamer lays it out
+ *
+ * @layout  filled with the plane offsets, strides and sizes
+ * @return FALSE if the format is not one the sink accepts
+ */
+gboolean
+gst_frame_layout_init (GstFrameLayout * layout, GstVideoFormat format,
+    gint width, gint height)
+{
+  gint p;
+
+  switch (format) {
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12:
+      layout->n_planes = 3;
+      break;
+    case GST_VIDEO_FORMAT_NV12:
+      layout->n_planes = 2;
+      break;
+    case GST_VIDEO_FORMAT_YUY2:
+    case GST_VIDEO_FORMAT_UYVY:
+      layout->n_planes = 1;
+      break;
+    default:
+      return FALSE;
+  }
+
+  /* the memory planes are the first n components; NV12's V shares U's plane */
+  for (p = 0; p < layout->n_planes; p++) {
+    layout->offset[p] =
+        gst_video_format_get_component_offset (format, p, width, height);
+    layout->stride[p] = gst_video_format_get_row_stride (format, p, width);
+    layout->line_bytes[p] =
+        gst_video_format_get_component_width (format, p, width) *
+        gst_video_format_get_pixel_stride (format, p);
+    layout->lines[p] =
+        gst_video_format_get_component_height (format, p, height);
+  }
+  layout->size = gst_video_format_get_size (format, width, height);
+
+  return TRUE;
+}
+
+/**
+ * Lay the planes of a frame out with padding, as decoders that work on
+ * aligned macroblocks want them: lines @rowstride bytes apart in the first
+ * plane (half that in the I420/YV12 chroma planes) and @rows lines of luma
+ * per frame, the lines beyond the picture height coming before the chroma.
+ *
+ * @layout     a layout from gst_frame_layout_init(), updated
+ * @rowstride  stride of the first plane in bytes, 0 for the natural one
+ * @rows       lines in the first plane, at least the picture height
+ * @return FALSE if the stride is too small for a line or not 4-byte aligned
+ */
+gboolean
+gst_frame_layout_pad (GstFrameLayout * layout, GstVideoFormat format,
+    gint rowstride, gint rows)
+{
+  gint stride, cstride, crows;
+  gsize ysize, csize;
+
+  stride = rowstride > 0 ? rowstride : layout->stride[0];
+  if (stride < layout->line_bytes[0] || (stride & 3) || rows < layout->lines[0])
+    return FALSE;
+
+  ysize = (gsize) stride * rows;
+  crows = (rows + 1) / 2;
+
+  switch (format) {
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12:
+      cstride = stride / 2;
+      if (cstride < layout->line_bytes[1])
+        return FALSE;
+      csize = (gsize) cstride * crows;
+      layout->stride[1] = layout->stride[2] = cstride;
+      /* offsets are per component: YV12 has V before U */
+      layout->offset[format == GST_VIDEO_FORMAT_I420 ? 1 : 2] = ysize;
+      layout->offset[format == GST_VIDEO_FORMAT_I420 ? 2 : 1] = ysize + csize;
+      layout->size = ysize + 2 * csize;
+      break;
+    case GST_VIDEO_FORMAT_NV12:
+      layout->stride[1] = stride;
+      layout->offset[1] = ysize;
+      layout->size = ysize + (gsize) stride * crows;
+      break;
+    default:
+      layout->size = ysize;
+      break;
+  }
+  layout->stride[0] = stride;
+  layout->offset[0] = 0;
+
+  return TRUE;
+}
+
+/**
+ * Layout of the frames described by @caps, taking the optional "rowstride"
+ * field of strided caps into account
+ */
+gboolean
+gst_frame_layout_from_caps (GstFrameLayout * layout, GstCaps * caps)
+{
+  GstVideoFormat format;
+  gint width, height, rowstride = 0;
+
+  if (!caps || !gst_video_format_parse_caps (caps, &format, &width, &height) ||
+      !gst_frame_layout_init (layout, format, width, height))
+    return FALSE;
+
+  gst_structure_get_int (gst_caps_get_structure (caps, 0), "rowstride",
+      &rowstride);
+  return rowstride <= 0 ||
+      gst_frame_layout_pad (layout, format, rowstride, height);
+}
+
+/* Copy one line. The destination is CMEM memory that is only read back by
+   the GPU, so the stores should not pull it into the cache where possible */
+static inline void
+copy_line (guint8 * dst, const guint8 * src, gint n)
+{
+#if defined(__ARM_NEON__)
+  /* ARMv7 has no non-temporal stores; stream 64 bytes at a time with the
+     source prefetched ahead and leave the write-back to the caller */
+  while (n >= 64) {
+    uint8x16_t a, b, c, d;
+
+    __builtin_prefetch (src + 256);
+    a = vld1q_u8 (src);
+    b = vld1q_u8 (src + 16);
+    c = vld1q_u8 (src + 32);
+    d = vld1q_u8 (src + 48);
+    vst1q_u8 (dst, a);
+    vst1q_u8 (dst + 16, b);
+    vst1q_u8 (dst + 32, c);
+    vst1q_u8 (dst + 48, d);
+    src += 64;
+    dst += 64;
+    n -= 64;
+  }
+#elif defined(__SSE2__)
+  while (n > 0 && ((gsize) dst & 15)) {
+    *dst++ = *src++;
+    n--;
+  }
+  while (n >= 64) {
+    __m128i a, b, c, d;
+
+    _mm_prefetch ((const char *) src + 256, _MM_HINT_NTA);
+    a = _mm_loadu_si128 ((const __m128i *) src);
+    b = _mm_loadu_si128 ((const __m128i *) (src + 16));
+    c = _mm_loadu_si128 ((const __m128i *) (src + 32));
+    d = _mm_loadu_si128 ((const __m128i *) (src + 48));
+    _mm_stream_si128 ((__m128i *) dst, a);
+    _mm_stream_si128 ((__m128i *) (dst + 16), b);
+    _mm_stream_si128 ((__m128i *) (dst + 32), c);
+    _mm_stream_si128 ((__m128i *) (dst + 48), d);
+    src += 64;
+    dst += 64;
+    n -= 64;
+  }
+#endif
+  if (n > 0)
+    memcpy (dst, src, n);
+}
+
+static void
+copy_band (GstCopyBand * band)
+{
+  gint i;
+
+  if (band->lines <= 0)
+    return;
+
+  if (band->dst_stride == band->line_bytes &&
+      band->src_stride == band->line_bytes) {
+    copy_line (band->dst, band->src, band->line_bytes * band->lines);
+  } else {
+    for (i = 0; i < band->lines; i++)
+      copy_line (band->dst + i * band->dst_stride,
+          band->src + i * band->src_stride, band->line_bytes);
+  }
+#if !defined(__ARM_NEON__) && defined(__SSE2__)
+  _mm_sfence ();
+#endif
+
+  /* write back only the lines just written, not the whole buffer */
+  if (band->write_back)
+    CMEM_cacheWb (band->dst,
+        (band->lines - 1) * band->dst_stride + band->line_bytes);
+}
+
+static void
+copy_worker (gpointer data, gpointer user_data)
+{
+  GstCopyBand *band = (GstCopyBand *) data;
+  GstFrameCopier *copier = band->copier;
+
+  copy_band (band);
+
+  g_mutex_lock (copier->lock);
+  if (--copier->pending == 0)
+    g_cond_signal (copier->done);
+  g_mutex_unlock (copier->lock);
+}
+
+/**
+ * Create a copy engine
+ *
+ * @n_threads  worker threads besides the caller; 0 picks one per additional
+ *             online cpu, so single core parts copy inline
+ */
+GstFrameCopier *
+gst_frame_copier_new (gint n_threads)
+{
+  GstFrameCopier *copier = g_new0 (GstFrameCopier, 1);
+
+  if (n_threads <= 0)
+    n_threads = sysconf (_SC_NPROCESSORS_ONLN) - 1;
+  if (n_threads < 0)
+    n_threads = 0;
+
+  copier->lock = g_mutex_new ();
+  copier->done = g_cond_new ();
+
+  if (n_threads > 0) {
+    copier->workers = g_thread_pool_new (copy_worker, NULL, n_threads, TRUE,
+        NULL);
+    if (!copier->workers) {
+      GST_WARNING ("could not start %d copy threads, copying inline",
+          n_threads);
+      n_threads = 0;
+    }
+  }
+  copier->n_threads = n_threads;
+  copier->bands = g_new0 (GstCopyBand, (n_threads + 1) * VID_MAX_COMPONENTS);
+
+  GST_DEBUG ("frame copier with %d worker threads", n_threads);
+
+  return copier;
+}
+
+void
+gst_frame_copier_free (GstFrameCopier * copier)
+{
+  if (!copier)
+    return;
+
+  if (copier->workers)
+    g_thread_pool_free (copier->workers, FALSE, TRUE);
+  g_cond_free (copier->done);
+  g_mutex_free (copier->lock);
+  g_free (copier->bands);
+  g_free (copier);
+}
+
+/**
+ * Copy a frame, converting between the source and destination strides
+ *
+ * Large frames are cut into bands of lines that the workers copy while the
+ * caller copies the last band of each plane. Returns once the whole frame
+ * is in memory and, if @cached, written back from the cpu cache.
+ */
+void
+gst_frame_copier_copy (GstFrameCopier * copier, guint8 * dst,
+    const GstFrameLayout * dst_layout, const guint8 * src,
+    const GstFrameLayout * src_layout, gboolean cached)
+{
+  GstCopyBand *band = copier->bands;
+  gint p, b, n_bands, first, lines;
+
+  g_return_if_fail (dst_layout->n_planes == src_layout->n_planes);
+
+  n_bands = 1;
+  if (copier->workers && dst_layout->size >= GST_FRAME_COPY_SPLIT_MIN)
+    n_bands = copier->n_threads + 1;
+
+  for (p = 0; p < dst_layout->n_planes; p++) {
+    lines = MIN (dst_layout->lines[p], src_layout->lines[p]);
+
+    for (b = 0, first = 0; b < n_bands; b++, band++) {
+      band->copier = copier;
+      band->lines = (lines * (b + 1)) / n_bands - first;
+      band->line_bytes =
+          MIN (dst_layout->line_bytes[p], src_layout->line_bytes[p]);
+      band->dst_stride = dst_layout->stride[p];
+      band->src_stride = src_layout->stride[p];
+      band->dst = dst + dst_layout->offset[p] + first * band->dst_stride;
+      band->src = src + src_layout->offset[p] + first * band->src_stride;
+      band->write_back = cached;
+      first += band->lines;
+    }
+  }
+
+  /* hand every band but the last of each plane to the workers */
+  if (n_bands > 1) {
+    g_mutex_lock (copier->lock);
+    copier->pending = dst_layout->n_planes * (n_bands - 1);
+    g_mutex_unlock (copier->lock);
+
+    for (p = 0; p < dst_layout->n_planes; p++)
+      for (b = 0; b < n_bands - 1; b++)
+        g_thread_pool_push (copier->workers, &copier->bands[p * n_bands + b],
+            NULL);
+  }
+
+  for (p = 0; p < dst_layout->n_planes; p++)
+    copy_band (&copier->bands[p * n_bands + n_bands - 1]);
+
+  if (n_bands > 1) {
+    g_mutex_lock (copier->lock);
+    while (copier->pending > 0)
+      g_cond_wait (copier->done, copier->lock);
+    g_mutex_unlock (copier->lock);
+  }
+}
@@ -0,0 +1,82 @@
+/******************************************************************************
+*****************************************************************************
+ * gst_frame_copy.h
+ * Frame copy engine for the slow path (buffers not allocated by the sink)
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+#ifndef __GST_FRAME_COPY_H__
+#define __GST_FRAME_COPY_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include "../../gpucomp.h"
+
+G_BEGIN_DECLS
+
+/* Frames smaller than this are copied by the calling thread alone */
+#define GST_FRAME_COPY_SPLIT_MIN  (256 * 1024)
+
+/**
+ * GstFrameLayout:
+ *
+ * Memory planes of one frame: the Y, U, V planes of I420/YV12, the Y and
+ * interleaved UV planes of NV12, or the single plane of a packed format.
+ */
+typedef struct
+{
+  gint n_planes;
+  gsize offset[VID_MAX_COMPONENTS];     /* plane start in the buffer */
+  gint stride[VID_MAX_COMPONENTS];      /* bytes from one line to the next */
+  gint line_bytes[VID_MAX_COMPONENTS];  /* bytes of picture in a line */
+  gint lines[VID_MAX_COMPONENTS];
+  gsize size;                           /* bytes spanned by the frame */
+} GstFrameLayout;
+
+typedef struct _GstFrameCopier GstFrameCopier;
+
+gboolean gst_frame_layout_init (GstFrameLayout * layout, GstVideoFormat format,
+    gint width, gint height);
+gboolean gst_frame_layout_pad (GstFrameLayout * layout, GstVideoFormat format,
+    gint rowstride, gint rows);
+gboolean gst_frame_layout_from_caps (GstFrameLayout * layout, GstCaps * caps);
+
+GstFrameCopier *gst_frame_copier_new (gint n_threads);
+void gst_frame_copier_free (GstFrameCopier * copier);
+void gst_frame_copier_copy (GstFrameCopier * copier, guint8 * dst,
+    const GstFrameLayout * dst_layout, const guint8 * src,
+    const GstFrameLayout * src_layout, gboolean cached);
+
+G_END_DECLS
+#endif /* __GST_FRAME_COPY_H__ */
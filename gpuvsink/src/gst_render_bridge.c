@@ -50,6 +50,7 @@
 #include <gst/gst.h>
 #include <gst/video/video.h>
 #include "gst_render_bridge.h"
+#include "gst_comp_link.h"
 #include <stdio.h>
 //#include "bc_cat.h"
 #include <pthread.h>
@@ -57,6 +58,8 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
 
 #include "../../gpucomp.h"
 
@@ -72,6 +75,19 @@ GST_DEBUG_CATEGORY (gpuvsink_debug);
 pthread_mutex_t ctrlmutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t initmutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* Channels left open by persistent-pool sinks that went to NULL, so that
+ * the next sink on the channel can take over the registered buffers.
+ */
+typedef struct
+{
+  GstBufferClassBufferPool *pool;   /* NULL if nothing is parked */
+  gint fd;
+  GstBuffer *held[GST_BC_HOLD_BUFFERS];  /* bcbuf_prev1..5 */
+} GstBufferClassParkedChannel;
+
+static GstBufferClassParkedChannel parked_channels[MAX_VID_PLANES];
+static pthread_mutex_t parkmutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* Properties */
 enum
 {
@@ -87,9 +103,44 @@ enum
   PROP_CROP_X,
   PROP_CROP_Y,
   PROP_CROP_WIDTH,
-  PROP_CROP_HEIGHT
+  PROP_CROP_HEIGHT,
+  PROP_COPY_THREADS,
+  PROP_SLOW_PATH_COPIES,
+  PROP_SLOW_PATH_BYTES,
+  PROP_FRAMES_IMPORTED,
+  PROP_POOL_BUFFERS,
+  PROP_POOL_HIGH_WATER,
+  PROP_FRAMES_SUBMITTED,
+  PROP_FRAMES_PRESENTED,
+  PROP_FRAMES_SKIPPED,
+  PROP_POOL_EMPTY_WAITS,
+  PROP_WRITE_LATENCY_MAX,
+  PROP_WRITE_BLOCKED_TIME,
+  PROP_BUFFERS_OUTSTANDING,
+  PROP_STATS_INTERVAL,
+  PROP_PERSISTENT_POOL,
+  PROP_DISPLAY_LATENCY,
+  PROP_AUTO_RENDER_DELAY,
+  PROP_MEMORY_TYPE
 };
 
+#define GST_TYPE_BC_MEMORY_TYPE (gst_bc_memory_type_get_type ())
+static GType
+gst_bc_memory_type_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_BC_MEMORY_AUTO, "Uncached for hardware upstream elements, else cached", "auto"},
+    {GST_BC_MEMORY_CACHED, "Cached, written back before rendering (CPU writers)", "cached"},
+    {GST_BC_MEMORY_UNCACHED, "Uncached (DMA writers)", "uncached"},
+    {0, NULL, NULL}
+  };
+
+  if (!type)
+    type = g_enum_register_static ("GstBcMemoryType", values);
+  return type;
+}
+
 /* Signals */
 enum
 {
@@ -178,80 +229,273 @@ gst_render_bridge_class_init (GstBufferClassSinkClass * klass)
       g_param_spec_float ("x-pos",
           "Display config parameters",
           "Specifies normalized device output x-cordinate for the video"
-          "on the display", -1, 1, 0, G_PARAM_WRITABLE));
+          "on the display", -1, 1, 0, G_PARAM_READWRITE));
 
   g_object_class_install_property (gobject_class, PROP_YPOS,
       g_param_spec_float ("y-pos",
           "Display config parameters",
           "Specifies normalized device output y-cordinate for the video"
-          "on the display", -1, 1, 1, G_PARAM_WRITABLE));
+          "on the display", -1, 1, 1, G_PARAM_READWRITE));
 
   g_object_class_install_property (gobject_class, PROP_WIDTH,
       g_param_spec_float ("width",
           "Display config parameters",
           "Specifies the normalized device output width for the video"
-          "on the display", 0, 2, 0, G_PARAM_WRITABLE));
+          "on the display", 0, 2, 0, G_PARAM_READWRITE));
 
   g_object_class_install_property (gobject_class, PROP_HEIGHT,
       g_param_spec_float ("height",
           "Display config parameters",
           "Specifies the normalized output height for the video"
-          "on the display", 0, 2, 0, G_PARAM_WRITABLE));
+          "on the display", 0, 2, 0, G_PARAM_READWRITE));
 
 
   g_object_class_install_property (gobject_class, PROP_CHANNEL_NO,
-      g_param_spec_uint ("channel-no",
+      g_param_spec_int ("channel-no",
           "Video channel number",
-          "Specifies the video channel number"
-          "on the display", 0, 4, 0, G_PARAM_WRITABLE));
+          "Specifies the video channel number "
+          "on the display, -1 for any free one", -1, MAX_VID_PLANES - 1,
+          VID_GPUVSINK_CHANNEL_NO, G_PARAM_READWRITE));
 
  g_object_class_install_property (gobject_class, PROP_ROTATE,
       g_param_spec_float ("rotate",
           "Display config parameters",
           "Specifies the rotation in degrees"
-          "on the display", -180, 180, 0, G_PARAM_WRITABLE));
+          "on the display", -180, 180, 0, G_PARAM_READWRITE));
 
 g_object_class_install_property (gobject_class, PROP_OVERLAYONGFX,
       g_param_spec_uint ("overlayongfx",
           "Overlay video channel on top of gfx",
           "Specifies the video channel priority over gfx 0 - gfx over video  1 - video over gfx  "
-          "on the display", 0, 1, 0, G_PARAM_WRITABLE));
+          "on the display", 0, 1, 0, G_PARAM_READWRITE));
 
 g_object_class_install_property (gobject_class, PROP_CROP_X,
       g_param_spec_uint ("crop_x",
           "cropping x co-ordinate",
           "Specifies the starting x co-ordinate for video frame cropping in samples"
-          "on the display", 0, 4096, 0, G_PARAM_WRITABLE));
+          "on the display", 0, 4096, 0, G_PARAM_READWRITE));
 
 g_object_class_install_property (gobject_class, PROP_CROP_Y,
       g_param_spec_uint ("crop_y",
           "cropping y co-ordinate",
           "Specifies the starting y co-ordinate for video frame cropping in samples"
-          "on the display", 0, 4096, 0, G_PARAM_WRITABLE));
+          "on the display", 0, 4096, 0, G_PARAM_READWRITE));
 
 
 g_object_class_install_property (gobject_class, PROP_CROP_WIDTH,
       g_param_spec_uint ("crop_w",
           "cropping width",
           "Specifies the cropping width in samples"
-          "on the display", 0, 4096, 0, G_PARAM_WRITABLE));
+          "on the display", 0, 4096, 0, G_PARAM_READWRITE));
 
 g_object_class_install_property (gobject_class, PROP_CROP_HEIGHT,
       g_param_spec_uint ("crop_h",
           "cropping height",
           "Specifies the cropping height in samples"
-          "on the display", 0, 4096, 0, G_PARAM_WRITABLE));
+          "on the display", 0, 4096, 0, G_PARAM_READWRITE));
 
   /**
    * GstBufferClassSink:queue-size
    *
-   * Number of buffers to be enqueued in the driver in streaming mode
+   * Maximum number of buffers in the pool. The pool starts with what the
+   * upstream latency calls for and grows up to this when it runs dry.
    */
   g_object_class_install_property (gobject_class, PROP_QUEUE_SIZE,
       g_param_spec_uint ("queue-size", "Queue size",
-          "Number of buffers to be enqueued in the driver in streaming mode",
+          "Maximum number of buffers to be enqueued in the driver in streaming mode",
           GST_BC_MIN_BUFFERS, GST_BC_MAX_BUFFERS, PROP_DEF_QUEUE_SIZE,
           G_PARAM_READWRITE));
+
+  /**
+   * GstBufferClassSink:pool-buffers
+   *
+   * Number of buffers currently allocated in the pool
+   */
+  g_object_class_install_property (gobject_class, PROP_POOL_BUFFERS,
+      g_param_spec_uint ("pool-buffers", "Pool buffers",
+          "Number of buffers currently allocated in the pool",
+          0, MAX_VIDEO_BUFFERS_PER_CHANNEL, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:pool-high-water
+   *
+   * Most buffers ever out of the pool at the same time
+   */
+  g_object_class_install_property (gobject_class, PROP_POOL_HIGH_WATER,
+      g_param_spec_uint ("pool-high-water", "Pool high water mark",
+          "Most buffers ever out of the pool at the same time",
+          0, MAX_VIDEO_BUFFERS_PER_CHANNEL, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:copy-threads
+   *
+   * Worker threads used to copy frames not allocated from the pool; a
+   * change takes effect with the next copied frame
+   */
+  g_object_class_install_property (gobject_class, PROP_COPY_THREADS,
+      g_param_spec_uint ("copy-threads", "Copy threads",
+          "Worker threads for copying frames not allocated by the sink "
+          "(0 = one per additional cpu)", 0, 8, 0, G_PARAM_READWRITE));
+
+  /**
+   * GstBufferClassSink:slow-path-copies
+   *
+   * Number of frames that had to be copied into the pool
+   */
+  g_object_class_install_property (gobject_class, PROP_SLOW_PATH_COPIES,
+      g_param_spec_uint64 ("slow-path-copies", "Slow path copies",
+          "Number of frames copied because upstream did not use the sink's buffers",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_SLOW_PATH_BYTES,
+      g_param_spec_uint64 ("slow-path-bytes", "Slow path bytes",
+          "Number of bytes copied because upstream did not use the sink's buffers",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:frames-imported
+   *
+   * Number of upstream frames rendered in place from their own physically
+   * contiguous memory instead of being copied
+   */
+  g_object_class_install_property (gobject_class, PROP_FRAMES_IMPORTED,
+      g_param_spec_uint64 ("frames-imported", "Frames imported",
+          "Number of upstream frames rendered without a copy from their own contiguous memory",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:frames-submitted
+   *
+   * Number of frames sent to the compositor
+   */
+  g_object_class_install_property (gobject_class, PROP_FRAMES_SUBMITTED,
+      g_param_spec_uint64 ("frames-submitted", "Frames submitted",
+          "Number of frames sent to the compositor",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:frames-presented
+   *
+   * Number of frames the compositor reported as shown
+   */
+  g_object_class_install_property (gobject_class, PROP_FRAMES_PRESENTED,
+      g_param_spec_uint64 ("frames-presented", "Frames presented",
+          "Number of frames the compositor put on the screen",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:frames-skipped
+   *
+   * Number of frames the compositor replaced before drawing them
+   */
+  g_object_class_install_property (gobject_class, PROP_FRAMES_SKIPPED,
+      g_param_spec_uint64 ("frames-skipped", "Frames skipped",
+          "Number of frames the compositor replaced by a newer one before drawing them",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:pool-empty-waits
+   *
+   * Number of times a buffer request had to wait for the compositor
+   */
+  g_object_class_install_property (gobject_class, PROP_POOL_EMPTY_WAITS,
+      g_param_spec_uint64 ("pool-empty-waits", "Pool empty waits",
+          "Number of buffer requests that waited for the compositor to release a buffer",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:write-latency-max
+   *
+   * Longest time spent sending a frame to the compositor, in nanoseconds
+   */
+  g_object_class_install_property (gobject_class, PROP_WRITE_LATENCY_MAX,
+      g_param_spec_uint64 ("write-latency-max", "Maximum write latency",
+          "Longest time spent sending a frame to the compositor (ns)",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:write-blocked-time
+   *
+   * Total time spent sending frames to the compositor, in nanoseconds
+   */
+  g_object_class_install_property (gobject_class, PROP_WRITE_BLOCKED_TIME,
+      g_param_spec_uint64 ("write-blocked-time", "Write blocked time",
+          "Total time spent sending frames to the compositor (ns)",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:buffers-outstanding
+   *
+   * Frames sent to the compositor that it has not reported on yet
+   */
+  g_object_class_install_property (gobject_class, PROP_BUFFERS_OUTSTANDING,
+      g_param_spec_uint ("buffers-outstanding", "Buffers outstanding",
+          "Frames sent to the compositor that it has not shown or skipped yet",
+          0, G_MAXUINT, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:stats-interval
+   *
+   * Post a "gpuvsink-stats" element message with the counters above every
+   * so many milliseconds while streaming. 0 disables the messages.
+   */
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Statistics interval",
+          "Milliseconds between gpuvsink-stats bus messages (0 = disabled)",
+          0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+  /**
+   * GstBufferClassSink:persistent-pool
+   *
+   * Keep the buffers and the compositor channel when going to NULL. The next
+   * sink of the process on the same channel takes them over if its caps are
+   * the same, and shows its first frame without any reconfiguration.
+   */
+  g_object_class_install_property (gobject_class, PROP_PERSISTENT_POOL,
+      g_param_spec_boolean ("persistent-pool", "Persistent pool",
+          "Keep the buffer pool and the compositor channel registered for "
+          "the next pipeline on this channel", FALSE, G_PARAM_READWRITE));
+
+  /**
+   * GstBufferClassSink:display-latency
+   *
+   * Time from a frame being rendered to it reaching the display, as
+   * measured by the compositor: the send, the wait for its render loop,
+   * the GPU's deferred rendering and the flip at the next vsync.
+   */
+  g_object_class_install_property (gobject_class, PROP_DISPLAY_LATENCY,
+      g_param_spec_uint64 ("display-latency", "Display latency",
+          "Measured time from render to scanout in nanoseconds (0 = not known yet)",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  /**
+   * GstBufferClassSink:auto-render-delay
+   *
+   * Set render-delay to the display latency, so that frames are handed to
+   * the compositor early enough to be on screen at their timestamp; the
+   * pipeline latency grows by the same amount. The delay is at most
+   * GST_BC_MAX_RENDER_DELAY_FRAMES frame durations. Setting render-delay
+   * turns this off.
+   */
+  g_object_class_install_property (gobject_class, PROP_AUTO_RENDER_DELAY,
+      g_param_spec_boolean ("auto-render-delay", "Automatic render delay",
+          "Keep render-delay at the display latency measured by the compositor",
+          TRUE, G_PARAM_READWRITE));
+
+  /**
+   * GstBufferClassSink:memory-type
+   *
+   * CPU caching of the pool buffers. Cached memory is much faster for
+   * software decoders, which read back what they write, and is written
+   * back before each frame is shown; frames written by a DMA engine are
+   * better off in uncached memory, which needs no write-back. "auto" uses
+   * uncached memory when upstream is a hardware element. Applies to the
+   * next pool.
+   */
+  g_object_class_install_property (gobject_class, PROP_MEMORY_TYPE,
+      g_param_spec_enum ("memory-type", "Memory type",
+          "CPU caching of the buffers handed to upstream",
+          GST_TYPE_BC_MEMORY_TYPE, GST_BC_MEMORY_AUTO, G_PARAM_READWRITE));
   
   /**
    * GstBufferClassSink::init:
@@ -294,6 +538,21 @@ g_object_class_install_property (gobject_class, PROP_CROP_HEIGHT,
   basesink_class->render = GST_DEBUG_FUNCPTR (gst_render_bridge_show_frame);
 }
 
+/* render-delay set by the application, basesink itself sets it without
+   a notification: it is no longer kept at the display latency */
+static void
+gst_render_bridge_render_delay_set (GObject * object, GParamSpec * pspec,
+    gpointer data)
+{
+  GstBufferClassSink *gpuvsink = GST_BCSINK (object);
+
+  GST_OBJECT_LOCK (gpuvsink);
+  if (gpuvsink->auto_render_delay)
+    GST_DEBUG_OBJECT (gpuvsink, "render-delay set, no longer automatic");
+  gpuvsink->auto_render_delay = FALSE;
+  GST_OBJECT_UNLOCK (gpuvsink);
+}
+
 static void
 gst_render_bridge_init (GstBufferClassSink * gpuvsink, GstBufferClassSinkClass * klass)
 {
@@ -311,7 +570,8 @@ gst_render_bridge_init (GstBufferClassSink * gpuvsink, GstBufferClassSinkClass *
   gpuvsink->channel_no = VID_GPUVSINK_CHANNEL_NO;
   gpuvsink->videoConfig.overlayongfx = VID_OVERLAYONGFX;
   gpuvsink->videoConfig.in.rotate = VID_GPUVSINK_ROTATE;
-  strcpy(gpuvsink->video_config_fifo,VIDEO_CONFIG_AND_DATA_FIFO_NAME);
+  gpuvsink->fd_video_cfg = -1;
+  gpuvsink->pool_lock = g_mutex_new ();
   gpuvsink->bcbuf_prev1 = NULL;
   gpuvsink->bcbuf_prev2 = NULL;
   gpuvsink->bcbuf_prev3 = NULL;
@@ -321,6 +581,33 @@ gst_render_bridge_init (GstBufferClassSink * gpuvsink, GstBufferClassSinkClass *
   gpuvsink->videoConfig.in.crop_y = 0;
   gpuvsink->videoConfig.in.crop_width = 0;
   gpuvsink->videoConfig.in.crop_height = 0;
+  gpuvsink->copier = NULL;
+  gpuvsink->copy_threads = 0;
+  gpuvsink->copier_threads = 0;
+  gpuvsink->slow_path_copies = 0;
+  gpuvsink->slow_path_bytes = 0;
+  gst_bc_import_reset (&gpuvsink->import);
+  gpuvsink->frames_imported = 0;
+  gpuvsink->status_thread = NULL;
+  gpuvsink->status_wake[0] = gpuvsink->status_wake[1] = -1;
+  gpuvsink->persistent_pool = FALSE;
+  gpuvsink->display_latency = 0;
+  gpuvsink->auto_render_delay = TRUE;
+  gpuvsink->memory_type = GST_BC_MEMORY_AUTO;
+  gpuvsink->frame_duration = GST_CLOCK_TIME_NONE;
+  gpuvsink->pending_skips = 0;
+  gpuvsink->qos_proportion = 1.0;
+  gpuvsink->frames_presented = 0;
+  gpuvsink->frames_skipped = 0;
+  gpuvsink->frames_submitted = 0;
+  gpuvsink->pool_empty_waits = 0;
+  gpuvsink->write_latency_max = 0;
+  gpuvsink->write_blocked_time = 0;
+  gpuvsink->stats_interval = 0;
+  gpuvsink->last_stats_us = 0;
+
+  g_signal_connect (gpuvsink, "notify::render-delay",
+      G_CALLBACK (gst_render_bridge_render_delay_set), NULL);
 }
 
 static void
@@ -339,9 +626,66 @@ gst_render_bridge_finalize (GstBufferClassSink * gpuvsink)
     gst_mini_object_unref (GST_MINI_OBJECT (gpuvsink->pool));
     gpuvsink->pool = NULL;
   }
+  gst_frame_copier_free (gpuvsink->copier);
+  gpuvsink->copier = NULL;
+  g_mutex_free (gpuvsink->pool_lock);
+  gpuvsink->pool_lock = NULL;
   G_OBJECT_CLASS (parent_class)->finalize ((GObject *) (gpuvsink));
 }
 
+/*
+ * Push the display properties to a running channel. The compositor only
+ * moves the plane and changes its texture coordinates, the buffers stay
+ * registered, so this is cheap enough to do on every frame. Called with
+ * the pool lock held: the streaming thread may replace the pool meanwhile.
+ */
+static void
+gst_render_bridge_send_geometry (GstBufferClassSink * gpuvsink)
+{
+  GstBufferClassBufferPool *pool = gpuvsink->pool;
+  videoConfig_s cfg;
+  gint crop_w, crop_h;
+
+  if (!pool || gpuvsink->fd_video_cfg < 0)
+    return;
+
+  crop_w = gpuvsink->videoConfig.in.crop_width ?
+      gpuvsink->videoConfig.in.crop_width : pool->width;
+  crop_h = gpuvsink->videoConfig.in.crop_height ?
+      gpuvsink->videoConfig.in.crop_height : pool->height;
+  if (gpuvsink->videoConfig.in.crop_x + crop_w > pool->width ||
+      gpuvsink->videoConfig.in.crop_y + crop_h > pool->height) {
+    GST_WARNING_OBJECT (gpuvsink, "crop window %dx%d+%d+%d outside the "
+        "%dx%d frame, ignored", crop_w, crop_h,
+        gpuvsink->videoConfig.in.crop_x, gpuvsink->videoConfig.in.crop_y,
+        pool->width, pool->height);
+    return;
+  }
+
+  /* the pool config is what later reconfigurations announce */
+  GST_BCBUFFERPOOL_LOCK (pool);
+  pool->config.out = gpuvsink->videoConfig.out;
+  pool->config.in.rotate = gpuvsink->videoConfig.in.rotate;
+  pool->config.in.crop_x = gpuvsink->videoConfig.in.crop_x;
+  pool->config.in.crop_y = gpuvsink->videoConfig.in.crop_y;
+  pool->config.in.crop_width = crop_w;
+  pool->config.in.crop_height = crop_h;
+  cfg = pool->config;
+  GST_BCBUFFERPOOL_UNLOCK (pool);
+
+  cfg.config_data = VID_MSG_GEOMETRY;
+  if (!gst_comp_link_send (gpuvsink->fd_video_cfg, &cfg, NULL, 0))
+    GST_WARNING_OBJECT (gpuvsink, "failed to send the new geometry");
+}
+
+static void
+gst_render_bridge_update_geometry (GstBufferClassSink * gpuvsink)
+{
+  g_mutex_lock (gpuvsink->pool_lock);
+  gst_render_bridge_send_geometry (gpuvsink);
+  g_mutex_unlock (gpuvsink->pool_lock);
+}
+
 static void
 gst_render_bridge_set_property (GObject * object,
     guint prop_id, const GValue * value, GParamSpec * pspec)
@@ -353,11 +697,12 @@ gst_render_bridge_set_property (GObject * object,
       break;
 
     case PROP_CHANNEL_NO:
-         gpuvsink->channel_no = g_value_get_uint (value);
-         if (gpuvsink->channel_no < 0 || gpuvsink->channel_no > (MAX_GFX_PLANES-1)) {
-             printf (" Invalid Channel Number: %d   <Valid Range: 0 to MAX_GFX_PLANES> \n", gpuvsink->channel_no);
+         gpuvsink->channel_no = g_value_get_int (value);
+         if (gpuvsink->channel_no < -1 || gpuvsink->channel_no > (MAX_VID_PLANES-1)) {
+             printf (" Invalid Channel Number: %d   <Valid Range: -1 (any) to MAX_VID_PLANES-1> \n", gpuvsink->channel_no);
              exit (0);
          }
+         gpuvsink->channel_auto = FALSE;
          break;
 
     case PROP_XPOS:
@@ -400,13 +745,61 @@ gst_render_bridge_set_property (GObject * object,
         gpuvsink->videoConfig.in.crop_height = g_value_get_uint (value);
         break;
 
+    case  PROP_COPY_THREADS:
+        gpuvsink->copy_threads = g_value_get_uint (value);
+        break;
+
+    case  PROP_STATS_INTERVAL:
+        gpuvsink->stats_interval = g_value_get_uint (value);
+        break;
+
+    case  PROP_PERSISTENT_POOL:
+        gpuvsink->persistent_pool = g_value_get_boolean (value);
+        break;
+
+    case  PROP_MEMORY_TYPE:
+        gpuvsink->memory_type = g_value_get_enum (value);
+        break;
+
+    case  PROP_AUTO_RENDER_DELAY:
+        GST_OBJECT_LOCK (gpuvsink);
+        gpuvsink->auto_render_delay = g_value_get_boolean (value);
+        GST_OBJECT_UNLOCK (gpuvsink);
+        break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
     }
+
+  switch (prop_id) {
+    case PROP_XPOS:
+    case PROP_YPOS:
+    case PROP_WIDTH:
+    case PROP_HEIGHT:
+    case PROP_ROTATE:
+    case PROP_CROP_X:
+    case PROP_CROP_Y:
+    case PROP_CROP_WIDTH:
+    case PROP_CROP_HEIGHT:
+      gst_render_bridge_update_geometry (gpuvsink);
+      break;
+    default:
+      break;
+  }
 }
 
 
+/* Frames the compositor has neither shown nor skipped yet; object lock held */
+static guint
+gst_render_bridge_outstanding (GstBufferClassSink * gpuvsink)
+{
+  guint64 reported = gpuvsink->frames_presented + gpuvsink->frames_skipped;
+
+  return reported < gpuvsink->frames_submitted ?
+      (guint) (gpuvsink->frames_submitted - reported) : 0;
+}
+
 static void
 gst_render_bridge_get_property (GObject * object,
     guint prop_id, GValue * value, GParamSpec * pspec)
@@ -417,6 +810,146 @@ gst_render_bridge_get_property (GObject * object,
       g_value_set_uint (value, gpuvsink->num_buffers);
       break;
     }
+    case PROP_CHANNEL_NO:{
+      g_value_set_int (value, gpuvsink->channel_no);
+      break;
+    }
+    case PROP_XPOS:{
+      g_value_set_float (value, gpuvsink->videoConfig.out.xpos);
+      break;
+    }
+    case PROP_YPOS:{
+      g_value_set_float (value, gpuvsink->videoConfig.out.ypos);
+      break;
+    }
+    case PROP_WIDTH:{
+      g_value_set_float (value, gpuvsink->videoConfig.out.width);
+      break;
+    }
+    case PROP_HEIGHT:{
+      g_value_set_float (value, gpuvsink->videoConfig.out.height);
+      break;
+    }
+    case PROP_ROTATE:{
+      g_value_set_float (value, gpuvsink->videoConfig.in.rotate);
+      break;
+    }
+    case PROP_OVERLAYONGFX:{
+      g_value_set_uint (value, gpuvsink->videoConfig.overlayongfx);
+      break;
+    }
+    case PROP_CROP_X:{
+      g_value_set_uint (value, gpuvsink->videoConfig.in.crop_x);
+      break;
+    }
+    case PROP_CROP_Y:{
+      g_value_set_uint (value, gpuvsink->videoConfig.in.crop_y);
+      break;
+    }
+    case PROP_CROP_WIDTH:{
+      g_value_set_uint (value, gpuvsink->videoConfig.in.crop_width);
+      break;
+    }
+    case PROP_CROP_HEIGHT:{
+      g_value_set_uint (value, gpuvsink->videoConfig.in.crop_height);
+      break;
+    }
+    case PROP_COPY_THREADS:{
+      g_value_set_uint (value, gpuvsink->copy_threads);
+      break;
+    }
+    case PROP_STATS_INTERVAL:{
+      g_value_set_uint (value, gpuvsink->stats_interval);
+      break;
+    }
+    case PROP_PERSISTENT_POOL:{
+      g_value_set_boolean (value, gpuvsink->persistent_pool);
+      break;
+    }
+    case PROP_DISPLAY_LATENCY:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->display_latency);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_MEMORY_TYPE:{
+      g_value_set_enum (value, gpuvsink->memory_type);
+      break;
+    }
+    case PROP_AUTO_RENDER_DELAY:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_boolean (value, gpuvsink->auto_render_delay);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_FRAMES_SUBMITTED:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->frames_submitted);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_FRAMES_PRESENTED:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->frames_presented);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_FRAMES_SKIPPED:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->frames_skipped);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_POOL_EMPTY_WAITS:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->pool_empty_waits);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_WRITE_LATENCY_MAX:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->write_latency_max);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_WRITE_BLOCKED_TIME:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->write_blocked_time);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_BUFFERS_OUTSTANDING:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint (value, gst_render_bridge_outstanding (gpuvsink));
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_SLOW_PATH_COPIES:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->slow_path_copies);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_FRAMES_IMPORTED:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->frames_imported);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
+    case PROP_POOL_BUFFERS:{
+      g_value_set_uint (value, gpuvsink->pool ? gpuvsink->pool->num_buffers : 0);
+      break;
+    }
+    case PROP_POOL_HIGH_WATER:{
+      g_value_set_uint (value, gpuvsink->pool ? gpuvsink->pool->high_water : 0);
+      break;
+    }
+    case PROP_SLOW_PATH_BYTES:{
+      GST_OBJECT_LOCK (gpuvsink);
+      g_value_set_uint64 (value, gpuvsink->slow_path_bytes);
+      GST_OBJECT_UNLOCK (gpuvsink);
+      break;
+    }
     default:{
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -425,6 +958,390 @@ gst_render_bridge_get_property (GObject * object,
 }
 
 
+static gint64
+gst_render_bridge_now_us (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * A frame made it to the screen: work out how late it was and tell
+ * upstream. Being up to one frame late is inherent to waiting for the
+ * compositor's next swap; beyond that, and for every frame the compositor
+ * overwrote before drawing it, we are producing faster than we display.
+ */
+static void
+gst_render_bridge_frame_presented (GstBufferClassSink * gpuvsink,
+    videoStatus_s * status)
+{
+  GstClockTime timestamp, duration, latency = 0, render_delay, delay;
+  GstClockTimeDiff jitter;
+  gint64 sent_us;
+  guint skipped;
+  gdouble rate, proportion;
+  gboolean auto_delay;
+
+  GST_OBJECT_LOCK (gpuvsink);
+  timestamp = gpuvsink->frame_ts[status->buf_index];
+  duration = gpuvsink->frame_dur[status->buf_index];
+  sent_us = gpuvsink->frame_sent_us[status->buf_index];
+  skipped = gpuvsink->pending_skips;
+  gpuvsink->pending_skips = 0;
+  gpuvsink->frames_presented++;
+  GST_OBJECT_UNLOCK (gpuvsink);
+
+  if (sent_us == 0)
+    return;
+
+  render_delay = gst_base_sink_get_render_delay (GST_BASE_SINK (gpuvsink));
+
+  /* The frame is due on the display at its timestamp, basesink hands it
+     over render-delay early: follow what the compositor measures */
+  if (status->scanout_us > sent_us) {
+    GST_OBJECT_LOCK (gpuvsink);
+    latency = (status->scanout_us - sent_us) * GST_USECOND;
+    if (gpuvsink->display_latency)
+      latency = (7 * gpuvsink->display_latency + latency) / 8;
+    gpuvsink->display_latency = latency;
+    auto_delay = gpuvsink->auto_render_delay;
+    GST_OBJECT_UNLOCK (gpuvsink);
+
+    /* a compositor that stalls for a while must not add its stall to the
+       pipeline latency for good */
+    delay = GST_BC_MAX_RENDER_DELAY_FRAMES *
+        (GST_CLOCK_TIME_IS_VALID (duration) && duration ? duration :
+        GST_SECOND / 30);
+    delay = MIN (latency, delay);
+
+    /* basesink posts the LATENCY message */
+    if (auto_delay && (delay > render_delay + GST_BC_LATENCY_STEP ||
+            delay + GST_BC_LATENCY_STEP < render_delay)) {
+      GST_DEBUG_OBJECT (gpuvsink, "display latency now %" GST_TIME_FORMAT
+          ", render delay %" GST_TIME_FORMAT, GST_TIME_ARGS (latency),
+          GST_TIME_ARGS (delay));
+      gst_base_sink_set_render_delay (GST_BASE_SINK (gpuvsink), delay);
+    }
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (timestamp) ||
+      !GST_CLOCK_TIME_IS_VALID (duration) || duration == 0)
+    return;
+
+  jitter = ((status->scanout_us ? status->scanout_us : status->present_us) -
+      sent_us) * GST_USECOND - render_delay;
+
+  rate = 1.0 + skipped;
+  if (jitter > (GstClockTimeDiff) duration)
+    rate += (gdouble) (jitter - duration) / duration;
+
+  GST_OBJECT_LOCK (gpuvsink);
+  gpuvsink->qos_proportion = (7.0 * gpuvsink->qos_proportion + rate) / 8.0;
+  proportion = gpuvsink->qos_proportion;
+  GST_OBJECT_UNLOCK (gpuvsink);
+
+  GST_LOG_OBJECT (gpuvsink, "frame %d at running time %" GST_TIME_FORMAT " presented, "
+      "jitter %" G_GINT64_FORMAT ", %u skipped, proportion %f",
+      status->buf_index, GST_TIME_ARGS (timestamp), jitter, skipped,
+      proportion);
+
+  if (gst_base_sink_is_qos_enabled (GST_BASE_SINK (gpuvsink)))
+    gst_pad_push_event (GST_BASE_SINK_PAD (gpuvsink),
+        gst_event_new_qos (proportion, jitter, timestamp));
+}
+
+/* Reads the frame status the compositor sends back until the link goes down */
+static gpointer
+gst_render_bridge_status_loop (gpointer data)
+{
+  GstBufferClassSink *gpuvsink = GST_BCSINK (data);
+  videoStatus_s status;
+
+  while (gst_comp_link_recv_status (gpuvsink->fd_video_cfg,
+          gpuvsink->status_wake[0], -1, &status)) {
+    if (status.status == VID_STATUS_REJECTED) {
+      GST_ELEMENT_ERROR (gpuvsink, STREAM, FORMAT,
+          ("The compositor cannot show the video buffer layout"), (NULL));
+      continue;
+    }
+    if (status.buf_index < 0 ||
+        status.buf_index >= MAX_VIDEO_BUFFERS_PER_CHANNEL)
+      continue;
+
+    switch (status.status) {
+      case VID_STATUS_PRESENTED:
+        gst_render_bridge_frame_presented (gpuvsink, &status);
+        break;
+      case VID_STATUS_SKIPPED:
+        GST_OBJECT_LOCK (gpuvsink);
+        gpuvsink->pending_skips++;
+        gpuvsink->frames_skipped++;
+        GST_OBJECT_UNLOCK (gpuvsink);
+        GST_LOG_OBJECT (gpuvsink, "frame %d skipped", status.buf_index);
+        break;
+      default:
+        break;
+    }
+  }
+
+  GST_DEBUG_OBJECT (gpuvsink, "status link closed");
+  return NULL;
+}
+
+/* Start reading the frame status of an open channel */
+static void
+gst_render_bridge_start_status (GstBufferClassSink * gpuvsink)
+{
+  GError *error = NULL;
+
+  GST_OBJECT_LOCK (gpuvsink);
+  memset (gpuvsink->frame_sent_us, 0, sizeof (gpuvsink->frame_sent_us));
+  gpuvsink->pending_skips = 0;
+  gpuvsink->qos_proportion = 1.0;
+  GST_OBJECT_UNLOCK (gpuvsink);
+
+  if (pipe (gpuvsink->status_wake) < 0) {
+    GST_WARNING_OBJECT (gpuvsink, "no frame status, QoS disabled: %s",
+        g_strerror (errno));
+    gpuvsink->status_wake[0] = gpuvsink->status_wake[1] = -1;
+    return;
+  }
+
+  gpuvsink->status_thread = g_thread_create (gst_render_bridge_status_loop,
+      gpuvsink, TRUE, &error);
+  if (!gpuvsink->status_thread) {
+    GST_WARNING_OBJECT (gpuvsink, "no frame status, QoS disabled: %s",
+        error->message);
+    g_error_free (error);
+  }
+}
+
+/* Stop the status thread, the channel itself stays open */
+static void
+gst_render_bridge_stop_status (GstBufferClassSink * gpuvsink)
+{
+  if (gpuvsink->status_thread) {
+    if (write (gpuvsink->status_wake[1], "", 1) < 0)
+      GST_WARNING_OBJECT (gpuvsink, "failed to wake the status thread");
+    g_thread_join (gpuvsink->status_thread);
+    gpuvsink->status_thread = NULL;
+  }
+  if (gpuvsink->status_wake[0] >= 0) {
+    close (gpuvsink->status_wake[0]);
+    close (gpuvsink->status_wake[1]);
+    gpuvsink->status_wake[0] = gpuvsink->status_wake[1] = -1;
+  }
+}
+
+/*
+ * Attach our video plane, or any free one if channel-no is -1; channel-no
+ * then reads back the plane the compositor picked until the channel closes.
+ */
+static gboolean
+gst_render_bridge_open_channel (GstBufferClassSink * gpuvsink)
+{
+  gint channel_no = gpuvsink->channel_no;
+  gint fd;
+
+  fd = gst_comp_link_open (&channel_no);
+  if (fd < 0)
+    return FALSE;
+
+  g_mutex_lock (gpuvsink->pool_lock);
+  gpuvsink->fd_video_cfg = fd;
+  g_mutex_unlock (gpuvsink->pool_lock);
+
+  if (gpuvsink->channel_no < 0) {
+    gpuvsink->channel_no = channel_no;
+    gpuvsink->channel_auto = TRUE;
+  }
+
+  gst_render_bridge_start_status (gpuvsink);
+  return TRUE;
+}
+
+/*
+ * Disable the video plane and drop the link to the composition module. The
+ * compositor acknowledges the close once the plane is off and the GPU is
+ * done with our buffers, so they can be freed as soon as this returns.
+ */
+static void
+gst_render_bridge_close_channel (GstBufferClassSink * gpuvsink)
+{
+  videoStatus_s status;
+  gboolean acked = FALSE;
+  gint fd = gpuvsink->fd_video_cfg;
+
+  if (fd < 0)
+    return;
+
+  gst_render_bridge_stop_status (gpuvsink);
+
+  gpuvsink->videoConfig.config_data = VID_MSG_CLOSE;
+  if (!gst_comp_link_send (fd, &gpuvsink->videoConfig, NULL, 0))
+  {
+      printf("Error in sending close to channel %d \n", gpuvsink->channel_no);
+  } else {
+    DEBUG_PRINTF ((" sending close command to channel %d is successful\n", gpuvsink->channel_no));
+
+    /* statuses of the last frames may still come first */
+    while (gst_comp_link_recv_status (fd, -1,
+            GST_BC_CLOSE_TIMEOUT_MS, &status)) {
+      if (status.status == VID_STATUS_CLOSED) {
+        acked = TRUE;
+        break;
+      }
+    }
+    if (!acked)
+      GST_WARNING_OBJECT (gpuvsink, "channel %d closed without acknowledgement",
+          gpuvsink->channel_no);
+  }
+
+  g_mutex_lock (gpuvsink->pool_lock);
+  gpuvsink->fd_video_cfg = -1;
+  g_mutex_unlock (gpuvsink->pool_lock);
+  gst_comp_link_close (fd);
+
+  if (gpuvsink->channel_auto) {
+    gpuvsink->channel_no = -1;
+    gpuvsink->channel_auto = FALSE;
+  }
+}
+
+/* Drop the pool and the frames held for the SGX */
+static void
+gst_render_bridge_release_pool (GstBufferClassSink * gpuvsink)
+{
+  GstBufferClassBufferPool *pool = gpuvsink->pool;
+
+  if (pool) {
+    g_mutex_lock (gpuvsink->pool_lock);
+    gpuvsink->pool = NULL;
+    g_mutex_unlock (gpuvsink->pool_lock);
+    gst_buffer_manager_dispose (pool);
+
+    if (gpuvsink->bcbuf_prev5 != NULL)
+      gst_buffer_unref (gpuvsink->bcbuf_prev5);
+    if (gpuvsink->bcbuf_prev4 != NULL)
+      gst_buffer_unref (gpuvsink->bcbuf_prev4);
+    if (gpuvsink->bcbuf_prev3 != NULL)
+      gst_buffer_unref (gpuvsink->bcbuf_prev3);
+    if (gpuvsink->bcbuf_prev2 != NULL)
+      gst_buffer_unref (gpuvsink->bcbuf_prev2);
+    if (gpuvsink->bcbuf_prev1 != NULL)
+      gst_buffer_unref (gpuvsink->bcbuf_prev1); 
+
+    gpuvsink->bcbuf_prev5 = NULL;
+    gpuvsink->bcbuf_prev4 = NULL;
+    gpuvsink->bcbuf_prev3 = NULL;
+    gpuvsink->bcbuf_prev2 = NULL;
+    gpuvsink->bcbuf_prev1 = NULL;
+  }
+}
+
+/*
+ * Leave the channel open with its pool and last frames for the next sink
+ * on the channel. The plane keeps showing the last frame meanwhile.
+ */
+static gboolean
+gst_render_bridge_park_channel (GstBufferClassSink * gpuvsink)
+{
+  GstBufferClassParkedChannel *pc = &parked_channels[gpuvsink->channel_no];
+
+  /* the next sink only finds a channel it asks for by number */
+  if (!gpuvsink->pool || gpuvsink->fd_video_cfg < 0 || gpuvsink->channel_auto)
+    return FALSE;
+
+  pthread_mutex_lock (&parkmutex);
+  if (pc->pool) {
+    pthread_mutex_unlock (&parkmutex);
+    return FALSE;
+  }
+
+  gst_render_bridge_stop_status (gpuvsink);
+
+  GST_BCBUFFERPOOL_LOCK (gpuvsink->pool);
+  gpuvsink->pool->elem = NULL;
+  GST_BCBUFFERPOOL_UNLOCK (gpuvsink->pool);
+
+  pc->pool = gpuvsink->pool;
+  pc->fd = gpuvsink->fd_video_cfg;
+  pc->held[0] = gpuvsink->bcbuf_prev1;
+  pc->held[1] = gpuvsink->bcbuf_prev2;
+  pc->held[2] = gpuvsink->bcbuf_prev3;
+  pc->held[3] = gpuvsink->bcbuf_prev4;
+  pc->held[4] = gpuvsink->bcbuf_prev5;
+  pthread_mutex_unlock (&parkmutex);
+
+  GST_DEBUG_OBJECT (gpuvsink, "parked channel %d with %d buffers",
+      gpuvsink->channel_no, pc->pool->num_buffers);
+
+  g_mutex_lock (gpuvsink->pool_lock);
+  gpuvsink->pool = NULL;
+  gpuvsink->fd_video_cfg = -1;
+  g_mutex_unlock (gpuvsink->pool_lock);
+  gpuvsink->bcbuf_prev1 = NULL;
+  gpuvsink->bcbuf_prev2 = NULL;
+  gpuvsink->bcbuf_prev3 = NULL;
+  gpuvsink->bcbuf_prev4 = NULL;
+  gpuvsink->bcbuf_prev5 = NULL;
+  return TRUE;
+}
+
+/*
+ * Take over a channel parked by a previous sink. Returns TRUE if its pool
+ * fits the caps; otherwise the parked channel is closed like at a normal
+ * stop and FALSE is returned.
+ */
+static gboolean
+gst_render_bridge_unpark_channel (GstBufferClassSink * gpuvsink, GstCaps * caps,
+    guint min_size)
+{
+  GstBufferClassParkedChannel *pc;
+
+  if (gpuvsink->channel_no < 0)
+    return FALSE;
+
+  pc = &parked_channels[gpuvsink->channel_no];
+  pthread_mutex_lock (&parkmutex);
+  if (!pc->pool) {
+    pthread_mutex_unlock (&parkmutex);
+    return FALSE;
+  }
+
+  g_mutex_lock (gpuvsink->pool_lock);
+  gpuvsink->pool = pc->pool;
+  gpuvsink->fd_video_cfg = pc->fd;
+  g_mutex_unlock (gpuvsink->pool_lock);
+  gpuvsink->bcbuf_prev1 = pc->held[0];
+  gpuvsink->bcbuf_prev2 = pc->held[1];
+  gpuvsink->bcbuf_prev3 = pc->held[2];
+  gpuvsink->bcbuf_prev4 = pc->held[3];
+  gpuvsink->bcbuf_prev5 = pc->held[4];
+  pc->pool = NULL;
+  pthread_mutex_unlock (&parkmutex);
+
+  GST_BCBUFFERPOOL_LOCK (gpuvsink->pool);
+  gpuvsink->pool->elem = GST_ELEMENT (gpuvsink);
+  GST_BCBUFFERPOOL_UNLOCK (gpuvsink->pool);
+
+  if (gpuvsink->persistent_pool && gst_caps_is_equal (gpuvsink->pool->caps, caps) &&
+      (guint) gpuvsink->pool->buf_size >= min_size) {
+    GST_DEBUG_OBJECT (gpuvsink, "took over parked channel %d",
+        gpuvsink->channel_no);
+    gst_render_bridge_start_status (gpuvsink);
+    return TRUE;
+  }
+
+  GST_DEBUG_OBJECT (gpuvsink, "parked channel %d does not fit, closing it",
+      gpuvsink->channel_no);
+  gst_render_bridge_close_channel (gpuvsink);
+  gst_render_bridge_release_pool (gpuvsink);
+  return FALSE;
+}
+
 static GstStateChangeReturn
 gst_render_bridge_change_state (GstElement * element, GstStateChange transition)
 {
@@ -453,26 +1370,10 @@ gst_render_bridge_change_state (GstElement * element, GstStateChange transition)
     }
     case GST_STATE_CHANGE_READY_TO_NULL:{
       g_signal_emit (gpuvsink, signals[SIG_CLOSE], 0);
-      if (gpuvsink->pool) {
-        gst_buffer_manager_dispose (gpuvsink->pool);
-        gpuvsink->pool = NULL;
-
-        if (gpuvsink->bcbuf_prev5 != NULL)
-          gst_buffer_unref (gpuvsink->bcbuf_prev5);
-        if (gpuvsink->bcbuf_prev4 != NULL)
-          gst_buffer_unref (gpuvsink->bcbuf_prev4);
-        if (gpuvsink->bcbuf_prev3 != NULL)
-          gst_buffer_unref (gpuvsink->bcbuf_prev3);
-        if (gpuvsink->bcbuf_prev2 != NULL)
-          gst_buffer_unref (gpuvsink->bcbuf_prev2);
-        if (gpuvsink->bcbuf_prev1 != NULL)
-          gst_buffer_unref (gpuvsink->bcbuf_prev1); 
-
-        gpuvsink->bcbuf_prev5 = NULL;
-        gpuvsink->bcbuf_prev4 = NULL;
-        gpuvsink->bcbuf_prev3 = NULL;
-        gpuvsink->bcbuf_prev2 = NULL;
-        gpuvsink->bcbuf_prev1 = NULL;
+      if (!gpuvsink->persistent_pool ||
+          !gst_render_bridge_park_channel (gpuvsink)) {
+        gst_render_bridge_close_channel (gpuvsink);
+        gst_render_bridge_release_pool (gpuvsink);
       }
       break;
     }
@@ -486,10 +1387,95 @@ gst_render_bridge_change_state (GstElement * element, GstStateChange transition)
   return ret;
 }
 
+/*
+ * Number of buffers to start the pool with: the frames held for the SGX,
+ * the one being rendered and the frames upstream keeps in flight according
+ * to its latency. The pool grows from there if that turns out too few.
+ */
+static guint
+gst_render_bridge_initial_buffers (GstBufferClassSink * gpuvsink, GstCaps * caps)
+{
+  GstQuery *query;
+  gboolean live;
+  GstClockTime min_latency, max_latency;
+  gint fps_n, fps_d;
+  guint frames = 0, count;
+
+  query = gst_query_new_latency ();
+  if (gst_pad_peer_query (GST_BASE_SINK_PAD (gpuvsink), query)) {
+    gst_query_parse_latency (query, &live, &min_latency, &max_latency);
+    if (GST_CLOCK_TIME_IS_VALID (min_latency) &&
+        gst_video_parse_caps_framerate (caps, &fps_n, &fps_d) &&
+        fps_n > 0 && fps_d > 0)
+      frames = gst_util_uint64_scale (min_latency, fps_n,
+          fps_d * GST_SECOND) + 1;
+    GST_DEBUG_OBJECT (gpuvsink, "upstream latency %" GST_TIME_FORMAT
+        " is %u frames", GST_TIME_ARGS (min_latency), frames);
+  }
+  gst_query_unref (query);
+
+  count = GST_BC_HOLD_BUFFERS + 1 + frames;
+  return CLAMP (count, GST_BC_MIN_BUFFERS, gpuvsink->num_buffers);
+}
+
+/*
+ * Whether the next pool is CPU cached. Upstream elements that write frames
+ * with a DMA engine say "Hardware" in their class by GStreamer convention;
+ * anything else is taken to be the CPU.
+ */
 static gboolean
-gst_render_bridge_set_caps (GstBaseSink * bsink, GstCaps * caps)
+gst_render_bridge_cached_memory (GstBufferClassSink * gpuvsink)
 {
-  GstBufferClassSink *gpuvsink = GST_BCSINK (bsink);
+  GstPad *peer;
+  GstElement *upstream;
+  GstElementFactory *factory;
+  gboolean cached = TRUE;
+
+  if (gpuvsink->memory_type != GST_BC_MEMORY_AUTO)
+    return gpuvsink->memory_type == GST_BC_MEMORY_CACHED;
+
+  peer = gst_pad_get_peer (GST_BASE_SINK_PAD (gpuvsink));
+  if (peer) {
+    upstream = gst_pad_get_parent_element (peer);
+    if (upstream) {
+      factory = gst_element_get_factory (upstream);
+      if (factory && strstr (gst_element_factory_get_klass (factory), "Hardware"))
+        cached = FALSE;
+      gst_object_unref (upstream);
+    }
+    gst_object_unref (peer);
+  }
+
+  GST_DEBUG_OBJECT (gpuvsink, "allocating %s buffers",
+      cached ? "cached" : "uncached");
+  return cached;
+}
+
+/* Frame duration for buffers without one, from the caps framerate */
+static void
+gst_render_bridge_set_frame_duration (GstBufferClassSink * gpuvsink,
+    GstCaps * caps)
+{
+  gint fps_n, fps_d;
+
+  GST_OBJECT_LOCK (gpuvsink);
+  if (gst_video_parse_caps_framerate (caps, &fps_n, &fps_d) && fps_n > 0)
+    gpuvsink->frame_duration =
+        gst_util_uint64_scale_int (GST_SECOND, fps_d, fps_n);
+  else
+    gpuvsink->frame_duration = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (gpuvsink);
+}
+
+/*
+ * Set up the pool for @caps, with buffers of at least @min_size bytes
+ * (see gst_buffer_manager_new()); an existing pool that fits is kept.
+ */
+static gboolean
+gst_render_bridge_configure (GstBufferClassSink * gpuvsink, GstCaps * caps,
+    guint min_size)
+{
+  GstBufferClassBufferPool *old_pool, *pool;
 
   g_return_val_if_fail (caps, FALSE);
   g_return_val_if_fail (gst_caps_is_fixed (caps), FALSE);
@@ -499,7 +1485,8 @@ gst_render_bridge_set_caps (GstBaseSink * bsink, GstCaps * caps)
 
     GST_DEBUG_OBJECT (gpuvsink, "already have caps: %" GST_PTR_FORMAT,
         current_caps);
-    if (gst_caps_is_equal (current_caps, caps)) {
+    if (gst_caps_is_equal (current_caps, caps) &&
+        (guint) gpuvsink->pool->buf_size >= min_size) {
       GST_DEBUG_OBJECT (gpuvsink, "they are equal!");
       gst_caps_unref (current_caps);
       return TRUE;
@@ -507,34 +1494,69 @@ gst_render_bridge_set_caps (GstBaseSink * bsink, GstCaps * caps)
 
     gst_caps_unref (current_caps);
     GST_DEBUG_OBJECT (gpuvsink, "new caps are different: %" GST_PTR_FORMAT, caps);
-
-    // TODO
-    GST_DEBUG_OBJECT (bsink, "reallocating buffers not implemented yet");
-    g_return_val_if_fail (0, FALSE);
   }
 
   GST_DEBUG_OBJECT (gpuvsink,
       "constructing bufferpool with caps: %" GST_PTR_FORMAT, caps);
 
-  gpuvsink->pool =
-      gst_buffer_manager_new (GST_ELEMENT (gpuvsink), gpuvsink->videoConfig,
-      gpuvsink->num_buffers, caps);
+  if (gpuvsink->fd_video_cfg < 0 &&
+      gst_render_bridge_unpark_channel (gpuvsink, caps, min_size))
+  {
+    /* same buffers as the previous sink: nothing to tell the compositor
+       beyond where this one wants the plane */
+    gst_render_bridge_update_geometry (gpuvsink);
+    gst_render_bridge_set_frame_duration (gpuvsink, caps);
+    gst_bc_import_reset (&gpuvsink->import);
+    g_signal_emit (gpuvsink, signals[SIG_INIT], 0, gpuvsink->pool->num_buffers);
+    return TRUE;
+  }
 
-  if (!gpuvsink->pool) {
-	return FALSE;
-}
-  if (gpuvsink->num_buffers != gpuvsink->pool->num_buffers) {
-    GST_DEBUG_OBJECT (gpuvsink, "asked for %d buffers, got %d instead",
-        gpuvsink->num_buffers, gpuvsink->pool->num_buffers);
-    gpuvsink->num_buffers = gpuvsink->pool->num_buffers;
-    g_object_notify (G_OBJECT (gpuvsink), "queue-size");
+  if (gpuvsink->fd_video_cfg < 0 && !gst_render_bridge_open_channel (gpuvsink))
+  {
+    printf (" Failed to attach video channel %d\n", gpuvsink->channel_no);
+    exit(0);
   }
 
-  g_signal_emit (gpuvsink, signals[SIG_INIT], 0, gpuvsink->num_buffers);
+  /* On renegotiation the new pool is announced to the compositor as a
+   * reconfiguration of the open channel, which keeps the last frame on
+   * screen until the first new one arrives. The old pool is only stopped:
+   * its memory goes away with the last buffer still held upstream or in
+   * the hold chain below.
+   */
+  old_pool = gpuvsink->pool;
+  pool = gst_buffer_manager_new (GST_ELEMENT (gpuvsink), gpuvsink->videoConfig,
+      gst_render_bridge_initial_buffers (gpuvsink, caps),
+      gpuvsink->num_buffers, caps, min_size,
+      gst_render_bridge_cached_memory (gpuvsink));
+
+  if (!pool)
+    return FALSE;
+
+  g_mutex_lock (gpuvsink->pool_lock);
+  gpuvsink->pool = pool;
+  g_mutex_unlock (gpuvsink->pool_lock);
+
+  if (old_pool)
+    gst_buffer_manager_dispose (old_pool);
+
+  gst_render_bridge_set_frame_duration (gpuvsink, caps);
+  gst_bc_import_reset (&gpuvsink->import);
+
+  g_signal_emit (gpuvsink, signals[SIG_INIT], 0, gpuvsink->pool->num_buffers);
 
   return TRUE;
 }
 
+static gboolean
+gst_render_bridge_set_caps (GstBaseSink * bsink, GstCaps * caps)
+{
+  GstBufferClassSink *gpuvsink = GST_BCSINK (bsink);
+
+  /* upstream may send other buffers now, even with the same caps */
+  gst_bc_import_retry (&gpuvsink->import);
+  return gst_render_bridge_configure (gpuvsink, caps, 0);
+}
+
 /** buffer alloc function to implement pad_alloc for upstream element */
 static GstFlowReturn
 gst_render_bridge_buffer_alloc (GstBaseSink * bsink, guint64 offset, guint size,
@@ -544,16 +1566,28 @@ gst_render_bridge_buffer_alloc (GstBaseSink * bsink, guint64 offset, guint size,
 
   if (G_UNLIKELY (!gpuvsink->pool)) {
     /* it's possible caps haven't been set yet: */
-    gst_render_bridge_set_caps (bsink, caps);
+    gst_render_bridge_configure (gpuvsink, caps, size);
     if (!gpuvsink->pool)
       return GST_FLOW_ERROR;
+  } else if (G_UNLIKELY (caps && !gst_caps_is_equal (gpuvsink->pool->caps, caps))) {
+    /* upstream is about to switch format: hand out buffers of the new one */
+    if (!gst_render_bridge_configure (gpuvsink, caps, size))
+      return GST_FLOW_ERROR;
+  } else if (G_UNLIKELY (size > (guint) gpuvsink->pool->buf_size)) {
+    /* a decoder that needs larger buffers: lay the pool out again */
+    GstCaps *current_caps = gst_buffer_manager_get_caps (gpuvsink->pool);
+    gboolean ok = gst_render_bridge_configure (gpuvsink, current_caps, size);
+
+    gst_caps_unref (current_caps);
+    if (!ok)
+      return GST_FLOW_ERROR;
   }
 
   *buf = GST_BUFFER (gst_buffer_manager_get (gpuvsink->pool));
 
  // printf ("gpuvsink: allocated a buffer 0x%x \n", GST_BUFFER_DATA(*buf));
 
-  if (G_LIKELY (buf)) {
+  if (G_LIKELY (*buf)) {
     GST_DEBUG_OBJECT (gpuvsink, "allocated buffer: %p", *buf);
     return GST_FLOW_OK;
   }
@@ -562,6 +1596,111 @@ gst_render_bridge_buffer_alloc (GstBaseSink * bsink, guint64 offset, guint size,
   return GST_FLOW_ERROR;
 }
 
+/* Post the counters on the bus every stats-interval milliseconds */
+static void
+gst_render_bridge_post_stats (GstBufferClassSink * gpuvsink, gint64 now_us)
+{
+  GstStructure *s;
+
+  if (gpuvsink->stats_interval == 0 ||
+      now_us - gpuvsink->last_stats_us < (gint64) gpuvsink->stats_interval * 1000)
+    return;
+  gpuvsink->last_stats_us = now_us;
+
+  GST_OBJECT_LOCK (gpuvsink);
+  s = gst_structure_new ("gpuvsink-stats",
+      "channel-no", G_TYPE_INT, gpuvsink->channel_no,
+      "frames-submitted", G_TYPE_UINT64, gpuvsink->frames_submitted,
+      "frames-presented", G_TYPE_UINT64, gpuvsink->frames_presented,
+      "frames-skipped", G_TYPE_UINT64, gpuvsink->frames_skipped,
+      "slow-path-copies", G_TYPE_UINT64, gpuvsink->slow_path_copies,
+      "slow-path-bytes", G_TYPE_UINT64, gpuvsink->slow_path_bytes,
+      "frames-imported", G_TYPE_UINT64, gpuvsink->frames_imported,
+      "pool-empty-waits", G_TYPE_UINT64, gpuvsink->pool_empty_waits,
+      "write-latency-max", G_TYPE_UINT64, gpuvsink->write_latency_max,
+      "write-blocked-time", G_TYPE_UINT64, gpuvsink->write_blocked_time,
+      "buffers-outstanding", G_TYPE_UINT, gst_render_bridge_outstanding (gpuvsink),
+      "pool-buffers", G_TYPE_UINT, gpuvsink->pool ? gpuvsink->pool->num_buffers : 0,
+      "qos-proportion", G_TYPE_DOUBLE, gpuvsink->qos_proportion,
+      "display-latency", G_TYPE_UINT64, gpuvsink->display_latency, NULL);
+  GST_OBJECT_UNLOCK (gpuvsink);
+
+  gst_element_post_message (GST_ELEMENT (gpuvsink),
+      gst_message_new_element (GST_OBJECT (gpuvsink), s));
+}
+
+/*
+ * Zero-copy path for a buffer that is not from the pool: a frame of the
+ * pool's layout in one physically contiguous block is rendered in place,
+ * from a compositor index mapped to its memory. The frame is then held
+ * like a pool buffer, by the hold chain, until the compositor is done.
+ *
+ * @return the compositor index, or -1 if the frame has to be copied
+ */
+static gint
+gst_render_bridge_import (GstBufferClassSink * gpuvsink, GstBuffer * buf)
+{
+  GstBufferClassBufferPool *pool = gpuvsink->pool;
+  GstBcImportCache *cache = &gpuvsink->import;
+  GstBuffer *held[GST_BC_HOLD_BUFFERS];
+  unsigned long phys;
+  guint32 busy = 0;
+  gboolean map;
+  gint i, slot;
+
+  if (!pool || GST_BUFFER_SIZE (buf) < pool->layout.size ||
+      (GST_BUFFER_CAPS (buf) && !gst_caps_is_equal (GST_BUFFER_CAPS (buf),
+              pool->caps)))
+    return -1;
+
+  phys = gst_bc_import_lookup (cache, GST_BUFFER_DATA (buf),
+      GST_BUFFER_SIZE (buf));
+  if (!phys)
+    return -1;
+
+  if (!cache->first_slot) {
+    /* enough indices for the frames held for the SGX and a new one */
+    if (!gst_buffer_manager_reserve (pool, GST_BC_HOLD_BUFFERS + 1)) {
+      GST_DEBUG_OBJECT (gpuvsink, "no buffer indices left for imports");
+      cache->disabled = TRUE;
+      return -1;
+    }
+    cache->first_slot = pool->import_first;
+  }
+
+  held[0] = gpuvsink->bcbuf_prev1;
+  held[1] = gpuvsink->bcbuf_prev2;
+  held[2] = gpuvsink->bcbuf_prev3;
+  held[3] = gpuvsink->bcbuf_prev4;
+  held[4] = gpuvsink->bcbuf_prev5;
+  for (i = 0; i < GST_BC_HOLD_BUFFERS; i++) {
+    if (held[i] && !GST_IS_BCBUFFER (held[i]) &&
+        (slot = gst_bc_import_find (cache, held[i])) >= 0)
+      busy |= 1u << slot;
+  }
+
+  slot = gst_bc_import_slot (cache, buf, phys, busy, &map);
+  if (slot < 0)
+    return -1;
+
+  if (map) {
+    GST_LOG_OBJECT (gpuvsink, "mapping index %d to 0x%lx", slot, phys);
+    gpuvsink->videoConfig.config_data = VID_MSG_MAP;
+    gpuvsink->videoConfig.buf_index = slot;
+    gpuvsink->videoConfig.in.phyaddr[slot] = phys;
+    if (!gst_comp_link_send (gpuvsink->fd_video_cfg, &gpuvsink->videoConfig, NULL, 0))
+    {
+      printf("Error in mapping buffer %d of channel %d \n", slot, gpuvsink->channel_no);
+    }
+  }
+
+  GST_OBJECT_LOCK (gpuvsink);
+  gpuvsink->frames_imported++;
+  GST_OBJECT_UNLOCK (gpuvsink);
+
+  return slot;
+}
+
 /** called after A/V sync to render frame */
 static GstFlowReturn
 gst_render_bridge_show_frame (GstBaseSink * bsink, GstBuffer * buf)
@@ -570,19 +1709,26 @@ gst_render_bridge_show_frame (GstBaseSink * bsink, GstBuffer * buf)
   GstBufferClassBuffer *bcbuf;
   GstBufferClassBuffer *bcbuf_rec;
   GstBuffer *newbuf = NULL;
-  int n;
-  static int queue_counter=0;
+  gint64 sent_us, now_us;
+  gint index = -1;
 
   GST_DEBUG_OBJECT (gpuvsink, "render buffer: %p", buf);
 
-  if (G_UNLIKELY (!GST_IS_BCBUFFER (buf))) {
+  if (G_UNLIKELY (!GST_IS_BCBUFFER (buf)))
+    index = gst_render_bridge_import (gpuvsink, buf);
+
+  if (G_UNLIKELY (!GST_IS_BCBUFFER (buf) && index < 0)) {
     GstFlowReturn ret;
+    GstBufferClassBufferPool *pool;
+    GstFrameLayout src_layout;
+    gsize copied;
 
     GST_DEBUG_OBJECT (gpuvsink, "slow-path.. I got a %s so I need to memcpy",
         g_type_name (G_OBJECT_TYPE (buf)));
+    /* no size: the frame is copied line by line into the pool's layout,
+       whatever padding the upstream buffer has */
     ret = gst_render_bridge_buffer_alloc (bsink,
-        GST_BUFFER_OFFSET (buf), GST_BUFFER_SIZE (buf), GST_BUFFER_CAPS (buf),
-        &newbuf);
+        GST_BUFFER_OFFSET (buf), 0, GST_BUFFER_CAPS (buf), &newbuf);
 
     if (GST_FLOW_OK != ret) {
       GST_DEBUG_OBJECT (gpuvsink,
@@ -590,32 +1736,86 @@ gst_render_bridge_show_frame (GstBaseSink * bsink, GstBuffer * buf)
       return GST_FLOW_OK;
     }
 
-    memcpy (GST_BUFFER_DATA (newbuf),
-        GST_BUFFER_DATA (buf),
-        MIN (GST_BUFFER_SIZE (newbuf), GST_BUFFER_SIZE (buf)));
+    pool = GST_BCBUFFER (newbuf)->pool;
+    if (G_LIKELY (gst_frame_layout_from_caps (&src_layout,
+                GST_BUFFER_CAPS (buf) ? GST_BUFFER_CAPS (buf) : pool->caps) &&
+            GST_BUFFER_SIZE (buf) >= src_layout.size)) {
+      guint threads = gpuvsink->copy_threads;
+
+      /* made with the first copy, and again once copy-threads changed */
+      if (G_UNLIKELY (!gpuvsink->copier || gpuvsink->copier_threads != threads)) {
+        gst_frame_copier_free (gpuvsink->copier);
+        gpuvsink->copier = gst_frame_copier_new (threads);
+        gpuvsink->copier_threads = threads;
+      }
+      gst_frame_copier_copy (gpuvsink->copier, GST_BUFFER_DATA (newbuf),
+          &pool->layout, GST_BUFFER_DATA (buf), &src_layout, pool->cached);
+      copied = src_layout.size;
+    } else {
+      GST_WARNING_OBJECT (gpuvsink, "short buffer of %u bytes, copying as is",
+          GST_BUFFER_SIZE (buf));
+      copied = MIN (GST_BUFFER_SIZE (newbuf), GST_BUFFER_SIZE (buf));
+      memcpy (GST_BUFFER_DATA (newbuf), GST_BUFFER_DATA (buf), copied);
+      /* unlike the copy engine, memcpy leaves the frame in the cache */
+      gst_bcbuffer_flush (GST_BCBUFFER (newbuf));
+    }
+
+    GST_OBJECT_LOCK (gpuvsink);
+    gpuvsink->slow_path_copies++;
+    gpuvsink->slow_path_bytes += copied;
+    GST_OBJECT_UNLOCK (gpuvsink);
 
     GST_DEBUG_OBJECT (gpuvsink, "render copied buffer: %p", newbuf);
 
     buf = newbuf;
   }
 
-  bcbuf = GST_BCBUFFER (buf);
+  if (index < 0) {
+    bcbuf = GST_BCBUFFER (buf);
 
-  /* cause buffer to be flushed before rendering */
-  gst_bcbuffer_flush (bcbuf);
+    if (G_UNLIKELY (bcbuf->pool != gpuvsink->pool)) {
+      /* allocated before a caps change, the compositor no longer knows it */
+      GST_DEBUG_OBJECT (gpuvsink, "dropping frame %p of a previous pool", buf);
+      return GST_FLOW_OK;
+    }
 
-  //g_signal_emit (gpuvsink, signals[SIG_RENDER], 0, bcbuf->index);
-  gst_buffer_ref(bcbuf);
+    /* cause buffer to be flushed before rendering; a copied frame has
+       been written back already */
+    if (!newbuf)
+      gst_bcbuffer_flush (bcbuf);
+    index = bcbuf->index;
+  }
 
-  gpuvsink->videoConfig.config_data = 0;
-  gpuvsink->videoConfig.buf_index = bcbuf->index;
+  //g_signal_emit (gpuvsink, signals[SIG_RENDER], 0, index);
+  gst_buffer_ref (buf);
 
-   n = write(gpuvsink->fd_video_cfg, &gpuvsink->videoConfig, sizeof(gpuvsink->videoConfig));
+  gpuvsink->videoConfig.config_data = VID_MSG_DATA;
+  gpuvsink->videoConfig.buf_index = index;
 
-  if(n != sizeof(gpuvsink->videoConfig))
+  /* remembered for the status the compositor sends back; QoS events
+     carry running time, taken in the segment the frame was rendered in */
+  GST_OBJECT_LOCK (gpuvsink);
+  gpuvsink->frame_ts[index] = gst_segment_to_running_time (
+      &GST_BASE_SINK (gpuvsink)->segment, GST_FORMAT_TIME,
+      GST_BUFFER_TIMESTAMP (buf));
+  gpuvsink->frame_dur[index] = GST_BUFFER_DURATION_IS_VALID (buf) ?
+      GST_BUFFER_DURATION (buf) : gpuvsink->frame_duration;
+  gpuvsink->frame_sent_us[index] = sent_us = gst_render_bridge_now_us ();
+  GST_OBJECT_UNLOCK (gpuvsink);
+
+  if (!gst_comp_link_send (gpuvsink->fd_video_cfg, &gpuvsink->videoConfig, NULL, 0))
   {
-      printf("Error in writing to named pipe: %s \n", VIDEO_CONFIG_AND_DATA_FIFO_NAME);
+      printf("Error in sending buffer %d to channel %d \n", index, gpuvsink->channel_no);
   }
+
+  now_us = gst_render_bridge_now_us ();
+  GST_OBJECT_LOCK (gpuvsink);
+  gpuvsink->frames_submitted++;
+  gpuvsink->write_latency_max = MAX (gpuvsink->write_latency_max,
+      (guint64) (now_us - sent_us) * GST_USECOND);
+  gpuvsink->write_blocked_time += (now_us - sent_us) * GST_USECOND;
+  GST_OBJECT_UNLOCK (gpuvsink);
+  gst_render_bridge_post_stats (gpuvsink, now_us);
  
   /* delay the buffer free up by two frames to account for the SGX deferred rendering archtecture */
   if (gpuvsink->bcbuf_prev5 != NULL)
@@ -624,7 +1824,7 @@ gst_render_bridge_show_frame (GstBaseSink * bsink, GstBuffer * buf)
   gpuvsink->bcbuf_prev4 = gpuvsink->bcbuf_prev3;
   gpuvsink->bcbuf_prev3 = gpuvsink->bcbuf_prev2;
   gpuvsink->bcbuf_prev2 = gpuvsink->bcbuf_prev1;
-  gpuvsink->bcbuf_prev1 = bcbuf; 
+  gpuvsink->bcbuf_prev1 = buf;
 //  gst_buffer_unref(bcbuf);
 
   /* note: it would be nice to know when the driver is done with the buffer..
@@ -49,6 +49,7 @@
 #include <gst/video/gstvideosink.h>
 
 #include "gst_buffer_manager.h"
+#include "gst_bc_import.h"
 
 G_BEGIN_DECLS
 
@@ -65,13 +66,28 @@ G_BEGIN_DECLS
 typedef struct _GstBufferClassSink GstBufferClassSink;
 typedef struct _GstBufferClassSinkClass GstBufferClassSinkClass;
 
+/* pool memory; cached suits frames the CPU writes, uncached DMA writers */
+typedef enum
+{
+  GST_BC_MEMORY_AUTO,
+  GST_BC_MEMORY_CACHED,
+  GST_BC_MEMORY_UNCACHED
+} GstBcMemoryType;
+
 
 #define PROP_DEF_QUEUE_SIZE 12 
 #define GST_BC_MIN_BUFFERS  2
 #define GST_BC_MAX_BUFFERS 12
+#define GST_BC_HOLD_BUFFERS 5     /* frames kept referenced for the SGX (bcbuf_prev1..5) */
+#define GST_BC_GROW_STEP    2     /* buffers added when the pool runs dry */
+#define GST_BC_SHRINK_PERIOD 300  /* buffer requests between two shrink checks */
+#define GST_BC_CLOSE_TIMEOUT_MS 1000 /* longest wait for the compositor to release a channel */
+#define GST_BC_LATENCY_STEP (2 * GST_MSECOND) /* render-delay follows the display latency
+                                                 when they differ by more than this */
+#define GST_BC_MAX_RENDER_DELAY_FRAMES 3 /* auto render-delay at most, in frame durations
+                                           (of 30 fps when the stream has none) */
 #define MAX_QUEUE 3
 #define BCIO_FLUSH                BC_IOWR(5)
-#define BPP 2
 
 /**
  * GstBufferClassSink:
@@ -87,12 +103,16 @@ struct _GstBufferClassSink
   guint32 num_buffers;
 
   GstBufferClassBufferPool *pool;
+  GMutex *pool_lock;              /* taken to replace pool or fd_video_cfg,
+                                     and by the property setters using them */
 
   int fd;
-  char video_config_fifo[100];
   videoConfig_s videoConfig;
   int    fd_video_cfg;
   int channel_no;
+  gboolean channel_auto;          /* channel_no picked by the compositor */
+  gboolean persistent_pool;       /* keep pool and channel over a restart */
+  GstBcMemoryType memory_type;
 
   GstBuffer *bcbuf_prev1;
   GstBuffer *bcbuf_prev2;
@@ -100,6 +120,40 @@ struct _GstBufferClassSink
   GstBuffer *bcbuf_prev4;
   GstBuffer *bcbuf_prev5;
 
+  /* slow path: frames copied into the pool */
+  GstFrameCopier *copier;
+  guint copy_threads;
+  guint copier_threads;           /* copy-threads the copier was made with */
+  guint64 slow_path_copies;
+  guint64 slow_path_bytes;
+
+  /* zero-copy path: contiguous upstream buffers rendered in place */
+  GstBcImportCache import;
+  guint64 frames_imported;
+
+  /* frame status reported back by the compositor, under the object lock */
+  GThread *status_thread;
+  int status_wake[2];             /* pipe to stop the status thread */
+  GstClockTime frame_duration;    /* from the caps framerate */
+  GstClockTime frame_ts[MAX_VIDEO_BUFFERS_PER_CHANNEL];    /* running time */
+  GstClockTime frame_dur[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+  gint64 frame_sent_us[MAX_VIDEO_BUFFERS_PER_CHANNEL];
+  guint pending_skips;            /* skipped since the last presented frame */
+  gdouble qos_proportion;
+  guint64 frames_presented;
+  guint64 frames_skipped;
+  GstClockTime display_latency;   /* smoothed render-to-scanout time, 0 = unknown */
+  gboolean auto_render_delay;     /* keep render-delay at display_latency,
+                                     until the application sets it */
+
+  /* runtime statistics, under the object lock */
+  guint64 frames_submitted;
+  guint64 pool_empty_waits;
+  guint64 write_latency_max;      /* ns, longest data message send */
+  guint64 write_blocked_time;     /* ns, total time in data message sends */
+  guint stats_interval;           /* ms between stats messages, 0 = none */
+  gint64 last_stats_us;
+
 };
 
 struct _GstBufferClassSinkClass
@@ -2,6 +2,10 @@ TARGET = qscreenlinuxfbofs
 include(qpluginbase.pri)
 
 INCLUDEPATH +=/home1/mahesh/cmem/include
+# compose() uses QWSWindowSurface from the private Qt headers, which only
+# a configured Qt source tree has: build the plugin from its
+# src/plugins/gfxdrivers directory, as qpluginbase.pri already requires
+INCLUDEPATH += $$QT_BUILD_TREE/include/QtGui
 QTDIR_build:DESTDIR = $$QT_BUILD_TREE/plugins/gfxdrivers
 LIBS += /home1/mahesh/cmem/lib/cmem.a470MV
 target.path = $$[QT_INSTALL_PLUGINS]/gfxdrivers
@@ -9,7 +13,11 @@ INSTALLS += target
 
 DEFINES += QT_QWS_LINUXFB
 
-HEADERS	= qscreenlinuxfb_qws.h
+contains(QT_ARCH, arm): QMAKE_CXXFLAGS += -mfpu=neon
+
+HEADERS	= qscreenlinuxfb_qws.h \
+          qscreenlinuxfb_simd.h
 
 SOURCES	= main.cpp \
-          qscreenlinuxfb_qws.cpp
+          qscreenlinuxfb_qws.cpp \
+          qscreenlinuxfb_simd.cpp
@@ -45,6 +45,12 @@
 //#include "qmemorymanager_qws.h"
 #include "qwsdisplay_qws.h"
 #include "qpixmap.h"
+#include "qpainter.h"
+#include "qregion.h"
+#include "qcoreapplication.h"
+#include "qsocketnotifier.h"
+#include "qpointer.h"
+#include "qdatetime.h"
 //#include <private/qwssignalhandler_p.h>
 //#include <private/qcore_unix_p.h> // overrides QT_OPEN
 
@@ -55,6 +61,7 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/kd.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
@@ -62,16 +69,21 @@
 #include <signal.h>
 
 #include "qwindowsystem_qws.h"
+#include <private/qwindowsurface_qws_p.h>
 
 #include <cmem.h>
 #include "../gpucomp.h"
+#include "qscreenlinuxfb_simd.h"
 
+/* CMEM_CACHED with the "cached" display spec option */
 static CMEM_AllocParams params = { CMEM_POOL, CMEM_NONCACHED, 4096 };
 
-//static CMEM_AllocParams params = { CMEM_POOL, CMEM_CACHED, 4096 };
+/* offscreen pixmaps are only touched by the CPU */
+static CMEM_AllocParams poolParams = { CMEM_POOL, CMEM_CACHED, 4096 };
 
 #define QT_OPEN open
 #define QT_WRITE write
+#define QT_READ read
 #define QT_CLOSE close
 
 #if !defined(Q_OS_DARWIN) && !defined(Q_OS_FREEBSD)
@@ -88,6 +100,190 @@ extern int qws_client_id;
 
 //#define DEBUG_CACHE
 
+/*
+  Buddy allocator for the offscreen pixmap arena. The arena is split into
+  blocks of 2^k units (1 KB each), kept on one free list per k. A request
+  takes the smallest block that fits from the first non empty list at or
+  above its size, splitting off the unused halves; a freed block merges
+  with its buddy for as long as the buddy is free too. Both walk at most
+  one list per block size, O(log n) in the size of the arena.
+
+  Per unit the allocator keeps the size of the block starting there,
+  whether it is free or handed out, the client owning it, and the free
+  list links. Units inside a block have none of this set.
+
+  The arena is CMEM of this process only, and so is the allocator: other
+  processes can't get at either, and a client's pixmaps go with it.
+*/
+class QLinuxFbOfsPool
+{
+public:
+    enum { UnitShift = 10, MaxOrder = 20 };
+
+    QLinuxFbOfsPool() : units(0) {}
+
+    void init(int bytes);
+    int alloc(int bytes, int clientId);     // offset, -1 if none
+    bool release(int offset, int clientId);
+    void clear(int clientId);
+
+private:
+    void push(int u, int k);
+    void unlink(int u);
+    void freeBlock(int u);
+
+    int units;
+    int head[MaxOrder + 1];
+    QVector<uchar> order;
+    QVector<uchar> isFree;
+    QVector<uchar> isUsed;
+    QVector<int> owner;
+    QVector<int> next;
+    QVector<int> prev;
+};
+
+void QLinuxFbOfsPool::init(int bytes)
+{
+    units = bytes >> UnitShift;
+    order.fill(0, units);
+    isFree.fill(0, units);
+    isUsed.fill(0, units);
+    owner.fill(0, units);
+    next.fill(-1, units);
+    prev.fill(-1, units);
+    for (int k = 0; k <= MaxOrder; ++k)
+        head[k] = -1;
+
+    // cover the arena with the largest aligned blocks that fit
+    int u = 0;
+    while (u < units) {
+        int k = 0;
+        while (k < MaxOrder && !(u & ((2 << k) - 1)) && u + (2 << k) <= units)
+            ++k;
+        push(u, k);
+        u += 1 << k;
+    }
+}
+
+void QLinuxFbOfsPool::push(int u, int k)
+{
+    order[u] = k;
+    isFree[u] = 1;
+    prev[u] = -1;
+    next[u] = head[k];
+    if (head[k] >= 0)
+        prev[head[k]] = u;
+    head[k] = u;
+}
+
+void QLinuxFbOfsPool::unlink(int u)
+{
+    if (prev[u] >= 0)
+        next[prev[u]] = next[u];
+    else
+        head[order[u]] = next[u];
+    if (next[u] >= 0)
+        prev[next[u]] = prev[u];
+    isFree[u] = 0;
+}
+
+int QLinuxFbOfsPool::alloc(int bytes, int clientId)
+{
+    int need = (bytes + (1 << UnitShift) - 1) >> UnitShift;
+    int k = 0;
+    while ((1 << k) < need)
+        ++k;
+
+    int j = k;
+    while (j <= MaxOrder && head[j] < 0)
+        ++j;
+    if (j > MaxOrder)
+        return -1;
+
+    int u = head[j];
+    unlink(u);
+    while (j > k) {
+        --j;
+        push(u + (1 << j), j);
+    }
+    order[u] = k;
+    isUsed[u] = 1;
+    owner[u] = clientId;
+    return u << UnitShift;
+}
+
+void QLinuxFbOfsPool::freeBlock(int u)
+{
+    int k = order[u];
+    isUsed[u] = 0;
+    owner[u] = 0;
+    while (k < MaxOrder) {
+        int b = u ^ (1 << k);
+        if (b + (1 << k) > units || !isFree[b] || order[b] != k)
+            break;
+        unlink(b);
+        // the upper half no longer starts a block
+        order[qMax(u, b)] = 0;
+        u = qMin(u, b);
+        ++k;
+    }
+    push(u, k);
+}
+
+bool QLinuxFbOfsPool::release(int offset, int clientId)
+{
+    int u = offset >> UnitShift;
+    if (offset < 0 || (offset & ((1 << UnitShift) - 1)) || u >= units || !isUsed[u]) {
+        qWarning("Attempt to delete unknown offset %d", offset);
+        return false;
+    }
+    if (owner[u] != clientId) {
+        qWarning("Attempt to delete client id %d cache entry", owner[u]);
+        return false;
+    }
+    freeBlock(u);
+    return true;
+}
+
+void QLinuxFbOfsPool::clear(int clientId)
+{
+    // block starts are found by stepping over whole blocks, all of them
+    // before any is freed: merging changes where blocks start
+    QVector<int> blocks;
+    for (int u = 0; u < units; u += 1 << order[u])
+        if (isUsed[u] && owner[u] == clientId)
+            blocks.append(u);
+    for (int i = 0; i < blocks.size(); ++i)
+        freeBlock(blocks[i]);
+}
+
+// Posted by setDirty(), sends what was drawn in an event loop pass
+static const QEvent::Type DamageFlushEvent = QEvent::Type(QEvent::registerEventType());
+
+// Type of the QLinuxFbFrameEvent posted to the receivers of requestFrame()
+static const QEvent::Type FrameDoneEvent = QEvent::Type(QEvent::registerEventType());
+
+// With frame events, damage waits for the event of the last message; the
+// compositor may not answer when the plane is not drawn
+#define FRAME_TIMEOUT_MS 100
+
+class QLinuxFbScreenOfsPrivate;
+
+// Reads the event pipe of the gfx plane; handles the notification itself
+// rather than through a signal
+class QLinuxFbEventNotifier : public QSocketNotifier
+{
+public:
+    QLinuxFbEventNotifier(int fd, QLinuxFbScreenOfsPrivate *d)
+        : QSocketNotifier(fd, QSocketNotifier::Read), d(d) {}
+
+protected:
+    bool event(QEvent *e);
+
+private:
+    QLinuxFbScreenOfsPrivate *d;
+};
+
 class QLinuxFbScreenOfsPrivate : public QObject
 {
 public:
@@ -97,6 +293,17 @@ public:
     void openTty();
     void closeTty();
 
+    bool event(QEvent *e);
+    void flushDamage();
+    bool sendRender();
+    int startFrame();
+    void sendFrameRequest();
+    bool takeEvents(qint64 *present, qint64 *scanout);
+    void readEvents();
+    bool waitFrame(qint64 *present, qint64 *scanout);
+    void frameDone(qint64 present, qint64 scanout);
+    void writeBack(const uchar *buf, const QRegion &region);
+
     int fd;
     int startupw;
     int startuph;
@@ -112,6 +319,43 @@ public:
     long oldKdMode;
     QString ttyDevice;
     QString displaySpec;
+
+    int gfxFd;              // named pipe of the gfx plane, -1 if none
+    QRegion damage;         // drawn since the last damage message
+    bool damagePosted;
+    bool cached;            // surface CPU cached, written back per damage
+    int dispWidth;          // display in pixels, 0 if unknown
+    int dispHeight;
+
+    // last blending/rotation sent, a render update carries all of them
+    int blendEnabled;
+    int globalAlphaEnabled;
+    float globalAlpha;
+    float rotate;
+
+    // Multi buffering: Qt draws into buffer curBuffer while the compositor
+    // shows the one sent with the last damage message
+    QLinuxFbScreenOfs *q;
+    uchar *bufBase;         // first buffer, the others follow every size bytes
+    int numBuffers;
+    int curBuffer;
+    int busyBuffers;        // bit per buffer the compositor may still sample
+    QRegion stale[GFX_MAX_BUFFERS]; // drawn since the buffer was last current
+
+    uchar *offscreen;       // pixmap arena, 0 if none
+    int offscreenSize;      // bytes, from the display spec
+    QLinuxFbOfsPool pool;
+
+    // Frame events of the compositor: one message per frame it shows
+    int evtFd;              // event pipe of the gfx plane, -1 if none
+    QLinuxFbEventNotifier *evtNotifier;
+    bool framePending;      // last message asked for a frame event
+    int frameSeq;           // frame_request of that message
+    int frameTimer;
+    QList<QPointer<QObject> > frameReceivers;
+
+protected:
+    void timerEvent(QTimerEvent *e);
 };
 
 QLinuxFbScreenOfsPrivate::QLinuxFbScreenOfsPrivate()
@@ -119,7 +363,12 @@ QLinuxFbScreenOfsPrivate::QLinuxFbScreenOfsPrivate()
 #ifdef QT_QWS_DEPTH_GENERIC
       doGenericColors(false),
 #endif
-      ttyfd(-1), oldKdMode(KD_TEXT)
+      ttyfd(-1), oldKdMode(KD_TEXT), gfxFd(-1), damagePosted(false), cached(false),
+      dispWidth(0), dispHeight(0),
+      blendEnabled(0), globalAlphaEnabled(0), globalAlpha(1.0), rotate(0.0),
+      q(0), bufBase(0), numBuffers(1), curBuffer(0), busyBuffers(1),
+      offscreen(0), offscreenSize(0),
+      evtFd(-1), evtNotifier(0), framePending(false), frameSeq(0), frameTimer(0)
 {
 //    QWSSignalHandler::instance()->addObject(this);
 }
@@ -128,6 +377,248 @@ QLinuxFbScreenOfsPrivate::~QLinuxFbScreenOfsPrivate()
     closeTty();
 }
 
+bool QLinuxFbScreenOfsPrivate::event(QEvent *e)
+{
+    if (e->type() == DamageFlushEvent) {
+        flushDamage();
+        return true;
+    }
+    return QObject::event(e);
+}
+
+// Tell the compositor what was drawn, so it composes the gfx plane again;
+// a region too fragmented for one message is sent as its bounding rect
+void QLinuxFbScreenOfsPrivate::flushDamage()
+{
+    const QVector<QRect> rects = damage.rects();
+    gfxCfg_s gfxCfg;
+    int i;
+
+    damagePosted = false;
+    if (gfxFd < 0 || framePending)
+        return;
+    if (rects.isEmpty()) {
+        if (!frameReceivers.isEmpty())
+            sendFrameRequest();
+        return;
+    }
+
+    memset(&gfxCfg, 0, sizeof(gfxCfg));
+    gfxCfg.enable = 1;
+    gfxCfg.frame_request = startFrame();
+    gfxCfg.damage_valid = 1;
+    gfxCfg.damage_g.buf_index = curBuffer;
+    if (rects.size() <= GFX_MAX_DAMAGE_RECTS) {
+        gfxCfg.damage_g.count = rects.size();
+        for (i = 0; i < rects.size(); i++) {
+            gfxCfg.damage_g.rect[i].x      = rects.at(i).x();
+            gfxCfg.damage_g.rect[i].y      = rects.at(i).y();
+            gfxCfg.damage_g.rect[i].width  = rects.at(i).width();
+            gfxCfg.damage_g.rect[i].height = rects.at(i).height();
+        }
+    } else {
+        const QRect r = damage.boundingRect();
+        gfxCfg.damage_g.count = 1;
+        gfxCfg.damage_g.rect[0].x      = r.x();
+        gfxCfg.damage_g.rect[0].y      = r.y();
+        gfxCfg.damage_g.rect[0].width  = r.width();
+        gfxCfg.damage_g.rect[0].height = r.height();
+    }
+    if (cached)
+        writeBack(q->base(), damage);
+    damage = QRegion();
+
+    if (QT_WRITE(gfxFd, &gfxCfg, sizeof(gfxCfg)) != sizeof(gfxCfg))
+        perror("QLinuxFbScreenOfs::setDirty");
+    busyBuffers |= 1 << curBuffer;
+
+    // The compositor shows this buffer from now on, draw into the next one
+    // once the compositor no longer samples it: the frame event naming a
+    // later buffer says so. With three buffers that came with the event of
+    // the previous message, with two it is this message's. Without frame
+    // events, only taken with three, the next one is taken right away.
+    if (numBuffers > 1) {
+        const int next = (curBuffer + 1) % numBuffers;
+        qint64 present = 0, scanout = 0;
+        bool done = false;
+
+        if (framePending && (busyBuffers & (1 << next)))
+            done = waitFrame(&present, &scanout);
+        q->flip();
+        if (done)
+            frameDone(present, scanout);
+    }
+}
+
+// Write the CPU cache back over the given areas of a buffer, so the GPU
+// reads what was drawn. One call per rect: the lines of a rect are
+// contiguous but for the stride, writing back the gaps costs less than a
+// call per line.
+void QLinuxFbScreenOfsPrivate::writeBack(const uchar *buf, const QRegion &region)
+{
+    const QVector<QRect> rects = region.rects();
+    const int lstep = q->linestep();
+    const int bpp = q->depth() / 8;
+
+    for (int i = 0; i < rects.size(); ++i) {
+        const QRect &r = rects.at(i);
+        const int start = r.y() * lstep + r.x() * bpp;
+        const int end = (r.y() + r.height() - 1) * lstep + (r.x() + r.width()) * bpp;
+        CMEM_cacheWb((void *)(buf + start), end - start);
+    }
+}
+
+// Ask for a frame event with the next message, 0 if there are none.
+// Requests are numbered, an event that comes after the timeout answers an
+// earlier one and is not taken for the answer to this.
+int QLinuxFbScreenOfsPrivate::startFrame()
+{
+    if (evtFd < 0)
+        return 0;
+
+    if (!evtNotifier)
+        evtNotifier = new QLinuxFbEventNotifier(evtFd, this);
+    evtNotifier->setEnabled(true);
+    framePending = true;
+    frameTimer = startTimer(FRAME_TIMEOUT_MS);
+    frameSeq = frameSeq == INT_MAX ? 1 : frameSeq + 1;
+    return frameSeq;
+}
+
+// Nothing drawn, but a receiver waits for the next frame
+void QLinuxFbScreenOfsPrivate::sendFrameRequest()
+{
+    gfxCfg_s gfxCfg;
+
+    memset(&gfxCfg, 0, sizeof(gfxCfg));
+    gfxCfg.enable = 1;
+    gfxCfg.frame_request = startFrame();
+    if (!gfxCfg.frame_request)
+        return;
+
+    if (QT_WRITE(gfxFd, &gfxCfg, sizeof(gfxCfg)) != sizeof(gfxCfg))
+        perror("QLinuxFbScreenOfs::requestFrame");
+}
+
+// Read the event pipe; true if it answered the last frame request, the
+// buffers other than the one the frame showed are free to draw into then
+bool QLinuxFbScreenOfsPrivate::takeEvents(qint64 *present, qint64 *scanout)
+{
+    gfxEvent_s evt;
+    bool done = false;
+    int n;
+
+    while ((n = QT_READ(evtFd, &evt, sizeof(evt))) == sizeof(evt)) {
+        if (evt.type == GFX_EVENT_FRAME_DONE && framePending &&
+            evt.frame_seq == frameSeq) {
+            done = true;
+            *present = evt.present_us;
+            *scanout = evt.scanout_us;
+            if (evt.buf_index >= 0 && evt.buf_index < numBuffers)
+                busyBuffers = 1 << evt.buf_index;
+        }
+    }
+
+    // the compositor went away: the timeout paces the messages until it
+    // opens the pipe again on the next frame request
+    if (n == 0)
+        evtNotifier->setEnabled(false);
+
+    return done;
+}
+
+void QLinuxFbScreenOfsPrivate::readEvents()
+{
+    qint64 present = 0, scanout = 0;
+
+    if (takeEvents(&present, &scanout))
+        frameDone(present, scanout);
+}
+
+// Block until the last frame request is answered, FRAME_TIMEOUT_MS at most:
+// the compositor does not answer while it does not draw the plane, and does
+// not sample its buffers either then
+bool QLinuxFbScreenOfsPrivate::waitFrame(qint64 *present, qint64 *scanout)
+{
+    struct pollfd pfd;
+    QTime elapsed;
+    int left;
+
+    pfd.fd = evtFd;
+    pfd.events = POLLIN;
+    elapsed.start();
+    while ((left = FRAME_TIMEOUT_MS - elapsed.elapsed()) > 0) {
+        pfd.revents = 0;
+        if (poll(&pfd, 1, left) <= 0)
+            break;
+        if (takeEvents(present, scanout))
+            return true;
+        if (pfd.revents & (POLLHUP | POLLERR))
+            break;
+    }
+    return false;
+}
+
+// Wake the receivers up and send what was drawn since the last message
+void QLinuxFbScreenOfsPrivate::frameDone(qint64 present, qint64 scanout)
+{
+    framePending = false;
+    if (frameTimer) {
+        killTimer(frameTimer);
+        frameTimer = 0;
+    }
+
+    const QList<QPointer<QObject> > receivers = frameReceivers;
+    frameReceivers.clear();
+    for (int i = 0; i < receivers.size(); ++i) {
+        if (receivers.at(i))
+            QCoreApplication::postEvent(receivers.at(i),
+                new QLinuxFbFrameEvent(FrameDoneEvent, present, scanout));
+    }
+
+    if (!damage.isEmpty())
+        flushDamage();
+}
+
+void QLinuxFbScreenOfsPrivate::timerEvent(QTimerEvent *e)
+{
+    if (e->timerId() == frameTimer)
+        frameDone(0, 0);
+    else
+        QObject::timerEvent(e);
+}
+
+bool QLinuxFbEventNotifier::event(QEvent *e)
+{
+    if (e->type() == QEvent::SockAct) {
+        d->readEvents();
+        return true;
+    }
+    return QSocketNotifier::event(e);
+}
+
+bool QLinuxFbScreenOfsPrivate::sendRender()
+{
+    gfxCfg_s gfxCfg;
+
+    if (gfxFd < 0)
+        return false;
+
+    memset(&gfxCfg, 0, sizeof(gfxCfg));
+    gfxCfg.enable = 1;
+    gfxCfg.render_params_valid = 1;
+    gfxCfg.render_g.enable_blending     = blendEnabled;
+    gfxCfg.render_g.enable_global_alpha = globalAlphaEnabled;
+    gfxCfg.render_g.global_alpha        = globalAlpha;
+    gfxCfg.render_g.rotate              = rotate;
+
+    if (QT_WRITE(gfxFd, &gfxCfg, sizeof(gfxCfg)) != sizeof(gfxCfg)) {
+        perror("QLinuxFbScreenOfs::sendRender");
+        return false;
+    }
+    return true;
+}
+
 void QLinuxFbScreenOfsPrivate::openTty()
 {
     const char *const devs[] = {"/dev/tty0", "/dev/tty", "/dev/console", 0};
@@ -260,6 +751,7 @@ void QLinuxFbScreenOfs::fixupScreenInfo(fb_fix_screeninfo &finfo, fb_var_screeni
 QLinuxFbScreenOfs::QLinuxFbScreenOfs(int display_id)
     : QScreen(display_id, LinuxFBClass), d_ptr(new QLinuxFbScreenOfsPrivate)
 {
+    d_ptr->q = this;
     canaccel=false;
     clearCacheFunc = &clearCache;
 #ifdef QT_QWS_CLIENTBLIT
@@ -290,6 +782,7 @@ QLinuxFbScreenOfs::~QLinuxFbScreenOfs()
 bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
 {
     char  gfx_config_fifo[] = GFX_CONFIG_NAMED_PIPE;
+    char  gfx_event_fifo[] = GFX_EVENT_NAMED_PIPE;
     int   gfx_plane_no = GFX_LINUXFBOFS_GFX_NO;  
     float x_pos   = GFX_LINUXFBOFS_XPOS; 
     float y_pos   = GFX_LINUXFBOFS_YPOS;
@@ -304,6 +797,10 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
     int crop_y = GFX_LINUXFBOFS_DEFAULT_CROP_Y;
     int crop_w  = 0;
     int crop_h = 0;
+    int num_buffers = 1;
+    int offscreen_kb = 0;
+    int surf_w = 0, surf_h = 0;     /* 0 - the size of the display */
+    int pos_x = -1, pos_y = -1;     /* -1 - placed with xpos, ypos, ... */
 
     unsigned long data_phy;
     gfxCfg_s gfxCfg;
@@ -359,6 +856,23 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
     }
 
     DEBUG_PRINTF ((" Graphics Plane number gfx_no: %d\n", gfx_plane_no));
+
+    /* Buffers of the gfx plane - Qt draws into one while another is shown.
+       Qt takes the next buffer once a frame event confirms the compositor
+       no longer samples it: with 2 it waits for the frame after each damage
+       message, 3 leave one to draw into meanwhile. */
+    QRegExp buffers(QLatin1String("buffers=?(\\d+)"));
+    int buffersIdx = args.indexOf(buffers);
+    if (buffersIdx >= 0) {
+        buffers.exactMatch(args.at(buffersIdx));
+        num_buffers = buffers.cap(1).toInt();
+    }
+    if (num_buffers < 1 || num_buffers > GFX_MAX_BUFFERS)
+    {
+        printf (" Error: Exceeding the number of gfx buffers supported <1 to %d>\n", GFX_MAX_BUFFERS);
+        exit (0);
+    }
+    DEBUG_PRINTF ((" Graphics Plane buffers: %d\n", num_buffers));
  
     /* x position of the output window - normalized device co-ordinate */
     QRegExp xpos(QLatin1String("xpos=?(\\d*\\.\\d+)"));
@@ -493,6 +1007,53 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
     if (args.contains(QLatin1String("nographicsmodeswitch")))
         d_ptr->doGraphicsMode = false;
 
+    /* Surface size in pixels, e.g. size=400x80 for a control bar; the
+       compositor only blends that much */
+    QRegExp surfSize(QLatin1String("size=?(\\d+)x(\\d+)"));
+    int surfSizeIdx = args.indexOf(surfSize);
+    if (surfSizeIdx >= 0) {
+        surfSize.exactMatch(args.at(surfSizeIdx));
+        surf_w = surfSize.cap(1).toInt();
+        surf_h = surfSize.cap(2).toInt();
+        if (surf_w == 0 || surf_h == 0)
+        {
+            printf (" Error: Invalid surface size %dx%d\n", surf_w, surf_h);
+            exit (0);
+        }
+    }
+
+    /* Top-left of the plane on the display in pixels, shown 1:1; replaces
+       xpos, ypos, width and height */
+    QRegExp surfPos(QLatin1String("pos=?(\\d+),(\\d+)"));
+    int surfPosIdx = args.indexOf(surfPos);
+    if (surfPosIdx >= 0) {
+        surfPos.exactMatch(args.at(surfPosIdx));
+        pos_x = surfPos.cap(1).toInt();
+        pos_y = surfPos.cap(2).toInt();
+    }
+
+    /* Offscreen pixmap memory in KB, 0 - none */
+    QRegExp offscreen(QLatin1String("offscreen=?(\\d+)"));
+    int offscreenIdx = args.indexOf(offscreen);
+    if (offscreenIdx >= 0) {
+        offscreen.exactMatch(args.at(offscreenIdx));
+        offscreen_kb = offscreen.cap(1).toInt();
+    }
+    if (offscreen_kb < 0 || offscreen_kb > (1 << QLinuxFbOfsPool::MaxOrder))
+    {
+        printf (" Error: Exceeding the offscreen memory supported <0 to %d KB>\n",
+                1 << QLinuxFbOfsPool::MaxOrder);
+        exit (0);
+    }
+    d_ptr->offscreenSize = offscreen_kb * 1024;
+
+    /* CPU cached surface - fast blending reads, the drawn areas are written
+       back before each damage message */
+    if (args.contains(QLatin1String("cached"))) {
+        d_ptr->cached = true;
+        params.flags = CMEM_CACHED;
+    }
+
 #ifdef QT_QWS_DEPTH_GENERIC
     if (args.contains(QLatin1String("genericcolors")))
         d_ptr->doGenericColors = true;
@@ -607,6 +1168,30 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
         dh = h = 240;
     }
 
+    if (surf_w) {
+        if (d_ptr->fd != -1 && ((uint)surf_w > vinfo.xres || (uint)surf_h > vinfo.yres)) {
+            printf (" Error: Surface %dx%d larger than the display %dx%d\n",
+                    surf_w, surf_h, vinfo.xres, vinfo.yres);
+            exit (0);
+        }
+        dw = w = surf_w;
+        dh = h = surf_h;
+    }
+    if (d_ptr->fd != -1) {
+        d_ptr->dispWidth = vinfo.xres;
+        d_ptr->dispHeight = vinfo.yres;
+    }
+    if (pos_x >= 0 && d_ptr->fd != -1 &&
+        ((uint)(pos_x + w) > vinfo.xres || (uint)(pos_y + h) > vinfo.yres)) {
+        printf (" Error: Plane at %d,%d exceeds the display %dx%d\n",
+                pos_x, pos_y, vinfo.xres, vinfo.yres);
+        exit (0);
+    }
+
+    /* The surface is not the framebuffer: its lines hold w pixels, as the
+       compositor registers it for texture streaming */
+    lstep = w * vinfo.bits_per_pixel / 8;
+
     setPixelFormat(vinfo);
 
     // Handle display physical size spec.
@@ -630,8 +1215,8 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
     if (dimIdxW < 0 && dimIdxH < 0) {
         if (vinfo.width != 0 && vinfo.height != 0
             && vinfo.width != UINT_MAX && vinfo.height != UINT_MAX) {
-            physWidth = vinfo.width;
-            physHeight = vinfo.height;
+            physWidth = vinfo.xres ? vinfo.width * dw / vinfo.xres : vinfo.width;
+            physHeight = vinfo.yres ? vinfo.height * dh / vinfo.yres : vinfo.height;
         } else {
             const int dpi = 72;
             physWidth = qRound(dw * 25.4 / dpi);
@@ -655,11 +1240,29 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
                                      MAP_SHARED, d_ptr->fd, 0);
 #endif
         CMEM_init();
-        data =  (unsigned char *)CMEM_alloc(size, &params);
-        memset (data, 0, size);
+        data =  (unsigned char *)CMEM_alloc(num_buffers * size, &params);
+        memset (data, 0, num_buffers * size);
+        if (d_ptr->cached)
+            CMEM_cacheWb (data, num_buffers * size);
         data_phy = CMEM_getPhys(data);
+        d_ptr->bufBase    = data;
+        d_ptr->numBuffers = num_buffers;
+        d_ptr->curBuffer  = 0;
         
         gfx_config_fifo[strlen(gfx_config_fifo)-1] = '0' + gfx_plane_no;
+        gfx_event_fifo[strlen(gfx_event_fifo)-1] = '0' + gfx_plane_no;
+
+        /* frame events, opened before any request for them; without the
+           pipe damage is sent as soon as it is drawn */
+        d_ptr->evtFd = QT_OPEN(gfx_event_fifo, O_RDONLY | O_NONBLOCK);
+        DEBUG_PRINTF ((" Frame events on %s: %s\n", gfx_event_fifo,
+                       d_ptr->evtFd >= 0 ? "yes" : "no"));
+        if (d_ptr->evtFd < 0 && num_buffers == 2)
+        {
+            printf (" Error: 2 gfx buffers need the frame events of %s\n", gfx_event_fifo);
+            exit (0);
+        }
+
         DEBUG_PRINTF ((" Opening the named pipe: %s\n", gfx_config_fifo));
 
         fd_gfxplane = open(gfx_config_fifo, O_WRONLY);
@@ -669,6 +1272,7 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
             exit(0);
         }
         DEBUG_PRINTF ((" Opened successfully the named pipe: %s\n", gfx_config_fifo));
+        memset(&gfxCfg, 0, sizeof(gfxCfg));
         gfxCfg.enable             = 1; /* Enable the gfx plane */
 
         /* set the input parameters */
@@ -709,6 +1313,8 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
             gfxCfg.in_g.pixel_format = BC_PIX_FMT_ARGB;
         }
         gfxCfg.in_g.data_ph_addr        = data_phy;
+        gfxCfg.in_g.count               = num_buffers;
+        gfxCfg.in_g.buf_size            = size;
         gfxCfg.in_g.enable_blending     = oblend_en;
         gfxCfg.in_g.enable_global_alpha = oglob_alpha_en;
         gfxCfg.in_g.global_alpha        = oglobal_alpha;
@@ -716,10 +1322,18 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
 
         /* set the output parameters */
         gfxCfg.output_params_valid = 1;
-        gfxCfg.out_g.xpos          = x_pos;
-        gfxCfg.out_g.ypos          = y_pos;
-        gfxCfg.out_g.width         = owidth;
-        gfxCfg.out_g.height        = oheight;
+        if (pos_x >= 0) {
+            gfxCfg.out_g.in_pixels = 1;
+            gfxCfg.out_g.xpos      = pos_x;
+            gfxCfg.out_g.ypos      = pos_y;
+            gfxCfg.out_g.width     = dw;
+            gfxCfg.out_g.height    = dh;
+        } else {
+            gfxCfg.out_g.xpos      = x_pos;
+            gfxCfg.out_g.ypos      = y_pos;
+            gfxCfg.out_g.width     = owidth;
+            gfxCfg.out_g.height    = oheight;
+        }
 
         DEBUG_PRINTF ((" Input Frame Width:  %d\n", dw));
         DEBUG_PRINTF ((" Input Frame Height: %d\n", dh));
@@ -730,6 +1344,14 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
         n = write(fd_gfxplane, &gfxCfg, sizeof(gfxCfg));
         DEBUG_PRINTF ((" Wrote the GFX config to the named pipe\n"));
 
+        /* kept open for the damage messages of setDirty() and the
+           runtime changes of setPlane*() */
+        d_ptr->gfxFd = fd_gfxplane;
+        d_ptr->blendEnabled       = oblend_en;
+        d_ptr->globalAlphaEnabled = oglob_alpha_en;
+        d_ptr->globalAlpha        = oglobal_alpha;
+        d_ptr->rotate             = orotate;
+
     }
 
     if ((long)data == -1) {
@@ -807,13 +1429,31 @@ bool QLinuxFbScreenOfs::connect(const QString &displaySpec)
 
 void QLinuxFbScreenOfs::disconnect()
 {
+    if (d_ptr->bufBase)
+        data = d_ptr->bufBase + dataoffset;
     data -= dataoffset;
     if (data)
         munmap((char*)data,mapsize);
 
     CMEM_free (data, &params);
+    if (d_ptr->offscreen) {
+        CMEM_free (d_ptr->offscreen, &poolParams);
+        d_ptr->offscreen = 0;
+    }
     CMEM_exit ();
     close(d_ptr->fd);
+
+    if (d_ptr->gfxFd >= 0) {
+        QT_CLOSE(d_ptr->gfxFd);
+        d_ptr->gfxFd = -1;
+    }
+
+    delete d_ptr->evtNotifier;
+    d_ptr->evtNotifier = 0;
+    if (d_ptr->evtFd >= 0) {
+        QT_CLOSE(d_ptr->evtFd);
+        d_ptr->evtFd = -1;
+    }
 }
 
 // #define DEBUG_VINFO
@@ -1047,12 +1687,6 @@ bool QLinuxFbScreenOfs::initDevice()
         free(cmap.transp);
     }
 
-    if (canaccel) {
-        *entryp=0;
-        *lowest = mapsize;
-        insert_entry(*entryp, *lowest, *lowest);  // dummy entry to mark start
-    }
-
     shared->fifocount = 0;
     shared->buffer_offset = 0xffffffff;  // 0 would be a sensible offset (screen)
     shared->linestep = 0;
@@ -1082,83 +1716,6 @@ bool QLinuxFbScreenOfs::initDevice()
     return true;
 }
 
-/*
-  The offscreen memory manager's list of entries is stored at the bottom
-  of the offscreen memory area and consistes of a series of QPoolEntry's,
-  each of which keep track of a block of allocated memory. Unallocated memory
-  is implicitly indicated by the gap between blocks indicated by QPoolEntry's.
-  The memory manager looks through any unallocated memory before the end
-  of currently-allocated memory to see if a new block will fit in the gap;
-  if it doesn't it allocated it from the end of currently-allocated memory.
-  Memory is allocated from the top of the framebuffer downwards; if it hits
-  the list of entries then offscreen memory is full and further allocations
-  are made from main RAM (and hence unaccelerated). Allocated memory can
-  be seen as a sort of upside-down stack; lowest keeps track of the
-  bottom of the stack.
-*/
-
-void QLinuxFbScreenOfs::delete_entry(int pos)
-{
-    if (pos > *entryp || pos < 0) {
-        qWarning("Attempt to delete odd pos! %d %d", pos, *entryp);
-        return;
-    }
-
-#ifdef DEBUG_CACHE
-    qDebug("Remove entry: %d", pos);
-#endif
-
-    QPoolEntry *qpe = &entries[pos];
-    if (qpe->start <= *lowest) {
-        // Lowest goes up again
-        *lowest = entries[pos-1].start;
-#ifdef DEBUG_CACHE
-        qDebug("   moved lowest to %d", *lowest);
-#endif
-    }
-
-    (*entryp)--;
-    if (pos == *entryp)
-        return;
-
-    int size = (*entryp)-pos;
-    memmove(&entries[pos], &entries[pos+1], size*sizeof(QPoolEntry));
-}
-
-void QLinuxFbScreenOfs::insert_entry(int pos, int start, int end)
-{
-    if (pos > *entryp) {
-        qWarning("Attempt to insert odd pos! %d %d",pos,*entryp);
-        return;
-    }
-
-#ifdef DEBUG_CACHE
-    qDebug("Insert entry: %d, %d -> %d", pos, start, end);
-#endif
-
-    if (start < (int)*lowest) {
-        *lowest = start;
-#ifdef DEBUG_CACHE
-        qDebug("    moved lowest to %d", *lowest);
-#endif
-    }
-
-    if (pos == *entryp) {
-        entries[pos].start = start;
-        entries[pos].end = end;
-        entries[pos].clientId = qws_client_id;
-        (*entryp)++;
-        return;
-    }
-
-    int size=(*entryp)-pos;
-    memmove(&entries[pos+1],&entries[pos],size*sizeof(QPoolEntry));
-    entries[pos].start=start;
-    entries[pos].end=end;
-    entries[pos].clientId=qws_client_id;
-    (*entryp)++;
-}
-
 /*!
     \fn uchar * QLinuxFbScreenOfs::cache(int amount)
 
@@ -1166,8 +1723,8 @@ void QLinuxFbScreenOfs::insert_entry(int pos, int start, int end)
     from the memory manager, and returns a pointer to the data within
     the framebuffer (or 0 if there is no free memory).
 
-    Note that the display is locked while memory is allocated in order to
-    preserve the memory pool's integrity.
+    The memory pool belongs to this process, so the display is not
+    locked while memory is allocated.
 
     Use the QScreen::onCard() function to retrieve an offset (in
     bytes) from the start of graphics card memory for the returned
@@ -1178,62 +1735,18 @@ void QLinuxFbScreenOfs::insert_entry(int pos, int start, int end)
 
 uchar * QLinuxFbScreenOfs::cache(int amount)
 {
-    if (!canaccel || entryp == 0)
+    if (!canaccel || !d_ptr->offscreen)
         return 0;
 
-    qt_fbdpy->grab();
-
-    int startp = cacheStart + (*entryp+1) * sizeof(QPoolEntry);
-    if (startp >= (int)*lowest) {
-        // We don't have room for another cache QPoolEntry.
-#ifdef DEBUG_CACHE
-        qDebug("No room for pool entry in VRAM");
-#endif
-        qt_fbdpy->ungrab();
-        return 0;
-    }
-
-    int align = pixmapOffsetAlignment();
-
-    if (*entryp > 1) {
-        // Try to find a gap in the allocated blocks.
-        for (int loopc = 0; loopc < *entryp-1; loopc++) {
-            int freestart = entries[loopc+1].end;
-            int freeend = entries[loopc].start;
-            if (freestart != freeend) {
-                while (freestart % align) {
-                    freestart++;
-                }
-                int len=freeend-freestart;
-                if (len >= amount) {
-                    insert_entry(loopc+1, freestart, freestart+amount);
-                    qt_fbdpy->ungrab();
-                    return data+freestart;
-                }
-            }
-        }
-    }
+    int offset = d_ptr->pool.alloc(amount, qws_client_id);
 
-    // No free blocks in already-taken memory; get some more
-    // if we can
-    int newlowest = (*lowest)-amount;
-    if (newlowest % align) {
-        newlowest -= align;
-        while (newlowest % align) {
-            newlowest++;
-        }
-    }
-    if (startp >= newlowest) {
-        qt_fbdpy->ungrab();
+    if (offset < 0) {
 #ifdef DEBUG_CACHE
-        qDebug("No VRAM available for %d bytes", amount);
+        qDebug("No offscreen memory available for %d bytes", amount);
 #endif
         return 0;
     }
-    insert_entry(*entryp, newlowest, *lowest);
-    qt_fbdpy->ungrab();
-
-    return data + newlowest;
+    return d_ptr->offscreen + offset;
 }
 
 /*!
@@ -1242,8 +1755,8 @@ uchar * QLinuxFbScreenOfs::cache(int amount)
     Deletes the specified \a memoryBlock allocated from the graphics
     card memory.
 
-    Note that the display is locked while memory is unallocated in
-    order to preserve the memory pool's integrity.
+    The memory pool belongs to this process, so the display is not
+    locked while memory is unallocated.
 
     This function will first sync the graphics card to ensure the
     memory isn't still being used by a command in the graphics card
@@ -1273,23 +1786,7 @@ void QLinuxFbScreenOfs::uncache(uchar * c)
 */
 void QLinuxFbScreenOfs::deleteEntry(uchar * c)
 {
-    qt_fbdpy->grab();
-    unsigned long pos=(unsigned long)c;
-    pos-=((unsigned long)data);
-    unsigned int hold=(*entryp);
-    for(unsigned int loopc=1;loopc<hold;loopc++) {
-        if (entries[loopc].start==pos) {
-            if (entries[loopc].clientId == qws_client_id)
-                delete_entry(loopc);
-            else
-                qWarning("Attempt to delete client id %d cache entry",
-                         entries[loopc].clientId);
-            qt_fbdpy->ungrab();
-            return;
-        }
-    }
-    qt_fbdpy->ungrab();
-    qWarning("Attempt to delete unknown offset %ld",pos);
+    d_ptr->pool.release(c - d_ptr->offscreen, qws_client_id);
 }
 
 /*!
@@ -1303,41 +1800,28 @@ void QLinuxFbScreenOfs::deleteEntry(uchar * c)
 */
 void QLinuxFbScreenOfs::clearCache(QScreen *instance, int clientId)
 {
+    // the arena is per process: another client's entries went with it
     QLinuxFbScreenOfs *screen = (QLinuxFbScreenOfs *)instance;
-    if (!screen->canaccel || !screen->entryp)
+    if (!screen->canaccel || !screen->d_ptr->offscreen || clientId != qws_client_id)
         return;
-    qt_fbdpy->grab();
-    for (int loopc = 0; loopc < *(screen->entryp); loopc++) {
-        if (screen->entries[loopc].clientId == clientId) {
-            screen->delete_entry(loopc);
-            loopc--;
-        }
-    }
-    qt_fbdpy->ungrab();
+    screen->d_ptr->pool.clear(clientId);
 }
 
-
+/*
+  Offscreen pixmaps live in an arena of their own, not behind the gfx
+  surface: the compositor reads the surface, and it is allocated to the
+  size of the screen only.
+*/
 void QLinuxFbScreenOfs::setupOffScreen()
 {
-    // Figure out position of offscreen memory
-    // Set up pool entries pointer table and 64-bit align it
-    int psize = size;
-
-    // hw: this causes the limitation of cursors to 64x64
-    // the cursor should rather use the normal pixmap mechanism
-    psize += 4096;  // cursor data
-    psize += 8;     // for alignment
-    psize &= ~0x7;  // align
-
-    unsigned long pos = (unsigned long)data;
-    pos += psize;
-    entryp = ((int *)pos);
-    lowest = ((unsigned int *)pos)+1;
-    pos += (sizeof(int))*4;
-    entries = (QPoolEntry *)pos;
-
-    // beginning of offscreen memory available for pixmaps.
-    cacheStart = psize + 4*sizeof(int) + sizeof(QPoolEntry);
+    d_ptr->offscreen = (uchar *)CMEM_alloc(d_ptr->offscreenSize, &poolParams);
+    if (!d_ptr->offscreen) {
+        qWarning("QLinuxFbScreenOfs: no CMEM for %d bytes of offscreen pixmaps",
+                 d_ptr->offscreenSize);
+        canaccel = false;
+        return;
+    }
+    d_ptr->pool.init(d_ptr->offscreenSize);
 }
 
 /*!
@@ -1543,6 +2027,409 @@ void QLinuxFbScreenOfs::setDirty(const QRect &r)
         else
             ioctl(d_ptr->fd, 0x46a2, 0);
     }
+
+    // The compositor only composes the plane again when told what was
+    // drawn. Everything drawn in one pass of the event loop goes in one
+    // message, sent once the posted events before it are processed; with
+    // frame events, what is drawn meanwhile waits for the event of the
+    // last message and goes with the next frame.
+    if (d_ptr->gfxFd < 0)
+        return;
+    d_ptr->damage += r & QRect(0, 0, dw, dh);
+    if (!d_ptr->damagePosted && !d_ptr->framePending) {
+        d_ptr->damagePosted = true;
+        QCoreApplication::postEvent(d_ptr, new QEvent(DamageFlushEvent),
+                                    Qt::LowEventPriority);
+    }
+
+    // the other buffers miss what is drawn into the current one
+    for (int k = 0; k < d_ptr->numBuffers; k++)
+        if (k != d_ptr->curBuffer)
+            d_ptr->stale[k] += r & QRect(0, 0, dw, dh);
+}
+
+/*!
+    \reimp
+
+    Fills with NEON/SSE2 kernels on the RGB565 and ARGB32/RGB32 surfaces;
+    other formats go through QScreen.
+*/
+void QLinuxFbScreenOfs::solidFill(const QColor &color, const QRegion &region)
+{
+    const QImage::Format format = pixelFormat();
+    if (pixelType() != NormalPixel ||
+        (format != QImage::Format_RGB16 && format != QImage::Format_RGB32 &&
+         format != QImage::Format_ARGB32)) {
+        QScreen::solidFill(color, region);
+        return;
+    }
+
+    const QVector<QRect> rects =
+        (region.translated(-offset()) & QRect(0, 0, dw, dh)).rects();
+    const QRgb rgba = color.rgba();
+
+    qt_fbdpy->grab();
+    for (int i = 0; i < rects.size(); ++i) {
+        const QRect &r = rects.at(i);
+        if (format == QImage::Format_RGB16)
+            ofs_fill16((quint16 *)(data + r.y() * lstep) + r.x(), lstep,
+                       r.width(), r.height(), ofs_rgb32to16(rgba));
+        else
+            ofs_fill32((quint32 *)(data + r.y() * lstep) + r.x(), lstep,
+                       r.width(), r.height(), rgba);
+    }
+    qt_fbdpy->ungrab();
+}
+
+/*!
+    \reimp
+
+    Copies or converts with NEON/SSE2 kernels between the 32 bit and RGB565
+    formats; a blit replaces the pixels, exposeRegion() blends translucent
+    windows before it blits them. Other formats go through QScreen.
+*/
+void QLinuxFbScreenOfs::blit(const QImage &img, const QPoint &topLeft, const QRegion &region)
+{
+    const QImage::Format dstFormat = pixelFormat();
+    const QImage::Format srcFormat = img.format();
+    const bool dst32 = dstFormat == QImage::Format_RGB32 ||
+                       dstFormat == QImage::Format_ARGB32;
+    const bool src32 = srcFormat == QImage::Format_RGB32 ||
+                       srcFormat == QImage::Format_ARGB32 ||
+                       srcFormat == QImage::Format_ARGB32_Premultiplied;
+    if (pixelType() != NormalPixel ||
+        (!dst32 && dstFormat != QImage::Format_RGB16) ||
+        (!src32 && srcFormat != QImage::Format_RGB16)) {
+        QScreen::blit(img, topLeft, region);
+        return;
+    }
+
+    const QRect bound = (this->region() & QRect(topLeft, img.size())).boundingRect();
+    const QVector<QRect> rects = (region & bound).rects();
+    const QPoint origin = offset();
+    const int srcStep = img.bytesPerLine();
+
+    qt_fbdpy->grab();
+    for (int i = 0; i < rects.size(); ++i) {
+        const QRect &r = rects.at(i);
+        const uchar *src = img.scanLine(r.y() - topLeft.y());
+        uchar *dst = data + (r.y() - origin.y()) * lstep;
+        const int sx = r.x() - topLeft.x();
+        const int dx = r.x() - origin.x();
+
+        if (dst32 && src32)
+            ofs_copy(dst + dx * 4, lstep, src + sx * 4, srcStep,
+                     r.width() * 4, r.height());
+        else if (!dst32 && !src32)
+            ofs_copy(dst + dx * 2, lstep, src + sx * 2, srcStep,
+                     r.width() * 2, r.height());
+        else if (dst32)
+            ofs_convert_16to32((quint32 *)dst + dx, lstep,
+                               (const quint16 *)src + sx, srcStep,
+                               r.width(), r.height());
+        else
+            ofs_convert_32to16((quint16 *)dst + dx, lstep,
+                               (const quint32 *)src + sx, srcStep,
+                               r.width(), r.height());
+    }
+    qt_fbdpy->ungrab();
+}
+
+/*!
+    \reimp
+
+    Composes the windows as QScreen does, but draws translucent windows
+    with premultiplied ARGB32 surfaces into the blend buffer with the
+    NEON/SSE2 source-over kernels; with the UI over video most of the
+    screen is such a window. Windows of other formats or with an opacity
+    are blended with QPainter. Screens the other reimplementations do not
+    handle, and background brushes other than a colour, go through QScreen.
+*/
+void QLinuxFbScreenOfs::exposeRegion(QRegion r, int changing)
+{
+    const QImage::Format format = pixelFormat();
+    const Qt::BrushStyle bgStyle = QWSServer::backgroundBrush().style();
+    if (pixelType() != NormalPixel ||
+        (format != QImage::Format_RGB16 && format != QImage::Format_RGB32 &&
+         format != QImage::Format_ARGB32) ||
+        (bgStyle != Qt::SolidPattern && bgStyle != Qt::NoBrush)) {
+        QScreen::exposeRegion(r, changing);
+        return;
+    }
+
+    r &= region();
+    if (r.isEmpty())
+        return;
+
+    // a lowered window uncovers the windows below where it was
+    if (changing && qwsServer->clientWindows().at(changing)->state() == QWSWindow::Lowering)
+        changing = 0;
+
+    QRegion blendRegion;
+    QImage *blendBuffer = 0;
+    compose(0, r, blendRegion, &blendBuffer, changing);
+
+    if (blendBuffer) {
+        const QPoint topLeft = blendRegion.boundingRect().topLeft();
+#ifndef QT_NO_QWS_CURSOR
+        if (qt_screencursor && !qt_screencursor->isAccelerated()) {
+            const QRect cursorRect = qt_screencursor->boundingRect();
+            if (blendRegion.intersects(cursorRect)) {
+                QPainter p(blendBuffer);
+                p.drawImage(cursorRect.topLeft() - topLeft, qt_screencursor->image());
+            }
+        }
+#endif
+        blit(*blendBuffer, topLeft, blendRegion);
+        delete blendBuffer;
+    }
+
+    const QVector<QRect> rects = r.rects();
+    for (int i = 0; i < rects.size(); ++i)
+        setDirty(rects.at(i));
+}
+
+/*
+    QScreen::compose(): paints exposed from the window at level down, the
+    background below the last window. Translucent parts are collected in
+    blend on the way down and drawn into *blendBuffer on the way back up,
+    bottom window first; exposeRegion() blits the buffer.
+*/
+void QLinuxFbScreenOfs::compose(int level, const QRegion &exposed, QRegion &blend,
+                                QImage **blendBuffer, int changingLevel)
+{
+    const QRect exposedBounds = exposed.boundingRect();
+    QWSWindow *win = 0;
+    do {
+        win = qwsServer->clientWindows().value(level); // null is background
+        ++level;
+    } while (win && !win->paintedRegion().boundingRect().intersects(exposedBounds));
+
+    QWSWindowSurface *surface = win ? win->windowSurface() : 0;
+    const bool aboveChanging = level <= changingLevel; // 0 is topmost
+    QRegion exposedBelow = exposed;
+
+    if (win) {
+        if (win->isOpaque() || !surface->isBuffered()) {
+            exposedBelow -= win->paintedRegion();
+            if (aboveChanging || !surface->isBuffered())
+                blend -= exposed & win->paintedRegion();
+        } else {
+            blend += exposed & win->paintedRegion();
+        }
+    }
+    if (win && !exposedBelow.isEmpty()) {
+        compose(level, exposedBelow, blend, blendBuffer, changingLevel);
+    } else if (!blend.isEmpty()) {
+        *blendBuffer = new QImage(blend.boundingRect().size(),
+                                  pixelFormat() == QImage::Format_RGB16 ?
+                                  QImage::Format_RGB16 :
+                                  QImage::Format_ARGB32_Premultiplied);
+    }
+
+    const QBrush &bg = QWSServer::backgroundBrush();
+    const QRegion blitRegion = exposed - blend;
+    if (!win) {
+        if (bg.style() == Qt::SolidPattern && !blitRegion.isEmpty())
+            solidFill(bg.color(), blitRegion);
+    } else if (!aboveChanging && surface->isBuffered()) {
+        QScreen::blit(win, blitRegion);
+    }
+
+    QRegion blendRegion = exposed & blend;
+    if (win)
+        blendRegion &= win->paintedRegion();
+    if (blendRegion.isEmpty() || (win && !surface->isBuffered()))
+        return;
+
+    QImage *buf = *blendBuffer;
+    const bool buf16 = buf->format() == QImage::Format_RGB16;
+    const QPoint off = blend.boundingRect().topLeft();
+    const QVector<QRect> rects = blendRegion.translated(-off).rects();
+    const int step = buf->bytesPerLine();
+
+    if (!win) {
+        // the background replaces what is below, as QScreen's does
+        const QColor c = bg.style() == Qt::SolidPattern ? bg.color() : QColor(Qt::transparent);
+        const int a = c.alpha();
+        const QRgb color = qRgba(ofs_div255(c.red() * a), ofs_div255(c.green() * a),
+                                 ofs_div255(c.blue() * a), a);
+        for (int i = 0; i < rects.size(); ++i) {
+            const QRect &rect = rects.at(i);
+            if (buf16)
+                ofs_fill16((quint16 *)buf->scanLine(rect.y()) + rect.x(), step,
+                           rect.width(), rect.height(), ofs_rgb32to16(color));
+            else
+                ofs_fill32((quint32 *)buf->scanLine(rect.y()) + rect.x(), step,
+                           rect.width(), rect.height(), color);
+        }
+        return;
+    }
+
+    const QImage img = surface->image();
+    const QPoint winOff = win->requestedRegion().boundingRect().topLeft() - off;
+
+    if (img.format() != QImage::Format_ARGB32_Premultiplied || win->opacity() != 255) {
+        QPainter p(buf);
+        p.setClipRegion(blendRegion.translated(-off));
+        p.setOpacity(win->opacity() / 255.0);
+        p.drawImage(winOff, img);
+        return;
+    }
+
+    const int srcStep = img.bytesPerLine();
+    for (int i = 0; i < rects.size(); ++i) {
+        const QRect &rect = rects.at(i);
+        const quint32 *src = (const quint32 *)img.scanLine(rect.y() - winOff.y()) +
+                             rect.x() - winOff.x();
+        if (buf16)
+            ofs_over16((quint16 *)buf->scanLine(rect.y()) + rect.x(), step,
+                       src, srcStep, rect.width(), rect.height());
+        else
+            ofs_over32((quint32 *)buf->scanLine(rect.y()) + rect.x(), step,
+                       src, srcStep, rect.width(), rect.height());
+    }
+}
+
+/*!
+    Moves the gfx plane to \a xpos, \a ypos and resizes it to \a width x
+    \a height, in the normalized device co-ordinates of the display spec
+    options xpos, ypos, width and height. Returns false if the plane is not
+    connected to the compositor or the values are out of range.
+*/
+bool QLinuxFbScreenOfs::setPlaneGeometry(float xpos, float ypos, float width, float height)
+{
+    gfxCfg_s gfxCfg;
+
+    if (d_ptr->gfxFd < 0 || xpos < -1.0 || xpos > 1.0 || ypos < -1.0 ||
+        ypos > 1.0 || width < 0.0 || width > 2.0 || height < 0.0 || height > 2.0)
+        return false;
+
+    memset(&gfxCfg, 0, sizeof(gfxCfg));
+    gfxCfg.enable = 1;
+    gfxCfg.output_params_valid = 1;
+    gfxCfg.out_g.xpos   = xpos;
+    gfxCfg.out_g.ypos   = ypos;
+    gfxCfg.out_g.width  = width;
+    gfxCfg.out_g.height = height;
+
+    if (QT_WRITE(d_ptr->gfxFd, &gfxCfg, sizeof(gfxCfg)) != sizeof(gfxCfg)) {
+        perror("QLinuxFbScreenOfs::setPlaneGeometry");
+        return false;
+    }
+    return true;
+}
+
+/*!
+    Moves the gfx plane so its top-left corner is at \a x, \a y pixels of
+    the display, shown 1:1 as with the display spec option pos. Returns
+    false if the plane is not connected or would not fit on the display.
+*/
+bool QLinuxFbScreenOfs::setPlanePosition(int x, int y)
+{
+    gfxCfg_s gfxCfg;
+
+    if (d_ptr->gfxFd < 0 || x < 0 || y < 0)
+        return false;
+    if (d_ptr->dispWidth > 0 &&
+        (x + dw > d_ptr->dispWidth || y + dh > d_ptr->dispHeight))
+        return false;
+
+    memset(&gfxCfg, 0, sizeof(gfxCfg));
+    gfxCfg.enable = 1;
+    gfxCfg.output_params_valid = 1;
+    gfxCfg.out_g.in_pixels = 1;
+    gfxCfg.out_g.xpos      = x;
+    gfxCfg.out_g.ypos      = y;
+    gfxCfg.out_g.width     = dw;
+    gfxCfg.out_g.height    = dh;
+
+    if (QT_WRITE(d_ptr->gfxFd, &gfxCfg, sizeof(gfxCfg)) != sizeof(gfxCfg)) {
+        perror("QLinuxFbScreenOfs::setPlanePosition");
+        return false;
+    }
+    return true;
+}
+
+/*!
+    Enables or disables blending of the gfx plane; with \a globalAlpha the
+    whole plane is blended with \a alpha [0.0 to 1.0], otherwise with the
+    alpha of its pixels.
+*/
+bool QLinuxFbScreenOfs::setPlaneBlending(bool enable, bool globalAlpha, float alpha)
+{
+    if (alpha < 0.0 || alpha > 1.0)
+        return false;
+
+    d_ptr->blendEnabled       = enable;
+    d_ptr->globalAlphaEnabled = globalAlpha;
+    d_ptr->globalAlpha        = alpha;
+    return d_ptr->sendRender();
+}
+
+/*!
+    Rotates the gfx plane by \a degrees [-180.0 to 180.0].
+*/
+bool QLinuxFbScreenOfs::setPlaneRotation(float degrees)
+{
+    if (degrees < -180.0 || degrees > 180.0)
+        return false;
+
+    d_ptr->rotate = degrees;
+    return d_ptr->sendRender();
+}
+
+/*!
+    Posts a QLinuxFbFrameEvent of type frameEventType() to \a receiver once
+    the compositor shows its next frame, or after a timeout if it does not.
+    Animations step on these events instead of a timer, so they draw no
+    more frames than reach the screen.
+
+    Returns false if the compositor sends no frame events.
+*/
+bool QLinuxFbScreenOfs::requestFrame(QObject *receiver)
+{
+    if (d_ptr->evtFd < 0 || d_ptr->gfxFd < 0)
+        return false;
+
+    d_ptr->frameReceivers.append(receiver);
+    if (!d_ptr->framePending && !d_ptr->damagePosted)
+        d_ptr->flushDamage();
+    return true;
+}
+
+QEvent::Type QLinuxFbScreenOfs::frameEventType() const
+{
+    return FrameDoneEvent;
+}
+
+/*!
+    \internal
+
+    Makes the next gfx buffer the one Qt draws into. Qt only redraws what
+    changes, so the buffer first gets what was drawn since it was current.
+*/
+void QLinuxFbScreenOfs::flip()
+{
+    const int next = (d_ptr->curBuffer + 1) % d_ptr->numBuffers;
+    const uchar *src = d_ptr->bufBase + d_ptr->curBuffer * size + dataoffset;
+    uchar *dst = d_ptr->bufBase + next * size + dataoffset;
+    const int bpp = d / 8;
+    const QVector<QRect> rects = d_ptr->stale[next].rects();
+
+    for (int i = 0; i < rects.size(); ++i) {
+        const QRect &r = rects.at(i);
+        const int offset = r.y() * lstep + r.x() * bpp;
+        for (int y = 0; y < r.height(); ++y)
+            memcpy(dst + offset + y * lstep, src + offset + y * lstep,
+                   r.width() * bpp);
+    }
+    if (d_ptr->cached)
+        d_ptr->writeBack(dst, d_ptr->stale[next]);
+    d_ptr->stale[next] = QRegion();
+
+    d_ptr->curBuffer = next;
+    data = dst;
 }
 
 /*!
@@ -1665,7 +2552,7 @@ bool QLinuxFbScreenOfs::useOffscreen()
 {
     // Not done for 8Track because on e-Ink displays,
     // everything is offscreen anyway
-    if (d_ptr->driverType == EInk8Track || ((mapsize - size) < 16*1024))
+    if (d_ptr->driverType == EInk8Track || d_ptr->offscreenSize < 16*1024)
         return false;
 
     return true;
@@ -43,6 +43,7 @@
 #define QSCREENLINUXFB_QWS_H
 
 #include <QtGui/qscreen_qws.h>
+#include <QtCore/qcoreevent.h>
 
 struct fb_cmap;
 struct fb_var_screeninfo;
@@ -76,6 +77,19 @@ public:
 
 class QLinuxFbScreenOfsPrivate;
 
+// Posted to the receivers of QLinuxFbScreenOfs::requestFrame(), with the
+// type frameEventType() returns
+class QLinuxFbFrameEvent : public QEvent
+{
+public:
+    QLinuxFbFrameEvent(QEvent::Type type, qint64 present, qint64 scanout)
+        : QEvent(type), presentUs(present), scanoutUs(scanout) {}
+
+    qint64 presentUs;   // CLOCK_MONOTONIC time of the swap in us, 0 if the
+                        // compositor did not answer in time
+    qint64 scanoutUs;   // estimated time it reaches the display, 0 if unknown
+};
+
 class Q_GUI_EXPORT QLinuxFbScreenOfs : public QScreen
 {
 public:
@@ -100,6 +114,23 @@ public:
     virtual void uncache(uchar *);
     virtual int sharedRamSize(void *);
     virtual void setDirty(const QRect&);
+    virtual void solidFill(const QColor &color, const QRegion &region);
+    virtual void blit(const QImage &img, const QPoint &topLeft, const QRegion &region);
+    virtual void exposeRegion(QRegion r, int changing);
+
+    // Move, fade or rotate the gfx plane while running; the compositor
+    // applies these without recreating the plane. Virtual, so applications
+    // can call them on QScreen::instance() without linking to the plugin.
+    virtual bool setPlaneGeometry(float xpos, float ypos, float width, float height);
+    virtual bool setPlanePosition(int x, int y);
+    virtual bool setPlaneBlending(bool enable, bool globalAlpha, float alpha);
+    virtual bool setPlaneRotation(float degrees);
+
+    // Frame callbacks: receiver gets one QLinuxFbFrameEvent once the next
+    // frame of the compositor is on the screen, the time to draw the next
+    // step of an animation. False if the compositor sends no frame events.
+    virtual bool requestFrame(QObject *receiver);
+    virtual QEvent::Type frameEventType() const;
 
     QLinuxFb_Shared * shared;
 
@@ -109,20 +140,21 @@ protected:
 
     bool canaccel;
     int dataoffset;
-    int cacheStart;
 
     virtual void fixupScreenInfo(fb_fix_screeninfo &finfo, fb_var_screeninfo &vinfo);
     static void clearCache(QScreen *instance, int);
 
 private:
 
-    void delete_entry(int);
-    void insert_entry(int,int,int);
     void setupOffScreen();
     void createPalette(fb_cmap &cmap, fb_var_screeninfo &vinfo, fb_fix_screeninfo &finfo);
     void setPixelFormat(struct fb_var_screeninfo);
+    void flip();
+    void compose(int level, const QRegion &exposed, QRegion &blend,
+                 QImage **blendBuffer, int changingLevel);
 
     QLinuxFbScreenOfsPrivate *d_ptr;
+    friend class QLinuxFbScreenOfsPrivate;
 };
 
 #endif // QT_NO_QWS_LINUXFB
@@ -0,0 +1,483 @@
+/******************************************************************************
+*****************************************************************************
+ * qscreenlinuxfb_simd.cpp
+ * Fill, copy and RGB565/ARGB32 conversion kernels of the linuxfbofs driver
+ * NEON on the Cortex-A8, SSE2 on x86, plain C elsewhere
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "qscreenlinuxfb_simd.h"
+
+#define OFS_LINE(type, p, stride, y) \
+    ((type *)((uint8_t *)(p) + (y) * (stride)))
+#define OFS_CLINE(type, p, stride, y) \
+    ((const type *)((const uint8_t *)(p) + (y) * (stride)))
+
+/* Plain C */
+
+void ofs_fill32_c (uint32_t *dst, int dst_stride, int w, int h, uint32_t color)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint32_t *d = OFS_LINE(uint32_t, dst, dst_stride, y);
+        for (x = 0; x < w; x++)
+            d[x] = color;
+    }
+}
+
+void ofs_fill16_c (uint16_t *dst, int dst_stride, int w, int h, uint16_t color)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint16_t *d = OFS_LINE(uint16_t, dst, dst_stride, y);
+        for (x = 0; x < w; x++)
+            d[x] = color;
+    }
+}
+
+void ofs_convert_32to16_c (uint16_t *dst, int dst_stride, const uint32_t *src,
+                           int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint16_t *d = OFS_LINE(uint16_t, dst, dst_stride, y);
+        const uint32_t *s = OFS_CLINE(uint32_t, src, src_stride, y);
+        for (x = 0; x < w; x++)
+            d[x] = ofs_rgb32to16(s[x]);
+    }
+}
+
+void ofs_convert_16to32_c (uint32_t *dst, int dst_stride, const uint16_t *src,
+                           int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint32_t *d = OFS_LINE(uint32_t, dst, dst_stride, y);
+        const uint16_t *s = OFS_CLINE(uint16_t, src, src_stride, y);
+        for (x = 0; x < w; x++)
+            d[x] = ofs_rgb16to32(s[x]);
+    }
+}
+
+void ofs_over32_c (uint32_t *dst, int dst_stride, const uint32_t *src,
+                   int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint32_t *d = OFS_LINE(uint32_t, dst, dst_stride, y);
+        const uint32_t *s = OFS_CLINE(uint32_t, src, src_stride, y);
+        for (x = 0; x < w; x++)
+            d[x] = ofs_over(s[x], d[x]);
+    }
+}
+
+void ofs_over16_c (uint16_t *dst, int dst_stride, const uint32_t *src,
+                   int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint16_t *d = OFS_LINE(uint16_t, dst, dst_stride, y);
+        const uint32_t *s = OFS_CLINE(uint32_t, src, src_stride, y);
+        for (x = 0; x < w; x++)
+            d[x] = ofs_rgb32to16(ofs_over(s[x], ofs_rgb16to32(d[x])));
+    }
+}
+
+/* Lines are copied with memcpy(), which the C library already implements
+   with the widest loads and stores of the CPU */
+void ofs_copy (uint8_t *dst, int dst_stride, const uint8_t *src,
+               int src_stride, int bytes, int h)
+{
+    int y;
+
+    if (dst_stride == bytes && src_stride == bytes) {
+        memcpy(dst, src, bytes * h);
+        return;
+    }
+    for (y = 0; y < h; y++)
+        memcpy(dst + y * dst_stride, src + y * src_stride, bytes);
+}
+
+#if defined(__ARM_NEON__)
+
+/* NEON: 8 pixels per step; vld4/vst4 split ARGB32 into its channels */
+
+void ofs_fill32 (uint32_t *dst, int dst_stride, int w, int h, uint32_t color)
+{
+    const uint32x4_t c = vdupq_n_u32(color);
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint32_t *d = OFS_LINE(uint32_t, dst, dst_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            vst1q_u32(d + x, c);
+            vst1q_u32(d + x + 4, c);
+        }
+        for (; x < w; x++)
+            d[x] = color;
+    }
+}
+
+void ofs_fill16 (uint16_t *dst, int dst_stride, int w, int h, uint16_t color)
+{
+    const uint16x8_t c = vdupq_n_u16(color);
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint16_t *d = OFS_LINE(uint16_t, dst, dst_stride, y);
+        for (x = 0; x + 16 <= w; x += 16) {
+            vst1q_u16(d + x, c);
+            vst1q_u16(d + x + 8, c);
+        }
+        for (; x < w; x++)
+            d[x] = color;
+    }
+}
+
+void ofs_convert_32to16 (uint16_t *dst, int dst_stride, const uint32_t *src,
+                         int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint16_t *d = OFS_LINE(uint16_t, dst, dst_stride, y);
+        const uint32_t *s = OFS_CLINE(uint32_t, src, src_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            uint8x8x4_t p = vld4_u8((const uint8_t *)(s + x));  /* b g r a */
+            uint16x8_t r = vshll_n_u8(p.val[2], 8);
+            uint16x8_t g = vshll_n_u8(p.val[1], 8);
+            uint16x8_t b = vshll_n_u8(p.val[0], 8);
+            r = vsriq_n_u16(r, g, 5);       /* rrrrrggg gggxxxxx */
+            r = vsriq_n_u16(r, b, 11);      /* rrrrrggg gggbbbbb */
+            vst1q_u16(d + x, r);
+        }
+        for (; x < w; x++)
+            d[x] = ofs_rgb32to16(s[x]);
+    }
+}
+
+void ofs_convert_16to32 (uint32_t *dst, int dst_stride, const uint16_t *src,
+                         int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint32_t *d = OFS_LINE(uint32_t, dst, dst_stride, y);
+        const uint16_t *s = OFS_CLINE(uint16_t, src, src_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            uint16x8_t c = vld1q_u16(s + x);
+            uint8x8_t r = vshrn_n_u16(c, 8);
+            uint8x8_t g = vshrn_n_u16(c, 3);
+            uint8x8_t b = vmovn_u16(vshlq_n_u16(c, 3));
+            uint8x8x4_t p;
+            p.val[0] = vsri_n_u8(b, b, 5);
+            p.val[1] = vsri_n_u8(g, g, 6);
+            p.val[2] = vsri_n_u8(r, r, 5);
+            p.val[3] = vdup_n_u8(0xff);
+            vst4_u8((uint8_t *)(d + x), p);
+        }
+        for (; x < w; x++)
+            d[x] = ofs_rgb16to32(s[x]);
+    }
+}
+
+/* s + d * ia / 255 per channel, rounded as ofs_div255() */
+static inline uint8x8_t ofs_neon_over (uint8x8_t s, uint8x8_t d, uint8x8_t ia)
+{
+    uint16x8_t t = vmull_u8(d, ia);
+    return vqadd_u8(s, vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+}
+
+void ofs_over32 (uint32_t *dst, int dst_stride, const uint32_t *src,
+                 int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint32_t *d = OFS_LINE(uint32_t, dst, dst_stride, y);
+        const uint32_t *s = OFS_CLINE(uint32_t, src, src_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            uint8x8x4_t sp = vld4_u8((const uint8_t *)(s + x));
+            uint8x8x4_t dp = vld4_u8((const uint8_t *)(d + x));
+            uint8x8_t ia = vmvn_u8(sp.val[3]);
+            dp.val[0] = ofs_neon_over(sp.val[0], dp.val[0], ia);
+            dp.val[1] = ofs_neon_over(sp.val[1], dp.val[1], ia);
+            dp.val[2] = ofs_neon_over(sp.val[2], dp.val[2], ia);
+            dp.val[3] = ofs_neon_over(sp.val[3], dp.val[3], ia);
+            vst4_u8((uint8_t *)(d + x), dp);
+        }
+        for (; x < w; x++)
+            d[x] = ofs_over(s[x], d[x]);
+    }
+}
+
+void ofs_over16 (uint16_t *dst, int dst_stride, const uint32_t *src,
+                 int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint16_t *d = OFS_LINE(uint16_t, dst, dst_stride, y);
+        const uint32_t *s = OFS_CLINE(uint32_t, src, src_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            uint8x8x4_t sp = vld4_u8((const uint8_t *)(s + x));
+            uint16x8_t c = vld1q_u16(d + x);
+            uint8x8_t r = vshrn_n_u16(c, 8);
+            uint8x8_t g = vshrn_n_u16(c, 3);
+            uint8x8_t b = vmovn_u16(vshlq_n_u16(c, 3));
+            uint8x8_t ia = vmvn_u8(sp.val[3]);
+            r = ofs_neon_over(sp.val[2], vsri_n_u8(r, r, 5), ia);
+            g = ofs_neon_over(sp.val[1], vsri_n_u8(g, g, 6), ia);
+            b = ofs_neon_over(sp.val[0], vsri_n_u8(b, b, 5), ia);
+            c = vsriq_n_u16(vshll_n_u8(r, 8), vshll_n_u8(g, 8), 5);
+            c = vsriq_n_u16(c, vshll_n_u8(b, 8), 11);
+            vst1q_u16(d + x, c);
+        }
+        for (; x < w; x++)
+            d[x] = ofs_rgb32to16(ofs_over(s[x], ofs_rgb16to32(d[x])));
+    }
+}
+
+#elif defined(__SSE2__)
+
+/* SSE2: 8 pixels per step, unaligned loads and stores */
+
+void ofs_fill32 (uint32_t *dst, int dst_stride, int w, int h, uint32_t color)
+{
+    const __m128i c = _mm_set1_epi32(color);
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint32_t *d = OFS_LINE(uint32_t, dst, dst_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            _mm_storeu_si128((__m128i *)(d + x), c);
+            _mm_storeu_si128((__m128i *)(d + x + 4), c);
+        }
+        for (; x < w; x++)
+            d[x] = color;
+    }
+}
+
+void ofs_fill16 (uint16_t *dst, int dst_stride, int w, int h, uint16_t color)
+{
+    const __m128i c = _mm_set1_epi16(color);
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint16_t *d = OFS_LINE(uint16_t, dst, dst_stride, y);
+        for (x = 0; x + 16 <= w; x += 16) {
+            _mm_storeu_si128((__m128i *)(d + x), c);
+            _mm_storeu_si128((__m128i *)(d + x + 8), c);
+        }
+        for (; x < w; x++)
+            d[x] = color;
+    }
+}
+
+static inline __m128i ofs_sse_32to16 (__m128i p)
+{
+    __m128i v = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xf800)),
+                     _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07e0))),
+        _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001f)));
+    /* sign extend, so the saturating pack keeps all 16 bits */
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+void ofs_convert_32to16 (uint16_t *dst, int dst_stride, const uint32_t *src,
+                         int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint16_t *d = OFS_LINE(uint16_t, dst, dst_stride, y);
+        const uint32_t *s = OFS_CLINE(uint32_t, src, src_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            __m128i lo = ofs_sse_32to16(_mm_loadu_si128((const __m128i *)(s + x)));
+            __m128i hi = ofs_sse_32to16(_mm_loadu_si128((const __m128i *)(s + x + 4)));
+            _mm_storeu_si128((__m128i *)(d + x), _mm_packs_epi32(lo, hi));
+        }
+        for (; x < w; x++)
+            d[x] = ofs_rgb32to16(s[x]);
+    }
+}
+
+static inline __m128i ofs_sse_16to32 (__m128i c)
+{
+    __m128i r = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(c, 8), _mm_set1_epi32(0xf80000)),
+                             _mm_and_si128(_mm_slli_epi32(c, 3), _mm_set1_epi32(0x070000)));
+    __m128i g = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(c, 5), _mm_set1_epi32(0x00fc00)),
+                             _mm_and_si128(_mm_srli_epi32(c, 1), _mm_set1_epi32(0x000300)));
+    __m128i b = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(c, 3), _mm_set1_epi32(0x0000f8)),
+                             _mm_and_si128(_mm_srli_epi32(c, 2), _mm_set1_epi32(0x000007)));
+    return _mm_or_si128(_mm_or_si128(r, g),
+                        _mm_or_si128(b, _mm_set1_epi32(0xff000000)));
+}
+
+void ofs_convert_16to32 (uint32_t *dst, int dst_stride, const uint16_t *src,
+                         int src_stride, int w, int h)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint32_t *d = OFS_LINE(uint32_t, dst, dst_stride, y);
+        const uint16_t *s = OFS_CLINE(uint16_t, src, src_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            __m128i c = _mm_loadu_si128((const __m128i *)(s + x));
+            _mm_storeu_si128((__m128i *)(d + x),
+                             ofs_sse_16to32(_mm_unpacklo_epi16(c, zero)));
+            _mm_storeu_si128((__m128i *)(d + x + 4),
+                             ofs_sse_16to32(_mm_unpackhi_epi16(c, zero)));
+        }
+        for (; x < w; x++)
+            d[x] = ofs_rgb16to32(s[x]);
+    }
+}
+
+/* source-over of 2 pixels unpacked to 16 bits per channel */
+static inline __m128i ofs_sse_over_half (__m128i s, __m128i d)
+{
+    __m128i ia = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+    __m128i t = _mm_mullo_epi16(d, _mm_xor_si128(ia, _mm_set1_epi16(0xff)));
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+/* source-over of 4 pixels */
+static inline __m128i ofs_sse_over (__m128i s, __m128i d)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = ofs_sse_over_half(_mm_unpacklo_epi8(s, zero),
+                                   _mm_unpacklo_epi8(d, zero));
+    __m128i hi = ofs_sse_over_half(_mm_unpackhi_epi8(s, zero),
+                                   _mm_unpackhi_epi8(d, zero));
+    return _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+}
+
+void ofs_over32 (uint32_t *dst, int dst_stride, const uint32_t *src,
+                 int src_stride, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint32_t *d = OFS_LINE(uint32_t, dst, dst_stride, y);
+        const uint32_t *s = OFS_CLINE(uint32_t, src, src_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            __m128i s0 = _mm_loadu_si128((const __m128i *)(s + x));
+            __m128i s1 = _mm_loadu_si128((const __m128i *)(s + x + 4));
+            __m128i d0 = _mm_loadu_si128((const __m128i *)(d + x));
+            __m128i d1 = _mm_loadu_si128((const __m128i *)(d + x + 4));
+            _mm_storeu_si128((__m128i *)(d + x), ofs_sse_over(s0, d0));
+            _mm_storeu_si128((__m128i *)(d + x + 4), ofs_sse_over(s1, d1));
+        }
+        for (; x < w; x++)
+            d[x] = ofs_over(s[x], d[x]);
+    }
+}
+
+void ofs_over16 (uint16_t *dst, int dst_stride, const uint32_t *src,
+                 int src_stride, int w, int h)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        uint16_t *d = OFS_LINE(uint16_t, dst, dst_stride, y);
+        const uint32_t *s = OFS_CLINE(uint32_t, src, src_stride, y);
+        for (x = 0; x + 8 <= w; x += 8) {
+            __m128i c = _mm_loadu_si128((const __m128i *)(d + x));
+            __m128i lo = ofs_sse_over(_mm_loadu_si128((const __m128i *)(s + x)),
+                                      ofs_sse_16to32(_mm_unpacklo_epi16(c, zero)));
+            __m128i hi = ofs_sse_over(_mm_loadu_si128((const __m128i *)(s + x + 4)),
+                                      ofs_sse_16to32(_mm_unpackhi_epi16(c, zero)));
+            _mm_storeu_si128((__m128i *)(d + x),
+                             _mm_packs_epi32(ofs_sse_32to16(lo), ofs_sse_32to16(hi)));
+        }
+        for (; x < w; x++)
+            d[x] = ofs_rgb32to16(ofs_over(s[x], ofs_rgb16to32(d[x])));
+    }
+}
+
+#else
+
+void ofs_fill32 (uint32_t *dst, int dst_stride, int w, int h, uint32_t color)
+{
+    ofs_fill32_c(dst, dst_stride, w, h, color);
+}
+
+void ofs_fill16 (uint16_t *dst, int dst_stride, int w, int h, uint16_t color)
+{
+    ofs_fill16_c(dst, dst_stride, w, h, color);
+}
+
+void ofs_convert_32to16 (uint16_t *dst, int dst_stride, const uint32_t *src,
+                         int src_stride, int w, int h)
+{
+    ofs_convert_32to16_c(dst, dst_stride, src, src_stride, w, h);
+}
+
+void ofs_convert_16to32 (uint32_t *dst, int dst_stride, const uint16_t *src,
+                         int src_stride, int w, int h)
+{
+    ofs_convert_16to32_c(dst, dst_stride, src, src_stride, w, h);
+}
+
+void ofs_over32 (uint32_t *dst, int dst_stride, const uint32_t *src,
+                 int src_stride, int w, int h)
+{
+    ofs_over32_c(dst, dst_stride, src, src_stride, w, h);
+}
+
+void ofs_over16 (uint16_t *dst, int dst_stride, const uint32_t *src,
+                 int src_stride, int w, int h)
+{
+    ofs_over16_c(dst, dst_stride, src, src_stride, w, h);
+}
+
+#endif
@@ -0,0 +1,118 @@
+/******************************************************************************
+*****************************************************************************
+ * qscreenlinuxfb_simd.h
+ * Fill, copy, blend and RGB565/ARGB32 conversion kernels of the linuxfbofs driver
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+#ifndef QSCREENLINUXFB_SIMD_H
+#define QSCREENLINUXFB_SIMD_H
+
+#include <stdint.h>
+
+/*
+ * Kernels behind QLinuxFbScreenOfs::solidFill(), blit() and the blending of
+ * translucent windows in exposeRegion(). Each works on
+ * a w x h rectangle; strides are in bytes. The ofs_*_c variants are the
+ * plain C versions, used for the tail of each line and where no SIMD unit
+ * is available.
+ *
+ * The conversions match Qt's: ARGB32 to RGB565 drops the alpha channel
+ * (a premultiplied source ends up over black), RGB565 to ARGB32 replicates
+ * the top bits into the low ones and sets alpha to 0xff.
+ *
+ * ofs_over32/ofs_over16 draw a premultiplied ARGB32 source over the
+ * destination (source-over, dst = src + dst * (255 - src alpha) / 255,
+ * rounded); RGB565 destinations are expanded, blended and truncated back
+ * with the conversions above.
+ */
+
+void ofs_fill32 (uint32_t *dst, int dst_stride, int w, int h, uint32_t color);
+void ofs_fill16 (uint16_t *dst, int dst_stride, int w, int h, uint16_t color);
+void ofs_copy (uint8_t *dst, int dst_stride, const uint8_t *src,
+               int src_stride, int bytes, int h);
+void ofs_convert_32to16 (uint16_t *dst, int dst_stride, const uint32_t *src,
+                         int src_stride, int w, int h);
+void ofs_convert_16to32 (uint32_t *dst, int dst_stride, const uint16_t *src,
+                         int src_stride, int w, int h);
+void ofs_over32 (uint32_t *dst, int dst_stride, const uint32_t *src,
+                 int src_stride, int w, int h);
+void ofs_over16 (uint16_t *dst, int dst_stride, const uint32_t *src,
+                 int src_stride, int w, int h);
+
+void ofs_fill32_c (uint32_t *dst, int dst_stride, int w, int h, uint32_t color);
+void ofs_fill16_c (uint16_t *dst, int dst_stride, int w, int h, uint16_t color);
+void ofs_convert_32to16_c (uint16_t *dst, int dst_stride, const uint32_t *src,
+                           int src_stride, int w, int h);
+void ofs_convert_16to32_c (uint32_t *dst, int dst_stride, const uint16_t *src,
+                           int src_stride, int w, int h);
+void ofs_over32_c (uint32_t *dst, int dst_stride, const uint32_t *src,
+                   int src_stride, int w, int h);
+void ofs_over16_c (uint16_t *dst, int dst_stride, const uint32_t *src,
+                   int src_stride, int w, int h);
+
+static inline uint16_t ofs_rgb32to16 (uint32_t c)
+{
+    return ((c >> 8) & 0xf800) | ((c >> 5) & 0x07e0) | ((c >> 3) & 0x001f);
+}
+
+static inline uint32_t ofs_rgb16to32 (uint16_t c)
+{
+    return 0xff000000
+        | ((c << 8) & 0xf80000) | ((c << 3) & 0x070000)
+        | ((c << 5) & 0x00fc00) | ((c >> 1) & 0x000300)
+        | ((c << 3) & 0x0000f8) | ((c >> 2) & 0x000007);
+}
+
+/* t / 255 rounded, for t up to 255 * 255 */
+static inline uint32_t ofs_div255 (uint32_t t)
+{
+    t += 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t ofs_over (uint32_t s, uint32_t d)
+{
+    const uint32_t ia = 255 - (s >> 24);
+    uint32_t r = 0;
+    int shift;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        uint32_t c = ((s >> shift) & 0xff) + ofs_div255(((d >> shift) & 0xff) * ia);
+        r |= (c > 255 ? 255 : c) << shift;
+    }
+    return r;
+}
+
+#endif // QSCREENLINUXFB_SIMD_H
@@ -0,0 +1,210 @@
+/******************************************************************************
+*****************************************************************************
+ * qscreenlinuxfb_simd_bench.cpp
+ * Throughput of the linuxfbofs blit kernels against plain C
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ *   Neither the name of Texas Instruments Incorporated nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Contact: mmurthy@ti.com
+ ****************************************************************************/
+
+/*
+ * Build with "qmake qscreenlinuxfb_simd_bench.pro && make" and run on the
+ * target as
+ *
+ *   qscreenlinuxfb_simd_bench [milliseconds per case]
+ *
+ * Each kernel runs on rectangles of typical widget sizes inside an
+ * 800x480 surface, as solidFill(), blit() and the blending of translucent
+ * windows see them while QWS repaints a window; every case is first
+ * checked against the plain C version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "qscreenlinuxfb_simd.h"
+
+#define SURF_W 800
+#define SURF_H 480
+
+static const struct { const char *name; int w, h; } sizes[] = {
+    { "icon   32x32 ",  32,  32 },
+    { "button 120x40",  120, 40 },
+    { "row    480x48",  480, 48 },
+    { "dialog 320x240", 320, 240 },
+    { "screen 800x480", 800, 480 },
+};
+
+enum { FILL32, FILL16, COPY32, CONV32TO16, CONV16TO32, OVER32, OVER16,
+       NUM_OPS };
+
+static const char *op_names[NUM_OPS] = {
+    "fill ARGB32", "fill RGB565", "copy ARGB32",
+    "ARGB32 -> RGB565", "RGB565 -> ARGB32",
+    "ARGB32 over ARGB32", "ARGB32 over RGB565"
+};
+
+static uint32_t src32[SURF_W * SURF_H], dst32[SURF_W * SURF_H];
+static uint16_t src16[SURF_W * SURF_H], dst16[SURF_W * SURF_H];
+static uint32_t ref32[SURF_W * SURF_H];
+static uint16_t ref16[SURF_W * SURF_H];
+
+static double now_sec (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* widgets start at odd positions, not on a SIMD boundary */
+static void run_op (int op, int simd, int w, int h)
+{
+    const int x = 3, y = 5;
+    uint32_t *d32 = dst32 + y * SURF_W + x;
+    uint16_t *d16 = dst16 + y * SURF_W + x;
+    const uint32_t *s32 = src32 + y * SURF_W + x;
+    const uint16_t *s16 = src16 + y * SURF_W + x;
+
+    if (x + w > SURF_W)
+        d32 -= x, d16 -= x, s32 -= x, s16 -= x;
+    if (y + h > SURF_H)
+        d32 -= y * SURF_W, d16 -= y * SURF_W, s32 -= y * SURF_W, s16 -= y * SURF_W;
+
+    switch (op) {
+    case FILL32:
+        (simd ? ofs_fill32 : ofs_fill32_c) (d32, SURF_W * 4, w, h, 0x80336699);
+        break;
+    case FILL16:
+        (simd ? ofs_fill16 : ofs_fill16_c) (d16, SURF_W * 2, w, h, 0x3333);
+        break;
+    case COPY32:
+        if (simd) {
+            ofs_copy ((uint8_t *)d32, SURF_W * 4, (const uint8_t *)s32,
+                      SURF_W * 4, w * 4, h);
+        } else {
+            for (int j = 0; j < h; j++)
+                for (int i = 0; i < w; i++)
+                    d32[j * SURF_W + i] = s32[j * SURF_W + i];
+        }
+        break;
+    case CONV32TO16:
+        (simd ? ofs_convert_32to16 : ofs_convert_32to16_c)
+            (d16, SURF_W * 2, s32, SURF_W * 4, w, h);
+        break;
+    case CONV16TO32:
+        (simd ? ofs_convert_16to32 : ofs_convert_16to32_c)
+            (d32, SURF_W * 4, s16, SURF_W * 2, w, h);
+        break;
+    case OVER32:
+        (simd ? ofs_over32 : ofs_over32_c)
+            (d32, SURF_W * 4, s32, SURF_W * 4, w, h);
+        break;
+    case OVER16:
+        (simd ? ofs_over16 : ofs_over16_c)
+            (d16, SURF_W * 2, s32, SURF_W * 4, w, h);
+        break;
+    }
+}
+
+/* the blends read the destination, it starts as a copy of the sources */
+static void reset_dst (void)
+{
+    memcpy (dst32, src32, sizeof (dst32));
+    memcpy (dst16, src16, sizeof (dst16));
+}
+
+static int check (int op, int w, int h)
+{
+    reset_dst ();
+    run_op (op, 0, w, h);
+    memcpy (ref32, dst32, sizeof (dst32));
+    memcpy (ref16, dst16, sizeof (dst16));
+
+    reset_dst ();
+    run_op (op, 1, w, h);
+    return memcmp (ref32, dst32, sizeof (dst32)) == 0 &&
+           memcmp (ref16, dst16, sizeof (dst16)) == 0;
+}
+
+/* megapixels per second over about ms milliseconds */
+static double measure (int op, int simd, int w, int h, int ms)
+{
+    long iterations = 0;
+    double start = now_sec (), elapsed;
+
+    do {
+        for (int i = 0; i < 16; i++)
+            run_op (op, simd, w, h);
+        iterations += 16;
+        elapsed = now_sec () - start;
+    } while (elapsed * 1000 < ms);
+
+    return (double) iterations * w * h / elapsed / 1e6;
+}
+
+int main (int argc, char **argv)
+{
+    int ms = argc > 1 ? atoi (argv[1]) : 200;
+    int failed = 0;
+
+    /* premultiplied, a quarter of it transparent and a quarter opaque as
+       around the controls of a UI over video */
+    srand (1);
+    for (int i = 0; i < SURF_W * SURF_H; i++) {
+        uint32_t a = rand () % 4 == 0 ? 0 : rand () % 3 == 0 ? 255 : rand () & 0xff;
+        src32[i] = a << 24 | (rand () % (a + 1)) << 16 |
+                   (rand () % (a + 1)) << 8 | rand () % (a + 1);
+        src16[i] = rand ();
+    }
+
+    printf ("%-18s %-15s %10s %10s\n", "", "", "C Mpix/s", "SIMD Mpix/s");
+    for (int op = 0; op < NUM_OPS; op++) {
+        for (unsigned s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++) {
+            int w = sizes[s].w, h = sizes[s].h;
+            double c, simd;
+
+            if (!check (op, w, h)) {
+                printf ("%-18s %-15s MISMATCH\n", op_names[op], sizes[s].name);
+                failed = 1;
+                continue;
+            }
+            c = measure (op, 0, w, h, ms);
+            simd = measure (op, 1, w, h, ms);
+            printf ("%-18s %-15s %10.1f %10.1f  (x%.2f)\n", op_names[op],
+                    sizes[s].name, c, simd, simd / c);
+        }
+    }
+    return failed;
+}
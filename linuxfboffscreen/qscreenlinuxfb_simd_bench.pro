@@ -0,0 +1,12 @@
+# blit kernel microbenchmark, not installed
+TEMPLATE = app
+TARGET = qscreenlinuxfb_simd_bench
+CONFIG -= qt
+CONFIG += console
+
+contains(QT_ARCH, arm): QMAKE_CXXFLAGS += -mfpu=neon
+
+HEADERS = qscreenlinuxfb_simd.h
+
+SOURCES = qscreenlinuxfb_simd_bench.cpp \
+          qscreenlinuxfb_simd.cpp
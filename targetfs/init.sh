@@ -66,3 +66,42 @@ then
 mkfifo -m 644 /opt/gpu-compositing/named_pipes/gfx_cfg_plane_3
 fi
 
+#----------------------------------
+# Named pipes for Graphics events
+# --------------------------------
+# Graphics Plane #0 events
+ls /opt/gpu-compositing/named_pipes/gfx_evt_plane_0 &> /dev/NULL
+if [ $? -eq 1 ]
+then
+mkfifo -m 644 /opt/gpu-compositing/named_pipes/gfx_evt_plane_0
+fi
+
+# Graphics Plane #1 events
+ls /opt/gpu-compositing/named_pipes/gfx_evt_plane_1 &> /dev/NULL
+if [ $? -eq 1 ]
+then
+mkfifo -m 644 /opt/gpu-compositing/named_pipes/gfx_evt_plane_1
+fi
+
+# Graphics Plane #2 events
+ls /opt/gpu-compositing/named_pipes/gfx_evt_plane_2 &> /dev/NULL
+if [ $? -eq 1 ]
+then
+mkfifo -m 644 /opt/gpu-compositing/named_pipes/gfx_evt_plane_2
+fi
+
+# Graphics Plane #3 events
+ls /opt/gpu-compositing/named_pipes/gfx_evt_plane_3 &> /dev/NULL
+if [ $? -eq 1 ]
+then
+mkfifo -m 644 /opt/gpu-compositing/named_pipes/gfx_evt_plane_3
+fi
+
+#----------------------------------
+# Named pipe for plane animations
+# --------------------------------
+ls /opt/gpu-compositing/named_pipes/plane_anim &> /dev/NULL
+if [ $? -eq 1 ]
+then
+mkfifo -m 644 /opt/gpu-compositing/named_pipes/plane_anim
+fi